@@ -0,0 +1,17 @@
+#include "bench.h"
+#include <stdio.h>
+#include <time.h>
+
+double bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+void bench_report(const char* name, double seconds, uint64_t nr_ops) {
+    double per_op = 0;
+    if (nr_ops) {
+        per_op = (seconds * 1e9) / (double)nr_ops;
+    }
+    fprintf(stderr, "%-40s %10.3f ms %12lu ops %10.1f ns/op\n", name, seconds * 1e3, nr_ops, per_op);
+}
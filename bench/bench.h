@@ -0,0 +1,22 @@
+#ifndef H_BENCH
+#define H_BENCH
+
+#include <stdint.h>
+
+/**
+ * @brief Monotonic wall clock in seconds
+ *
+ * @return Seconds since an arbitrary fixed point
+ */
+double bench_now();
+
+/**
+ * @brief Print one result line
+ *
+ * @param name What was measured
+ * @param seconds Wall time taken
+ * @param nr_ops Number of operations performed in that time
+ */
+void bench_report(const char* name, double seconds, uint64_t nr_ops);
+
+#endif
@@ -0,0 +1,67 @@
+#include "../chunk.h"
+#include "../chunk_node.h"
+#include "../chunk_arena.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NR_RECORDS 2000000
+
+// Linked with -Wl,--wrap=malloc so every allocation is counted.
+static uint64_t nr_mallocs = 0;
+
+void* __real_malloc(size_t size);
+
+void* __wrap_malloc(size_t size) {
+    nr_mallocs++;
+    return __real_malloc(size);
+}
+
+uint8_t* make_document(uint64_t* size) {
+    uint8_t* data = malloc((uint64_t)NR_RECORDS * 32);
+    uint8_t* walk = data + 9;
+    for (uint64_t i = 0; i < NR_RECORDS; i++) {
+        uint8_t nr_leaves = 1 + (i % 3);
+        walk = chunk_write_header(walk, CHUNK_TYPE_SET, nr_leaves * 3);
+        for (uint8_t j = 0; j < nr_leaves; j++) {
+            walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+            *walk++ = (uint8_t)(i + j);
+        }
+    }
+    chunk_write_header(data, CHUNK_TYPE_SET, (walk - data) - 9);
+    *size = walk - data;
+    return data;
+}
+
+int main(int argc, char** argv) {
+    uint64_t size = 0;
+    uint8_t* data = make_document(&size);
+
+    uint64_t before = nr_mallocs;
+    double start = bench_now();
+    chunk_node_t* root = chunk_node_build(data);
+    double build = bench_now() - start;
+    uint64_t heap_mallocs = nr_mallocs - before;
+
+    start = bench_now();
+    chunk_node_destroy(root);
+    double destroy = bench_now() - start;
+
+    fprintf(stderr, "heap  build: %8.3f ms destroy: %8.3f ms mallocs: %lu\n", build * 1e3, destroy * 1e3, heap_mallocs);
+
+    before = nr_mallocs;
+    start = bench_now();
+    chunk_arena_t* arena = chunk_arena_create(CHUNK_ARENA_BLOCK_SIZE);
+    root = chunk_node_build_arena(data, arena);
+    build = bench_now() - start;
+    uint64_t arena_mallocs = nr_mallocs - before;
+
+    start = bench_now();
+    chunk_node_destroy_arena(root, arena);
+    destroy = bench_now() - start;
+
+    fprintf(stderr, "arena build: %8.3f ms destroy: %8.3f ms mallocs: %lu\n", build * 1e3, destroy * 1e3, arena_mallocs);
+
+    free(data);
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "../chunk.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NR_RECORDS 1000000
+#define NR_PASSES 10
+
+uint8_t* write_record(uint8_t* data, uint64_t i, uint8_t compact) {
+    uint8_t* start = data;
+    uint8_t nr_leaves = 1 + (i % 3);
+    if (compact) {
+        data = chunk_set_begin(start);
+    }
+    else {
+        data = chunk_write_header(start, CHUNK_TYPE_SET, nr_leaves * 3);
+    }
+    for (uint8_t j = 0; j < nr_leaves; j++) {
+        data = chunk_write_header(data, CHUNK_TYPE_UINT8, 1);
+        *data++ = (uint8_t)(i + j);
+    }
+    if (compact) {
+        data = chunk_set_end(start, data);
+    }
+    return data;
+}
+
+uint8_t* make_document(uint8_t compact, uint64_t* size) {
+    uint8_t* data = malloc(NR_RECORDS * 32);
+    uint8_t* walk = NULL;
+    if (compact) {
+        walk = chunk_set_begin(data);
+    }
+    else {
+        walk = data + 9;
+    }
+    for (uint64_t i = 0; i < NR_RECORDS; i++) {
+        walk = write_record(walk, i, compact);
+    }
+    if (compact) {
+        walk = chunk_set_end(data, walk);
+    }
+    else {
+        chunk_write_header(data, CHUNK_TYPE_SET, (walk - data) - 9);
+    }
+    *size = walk - data;
+    return data;
+}
+
+uint64_t sum_leaves(uint8_t* start) {
+    chunk_t chunk = chunk_decode(start);
+    if (chunk.type != CHUNK_TYPE_SET) {
+        return chunk.data[0];
+    }
+    uint64_t sum = 0;
+    uint64_t remaining = chunk.data_length;
+    uint8_t* data = chunk.data;
+    while (remaining) {
+        chunk_t child = chunk_decode(data);
+        sum += sum_leaves(data);
+        data += child.total_length;
+        remaining -= child.total_length;
+    }
+    return sum;
+}
+
+void run(const char* name, uint8_t compact) {
+    uint64_t size = 0;
+    uint8_t* data = make_document(compact, &size);
+    uint64_t sum = 0;
+    double start = bench_now();
+    for (uint8_t i = 0; i < NR_PASSES; i++) {
+        sum += sum_leaves(data);
+    }
+    double seconds = bench_now() - start;
+    fprintf(stderr, "%s: %lu bytes, %.1f MB/s, %.1f M records/s (sum %lu)\n", name, size, ((double)size * NR_PASSES) / seconds / 1e6, ((double)NR_RECORDS * NR_PASSES) / seconds / 1e6, sum);
+    free(data);
+}
+
+int main(int argc, char** argv) {
+    run("fixed 8 byte set lengths", 0);
+    run("compact LEB128 set lengths", 1);
+    return 0;
+}
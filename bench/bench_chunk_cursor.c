@@ -0,0 +1,70 @@
+#include "../chunk.h"
+#include "../chunk_node.h"
+#include "../chunk_cursor.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEPTH 200
+#define WIDTH 64
+#define NR_MOVES 1000000
+
+// DEPTH nested sets, each holding WIDTH uint8 leaves before the next set
+uint8_t* make_document(void) {
+    uint64_t level = 1 + 8 + (WIDTH * 3);
+    uint8_t* data = malloc(DEPTH * level + 9);
+    uint8_t* walk = data;
+    for (uint64_t d = 0; d <= DEPTH; d++) {
+        // the full levels below this one and the empty set at the bottom
+        uint64_t below = (DEPTH - d - 1) * level + 9;
+        walk = chunk_write_header(walk, CHUNK_TYPE_SET, (d == DEPTH) ? 0 : (WIDTH * 3) + below);
+        if (d == DEPTH) {
+            break;
+        }
+        for (uint64_t i = 0; i < WIDTH; i++) {
+            walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+            *walk++ = (uint8_t)i;
+        }
+    }
+    return data;
+}
+
+int main(int argc, char** argv) {
+    uint8_t* data = make_document();
+    chunk_node_t* root = chunk_node_build(data);
+
+    // walk to the bottom, then step along the leaves of the deepest level
+    uint64_t path[DEPTH + 1];
+    for (uint64_t d = 0; d < DEPTH; d++) {
+        path[d] = WIDTH;
+    }
+    path[DEPTH - 1] = 0;
+    uint64_t sum = 0;
+    double start = bench_now();
+    for (uint64_t i = 0; i < NR_MOVES; i++) {
+        path[DEPTH - 1] = i % WIDTH;
+        sum += chunk_node_select(root, path, DEPTH)->data_length;
+    }
+    double select = bench_now() - start;
+
+    chunk_cursor_t cursor;
+    chunk_cursor_init(&cursor, root);
+    chunk_cursor_select(&cursor, root, path, DEPTH);
+    start = bench_now();
+    for (uint64_t i = 0; i < NR_MOVES; i++) {
+        if (!chunk_cursor_next(&cursor)) {
+            chunk_cursor_seek(&cursor, 0);
+        }
+        sum += cursor.node->data_length;
+    }
+    double moves = bench_now() - start;
+
+    fprintf(stderr, "depth %u (%lu)\n", DEPTH, sum);
+    bench_report("select from root", select, NR_MOVES);
+    bench_report("cursor move", moves, NR_MOVES);
+
+    chunk_cursor_destroy(&cursor);
+    chunk_node_destroy(root);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include "../chunk_endian.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NR_ITEMS (8 * 1024 * 1024)
+
+int main(int argc, char** argv) {
+    uint64_t size = (uint64_t)NR_ITEMS * 8;
+    uint8_t* src = malloc(size);
+    uint8_t* dest = malloc(size);
+    for (uint64_t i = 0; i < size; i++) {
+        src[i] = (uint8_t)i;
+    }
+    memset(dest, 0, size);
+    memcpy(dest, src, size);
+
+    double start = bench_now();
+    memcpy(dest, src, size);
+    double seconds = bench_now() - start;
+    fprintf(stderr, "memcpy:                  %.1f MB/s (%u)\n", (double)size / seconds / 1e6, dest[size - 1]);
+
+    start = bench_now();
+    for (uint64_t i = 0; i < NR_ITEMS; i++) {
+        for (uint8_t b = 0; b < 8; b++) {
+            dest[(i * 8) + b] = src[(i * 8) + (7 - b)];
+        }
+    }
+    seconds = bench_now() - start;
+    fprintf(stderr, "byte loop float64:       %.1f MB/s (%u)\n", (double)size / seconds / 1e6, dest[size - 1]);
+
+    start = bench_now();
+    chunk_byteswap(dest, src, CHUNK_TYPE_FLOAT64, NR_ITEMS);
+    seconds = bench_now() - start;
+    fprintf(stderr, "chunk_byteswap float64:  %.1f MB/s (%u)\n", (double)size / seconds / 1e6, dest[size - 1]);
+
+    start = bench_now();
+    chunk_byteswap(dest, src, CHUNK_TYPE_UINT16, NR_ITEMS * 4);
+    seconds = bench_now() - start;
+    fprintf(stderr, "chunk_byteswap uint16:   %.1f MB/s (%u)\n", (double)size / seconds / 1e6, dest[size - 1]);
+
+    start = bench_now();
+    chunk_byteswap(dest, dest, CHUNK_TYPE_UINT32, NR_ITEMS * 2);
+    seconds = bench_now() - start;
+    fprintf(stderr, "chunk_byteswap in place: %.1f MB/s (%u)\n", (double)size / seconds / 1e6, dest[size - 1]);
+
+    free(src);
+    free(dest);
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include "../chunk_gap.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LEAF_SIZE (4 * 1024 * 1024)
+#define NR_KEYSTROKES 100000
+#define NR_KEYSTROKES_COPY 1000
+
+int main(int argc, char** argv) {
+    uint8_t* leaf = malloc(LEAF_SIZE);
+    memset(leaf, 'a', LEAF_SIZE);
+    uint8_t key = 'b';
+
+    // what chunk_node_data_insert() did: a fresh buffer per keystroke
+    uint64_t length = LEAF_SIZE;
+    uint8_t* data = malloc(length);
+    memcpy(data, leaf, length);
+    double start = bench_now();
+    for (uint64_t i = 0; i < NR_KEYSTROKES_COPY; i++) {
+        uint64_t location = (LEAF_SIZE / 2) + i;
+        uint8_t* data_new = malloc(length + 1);
+        memcpy(data_new, data, location);
+        data_new[location] = key;
+        memcpy(&data_new[location + 1], &data[location], length - location);
+        free(data);
+        data = data_new;
+        length++;
+    }
+    bench_report("copy per keystroke", bench_now() - start, NR_KEYSTROKES_COPY);
+    free(data);
+
+    chunk_gap_t gap;
+    chunk_gap_init(&gap, leaf, LEAF_SIZE);
+    start = bench_now();
+    for (uint64_t i = 0; i < NR_KEYSTROKES; i++) {
+        chunk_gap_insert(&gap, (LEAF_SIZE / 2) + i, &key, 1);
+    }
+    bench_report("gap buffer", bench_now() - start, NR_KEYSTROKES);
+    chunk_gap_destroy(&gap);
+
+    free(leaf);
+    return 0;
+}
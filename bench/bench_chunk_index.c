@@ -0,0 +1,62 @@
+#include "../chunk_index.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NR_ITEMS 50000
+#define NR_LOOKUPS 2000
+
+uint8_t* make_wide_set(uint64_t nr_items, uint64_t* size) {
+    uint64_t data_length = nr_items * 3;
+    *size = 9 + data_length;
+    uint8_t* data = malloc(*size);
+    uint8_t* walk = chunk_write_header(data, CHUNK_TYPE_SET, data_length);
+    for (uint64_t i = 0; i < nr_items; i++) {
+        walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+        *walk = (uint8_t)i;
+        walk++;
+    }
+    return data;
+}
+
+int main(int argc, char** argv) {
+    uint64_t size = 0;
+    uint8_t* data = make_wide_set(NR_ITEMS, &size);
+    chunk_t set = chunk_decode(data);
+    uint64_t check = 0;
+
+    uint32_t* lookups = malloc(sizeof(uint32_t) * NR_LOOKUPS);
+    srand(1);
+    for (uint32_t i = 0; i < NR_LOOKUPS; i++) {
+        lookups[i] = rand() % NR_ITEMS;
+    }
+
+    double start = bench_now();
+    for (uint32_t i = 0; i < NR_LOOKUPS; i++) {
+        check += chunk_set_item_byte_offset(set, lookups[i]);
+    }
+    bench_report("chunk_set_item_byte_offset (scan)", bench_now() - start, NR_LOOKUPS);
+
+    chunk_index_t index;
+    chunk_index_init(&index, set);
+
+    start = bench_now();
+    chunk_index_build(&index);
+    bench_report("chunk_index_build", bench_now() - start, 1);
+
+    start = bench_now();
+    for (uint32_t i = 0; i < NR_LOOKUPS; i++) {
+        check -= chunk_index_item_byte_offset(&index, lookups[i]);
+    }
+    bench_report("chunk_index_item_byte_offset", bench_now() - start, NR_LOOKUPS);
+
+    if (check != 0) {
+        fprintf(stderr, "offsets disagree\n");
+        return 1;
+    }
+
+    chunk_index_destroy(&index);
+    free(lookups);
+    free(data);
+    return 0;
+}
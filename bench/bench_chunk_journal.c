@@ -0,0 +1,64 @@
+#include "../chunk.h"
+#include "../chunk_node.h"
+#include "../chunk_journal.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NR_RECORDS 2000000
+#define NR_EDITS 100000
+
+uint8_t* make_document(uint64_t* size) {
+    uint8_t* data = malloc((uint64_t)NR_RECORDS * 32);
+    uint8_t* walk = data + 9;
+    for (uint64_t i = 0; i < NR_RECORDS; i++) {
+        uint8_t nr_leaves = 1 + (i % 3);
+        walk = chunk_write_header(walk, CHUNK_TYPE_SET, nr_leaves * 3);
+        for (uint8_t j = 0; j < nr_leaves; j++) {
+            walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+            *walk++ = (uint8_t)(i + j);
+        }
+    }
+    chunk_write_header(data, CHUNK_TYPE_SET, (walk - data) - 9);
+    *size = walk - data;
+    return data;
+}
+
+int main(int argc, char** argv) {
+    uint64_t size = 0;
+    uint8_t* data = make_document(&size);
+    chunk_node_t* root = chunk_node_build_lazy(data);
+    chunk_journal_t journal;
+    chunk_journal_init(&journal);
+
+    double start = bench_now();
+    for (uint64_t i = 0; i < NR_EDITS; i++) {
+        uint64_t path[2] = {(i * 7919) % NR_RECORDS, 0};
+        uint8_t value = (uint8_t)i;
+        if (i % 2) {
+            chunk_journal_data_replace(&journal, root, path, 2, 0, 1, &value, 1);
+        }
+        else {
+            chunk_journal_set_insert(&journal, root, path, 1, 0, CHUNK_TYPE_UINT8);
+        }
+    }
+    double edit = bench_now() - start;
+
+    start = bench_now();
+    while (chunk_journal_undo(&journal, root));
+    double undo = bench_now() - start;
+
+    start = bench_now();
+    while (chunk_journal_redo(&journal, root));
+    double redo = bench_now() - start;
+
+    fprintf(stderr, "journal: %lu entries, %.1f bytes each\n", journal.nr_entries, (double)journal.length / journal.nr_entries);
+    bench_report("edit through journal", edit, NR_EDITS);
+    bench_report("undo", undo, NR_EDITS);
+    bench_report("redo", redo, NR_EDITS);
+
+    chunk_journal_destroy(&journal);
+    chunk_node_destroy(root);
+    free(data);
+    return 0;
+}
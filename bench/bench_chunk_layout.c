@@ -0,0 +1,83 @@
+#include "../chunk.h"
+#include "../chunk_node.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NR_RECORDS 1000000
+#define NR_PASSES 10
+
+// Linked with -Wl,--wrap=malloc so every allocation is counted.
+static uint64_t nr_mallocs = 0;
+
+void* __real_malloc(size_t size);
+
+void* __wrap_malloc(size_t size) {
+    nr_mallocs++;
+    return __real_malloc(size);
+}
+
+// Records of a uint32 id, a uint8 flag and a name, one name in four too long
+// to keep in a node.
+uint8_t* make_document(void) {
+    uint8_t* data = malloc((uint64_t)NR_RECORDS * 48);
+    uint8_t* walk = data + 9;
+    for (uint64_t i = 0; i < NR_RECORDS; i++) {
+        const char* name = (i % 4) ? "short" : "a longer name";
+        uint64_t name_length = strlen(name);
+        walk = chunk_write_header(walk, CHUNK_TYPE_SET, 6 + 3 + 2 + name_length);
+        walk = chunk_write_header(walk, CHUNK_TYPE_UINT32, 4);
+        *(uint32_t*)walk = (uint32_t)i;
+        walk += 4;
+        walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+        *walk++ = (uint8_t)(i & 1);
+        walk = chunk_write_header(walk, CHUNK_TYPE_UTF8, name_length);
+        memcpy(walk, name, name_length);
+        walk += name_length;
+    }
+    chunk_write_header(data, CHUNK_TYPE_SET, (walk - data) - 9);
+    return data;
+}
+
+int main(int argc, char** argv) {
+    uint8_t* data = make_document();
+
+    uint64_t before = nr_mallocs;
+    chunk_node_t* root = chunk_node_build(data);
+    uint64_t mallocs = nr_mallocs - before;
+    uint64_t memory = chunk_node_memory(root);
+    uint64_t nr_nodes = 1 + NR_RECORDS * 4;
+
+    uint64_t sum = 0;
+    double start = bench_now();
+    for (uint64_t pass = 0; pass < NR_PASSES; pass++) {
+        chunk_node_iter_t iter;
+        chunk_node_iter_init(&iter, root, CHUNK_ITER_PRE_ORDER);
+        chunk_node_t* walk = NULL;
+        while ((walk = chunk_node_iter_next(&iter)) != NULL) {
+            sum += walk->data_length;
+        }
+        chunk_node_iter_destroy(&iter);
+    }
+    double iterate = bench_now() - start;
+
+    // read each record's id through its node, as a viewer or query would
+    start = bench_now();
+    for (uint64_t pass = 0; pass < NR_PASSES; pass++) {
+        for (uint64_t i = 0; i < NR_RECORDS; i++) {
+            chunk_node_t* id = chunk_node_child(chunk_node_child(root, i), 0);
+            sum += *(uint32_t*)id->data;
+        }
+    }
+    double index = bench_now() - start;
+
+    fprintf(stderr, "node %lu bytes, %lu nodes, %lu mallocs, %.1f MB (%.1f bytes per node) (%lu)\n",
+        sizeof(chunk_node_t), nr_nodes, mallocs, memory / 1e6, (double)memory / nr_nodes, sum);
+    bench_report("pre-order walk", iterate, nr_nodes * NR_PASSES);
+    bench_report("indexed field read", index, (uint64_t)NR_RECORDS * NR_PASSES);
+
+    chunk_node_destroy(root);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "../chunk.h"
+#include "../chunk_node.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NR_RECORDS 2000000
+
+uint8_t* make_document(uint64_t* size) {
+    uint8_t* data = malloc((uint64_t)NR_RECORDS * 32);
+    uint8_t* walk = data + 9;
+    for (uint64_t i = 0; i < NR_RECORDS; i++) {
+        uint8_t nr_leaves = 1 + (i % 3);
+        walk = chunk_write_header(walk, CHUNK_TYPE_SET, nr_leaves * 3);
+        for (uint8_t j = 0; j < nr_leaves; j++) {
+            walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+            *walk++ = (uint8_t)(i + j);
+        }
+    }
+    chunk_write_header(data, CHUNK_TYPE_SET, (walk - data) - 9);
+    *size = walk - data;
+    return data;
+}
+
+int main(int argc, char** argv) {
+    uint64_t size = 0;
+    uint8_t* data = make_document(&size);
+    uint64_t addr[2] = {NR_RECORDS / 2, 0};
+
+    double start = bench_now();
+    chunk_node_t* root = chunk_node_build(data);
+    chunk_node_select(root, addr, 2);
+    double eager = bench_now() - start;
+    chunk_node_destroy(root);
+
+    start = bench_now();
+    root = chunk_node_build_lazy(data);
+    chunk_node_select(root, addr, 2);
+    double lazy = bench_now() - start;
+    chunk_node_destroy(root);
+
+    fprintf(stderr, "open and select one record, eager: %8.3f ms\n", eager * 1e3);
+    fprintf(stderr, "open and select one record, lazy:  %8.3f ms\n", lazy * 1e3);
+
+    free(data);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "../chunk.h"
+#include "../chunk_node.h"
+#include "../chunk_arena.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define NR_RECORDS 4000000
+
+uint8_t* make_document(uint64_t* size) {
+    uint8_t* data = malloc((uint64_t)NR_RECORDS * 32);
+    uint8_t* walk = data + 9;
+    for (uint64_t i = 0; i < NR_RECORDS; i++) {
+        uint8_t nr_leaves = 1 + (i % 3);
+        walk = chunk_write_header(walk, CHUNK_TYPE_SET, nr_leaves * 3);
+        for (uint8_t j = 0; j < nr_leaves; j++) {
+            walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+            *walk++ = (uint8_t)(i + j);
+        }
+    }
+    chunk_write_header(data, CHUNK_TYPE_SET, (walk - data) - 9);
+    *size = walk - data;
+    return data;
+}
+
+int main(int argc, char** argv) {
+    uint64_t size = 0;
+    uint8_t* data = make_document(&size);
+    long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    fprintf(stderr, "document: %.1f MB, %ld cpus\n", (double)size / 1e6, nr_cpus);
+
+    for (uint32_t nr_threads = 1; nr_threads <= 2 * nr_cpus; nr_threads *= 2) {
+        chunk_arena_t* arena = chunk_arena_create(0);
+        double start = bench_now();
+        chunk_node_t* root = chunk_node_build_parallel(data, arena, nr_threads);
+        double build = bench_now() - start;
+        fprintf(stderr, "threads: %3u build: %8.3f ms\n", nr_threads, build * 1e3);
+        chunk_node_destroy_arena(root, arena);
+    }
+
+    free(data);
+    return 0;
+}
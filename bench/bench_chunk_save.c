@@ -0,0 +1,81 @@
+#include "../chunk.h"
+#include "../chunk_node.h"
+#include "../chunk_save.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define NR_RECORDS 8000000
+
+uint8_t* make_document(uint64_t* size) {
+    uint8_t* data = malloc((uint64_t)NR_RECORDS * 32);
+    uint8_t* walk = data + 9;
+    for (uint64_t i = 0; i < NR_RECORDS; i++) {
+        uint8_t nr_leaves = 1 + (i % 3);
+        walk = chunk_write_header(walk, CHUNK_TYPE_SET, nr_leaves * 3);
+        for (uint8_t j = 0; j < nr_leaves; j++) {
+            walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+            *walk++ = (uint8_t)(i + j);
+        }
+    }
+    chunk_write_header(data, CHUNK_TYPE_SET, (walk - data) - 9);
+    *size = walk - data;
+    return data;
+}
+
+int main(int argc, char** argv) {
+    uint64_t size = 0;
+    uint8_t* data = make_document(&size);
+    char in_path[] = "/tmp/bench_chunk_save_in_XXXXXX";
+    char out_path[] = "/tmp/bench_chunk_save_out_XXXXXX";
+    int in = mkstemp(in_path);
+    int out = mkstemp(out_path);
+    unlink(in_path);
+    unlink(out_path);
+    if (write(in, data, size) != (ssize_t)size) {
+        return 1;
+    }
+    free(data);
+    uint8_t* map = mmap(0, size, PROT_READ, MAP_SHARED, in, 0);
+
+    // the cost floor: one sequential copy of the mapping
+    double start = bench_now();
+    if (write(out, map, size) != (ssize_t)size) {
+        return 1;
+    }
+    double copy = bench_now() - start;
+
+    chunk_node_t* root = chunk_node_build_lazy(map);
+    uint64_t addr[2] = {NR_RECORDS / 2, 0};
+    chunk_node_t* leaf = chunk_node_select(root, addr, 2);
+    uint8_t value = 0xff;
+    chunk_node_data_delete(leaf, 0, 1);
+    chunk_node_data_insert(leaf, 0, &value, 1);
+
+    chunk_save_stats_t stats;
+    ftruncate(out, 0);
+    lseek(out, 0, SEEK_SET);
+    start = bench_now();
+    chunk_save_fd(root, out, &stats);
+    double save = bench_now() - start;
+
+    // the same edit kept its length, so only its byte has to reach the file
+    chunk_save_stats_t patch_stats;
+    start = bench_now();
+    chunk_save_patch(root, in, map, &patch_stats);
+    double patch = bench_now() - start;
+
+    fprintf(stderr, "document: %.1f MB\n", (double)size / 1e6);
+    fprintf(stderr, "sequential write: %8.3f ms\n", copy * 1e3);
+    fprintf(stderr, "save after edit:  %8.3f ms (%lu iovecs, %lu writes, %.1f%% reused)\n", save * 1e3, stats.nr_iovecs, stats.nr_writes, (stats.nr_reused * 100.0) / stats.nr_bytes);
+    fprintf(stderr, "patch after edit: %8.3f ms (%lu patches, %lu bytes)\n", patch * 1e3, patch_stats.nr_patches, patch_stats.nr_bytes);
+
+    chunk_node_destroy(root);
+    munmap(map, size);
+    close(in);
+    close(out);
+    return 0;
+}
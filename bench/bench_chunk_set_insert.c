@@ -0,0 +1,35 @@
+#include "../chunk.h"
+#include "../chunk_node.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NR_INSERTS 100000
+
+uint8_t EMPTY_SET[] = {0x8d, 0, 0, 0, 0, 0, 0, 0, 0};
+
+int main(int argc, char** argv) {
+    chunk_node_t* root = chunk_node_build(EMPTY_SET);
+    double start = bench_now();
+    for (uint64_t i = 0; i < NR_INSERTS; i++) {
+        chunk_node_set_insert(root, root->nr_children);
+    }
+    bench_report("chunk_node_set_insert append", bench_now() - start, NR_INSERTS);
+    chunk_node_destroy(root);
+
+    root = chunk_node_build(EMPTY_SET);
+    start = bench_now();
+    for (uint64_t i = 0; i < NR_INSERTS; i++) {
+        chunk_node_set_insert(root, root->nr_children / 2);
+    }
+    bench_report("chunk_node_set_insert middle", bench_now() - start, NR_INSERTS);
+
+    uint64_t sum = 0;
+    start = bench_now();
+    for (uint64_t i = 0; i < NR_INSERTS; i++) {
+        sum += chunk_node_child(root, (i * 7919) % NR_INSERTS)->type;
+    }
+    bench_report("chunk_node_child random", bench_now() - start, NR_INSERTS);
+    chunk_node_destroy(root);
+    return (int)sum;
+}
@@ -0,0 +1,70 @@
+#include "../chunk.h"
+#include "../chunk_node.h"
+#include "../chunk_snap.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NR_RECORDS 2000000
+#define NR_SNAPSHOTS 100
+
+uint8_t* make_document(uint64_t* size) {
+    uint8_t* data = malloc((uint64_t)NR_RECORDS * 32);
+    uint8_t* walk = data + 9;
+    // a few wide sets of records, so an edit dirties one of them
+    for (uint64_t i = 0; i < 1000; i++) {
+        uint8_t* set = walk;
+        walk += 9;
+        for (uint64_t k = 0; k < (NR_RECORDS / 1000); k++) {
+            walk = chunk_write_header(walk, CHUNK_TYPE_SET, 6);
+            walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+            *walk++ = (uint8_t)k;
+            walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+            *walk++ = (uint8_t)i;
+        }
+        chunk_write_header(set, CHUNK_TYPE_SET, (walk - set) - 9);
+    }
+    chunk_write_header(data, CHUNK_TYPE_SET, (walk - data) - 9);
+    *size = walk - data;
+    return data;
+}
+
+int main(int argc, char** argv) {
+    uint64_t size = 0;
+    uint8_t* data = make_document(&size);
+    chunk_node_t* root = chunk_node_build_lazy(data);
+
+    // the floor for a snapshot by copying: the encoded bytes alone
+    uint8_t* copy = malloc(size);
+    memset(copy, 0, size);
+    double start = bench_now();
+    memcpy(copy, data, size);
+    double deep = bench_now() - start;
+    uint8_t check = copy[size / 2];
+    free(copy);
+
+    chunk_snap_t* snaps[NR_SNAPSHOTS];
+    uint8_t value = 0xff;
+    double take = 0;
+    for (uint64_t i = 0; i < NR_SNAPSHOTS; i++) {
+        uint64_t addr[3] = {(i * 7) % 1000, (i * 13) % (NR_RECORDS / 1000), 0};
+        chunk_node_t* leaf = chunk_node_select(root, addr, 3);
+        chunk_node_data_delete(leaf, 0, 1);
+        chunk_node_data_insert(leaf, 0, &value, 1);
+        start = bench_now();
+        snaps[i] = chunk_snap_take(root);
+        take += bench_now() - start;
+    }
+
+    fprintf(stderr, "document: %.1f MB\n", (double)size / 1e6);
+    fprintf(stderr, "byte copy:         %8.3f ms (%02x)\n", deep * 1e3, check);
+    bench_report("snapshot after edit", take, NR_SNAPSHOTS);
+
+    for (uint64_t i = 0; i < NR_SNAPSHOTS; i++) {
+        chunk_snap_release(snaps[i]);
+    }
+    chunk_node_destroy(root);
+    free(data);
+    return 0;
+}
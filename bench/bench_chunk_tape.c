@@ -0,0 +1,70 @@
+#include "../chunk_tape.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NR_RECORDS 4000000
+
+uint8_t* make_document(uint64_t* size) {
+    uint8_t* data = malloc((uint64_t)NR_RECORDS * 32);
+    uint8_t* walk = data + 9;
+    for (uint64_t i = 0; i < NR_RECORDS; i++) {
+        uint8_t nr_leaves = 1 + (i % 3);
+        walk = chunk_write_header(walk, CHUNK_TYPE_SET, nr_leaves * 3);
+        for (uint8_t j = 0; j < nr_leaves; j++) {
+            walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+            *walk++ = (uint8_t)(i + j);
+        }
+    }
+    chunk_write_header(data, CHUNK_TYPE_SET, (walk - data) - 9);
+    *size = walk - data;
+    return data;
+}
+
+uint64_t count_chunks(uint8_t* start) {
+    chunk_t chunk = chunk_decode(start);
+    uint64_t count = 1;
+    if (chunk.type != CHUNK_TYPE_SET) {
+        return count;
+    }
+    uint64_t remaining = chunk.data_length;
+    uint8_t* data = chunk.data;
+    while (remaining) {
+        chunk_t child = chunk_decode(data);
+        count += count_chunks(data);
+        data += child.total_length;
+        remaining -= child.total_length;
+    }
+    return count;
+}
+
+int main(int argc, char** argv) {
+    uint64_t size = 0;
+    uint8_t* data = make_document(&size);
+    double start = 0;
+    double seconds = 0;
+
+    uint8_t* copy = malloc(size);
+    memset(copy, 0, size);
+    start = bench_now();
+    memcpy(copy, data, size);
+    seconds = bench_now() - start;
+    fprintf(stderr, "memcpy:           %.1f MB/s (%u)\n", (double)size / seconds / 1e6, copy[size - 1]);
+    free(copy);
+
+    start = bench_now();
+    uint64_t count = count_chunks(data);
+    seconds = bench_now() - start;
+    fprintf(stderr, "recursive walk:   %.1f MB/s (%lu chunks)\n", (double)size / seconds / 1e6, count);
+
+    chunk_tape_t tape;
+    start = bench_now();
+    chunk_tape_build(&tape, data);
+    seconds = bench_now() - start;
+    fprintf(stderr, "chunk_tape_build: %.1f MB/s (%u entries)\n", (double)size / seconds / 1e6, tape.nr_entries);
+
+    chunk_tape_destroy(&tape);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "../chunk.h"
+#include "../chunk_node.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NR_RECORDS 2000000
+
+uint8_t* make_document(uint64_t* size) {
+    uint8_t* data = malloc((uint64_t)NR_RECORDS * 32);
+    uint8_t* walk = data + 9;
+    for (uint64_t i = 0; i < NR_RECORDS; i++) {
+        uint8_t nr_leaves = 1 + (i % 3);
+        walk = chunk_write_header(walk, CHUNK_TYPE_SET, nr_leaves * 3);
+        for (uint8_t j = 0; j < nr_leaves; j++) {
+            walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+            *walk++ = (uint8_t)(i + j);
+        }
+    }
+    chunk_write_header(data, CHUNK_TYPE_SET, (walk - data) - 9);
+    *size = walk - data;
+    return data;
+}
+
+int main(int argc, char** argv) {
+    uint64_t size = 0;
+    uint8_t* data = make_document(&size);
+
+    double start = bench_now();
+    chunk_error_t error = chunk_validate(data, size, NULL);
+    double validate = bench_now() - start;
+
+    start = bench_now();
+    chunk_node_t* root = chunk_node_build(data);
+    double build = bench_now() - start;
+
+    fprintf(stderr, "chunk_validate:   %8.3f ms %.1f MB/s (%s)\n", validate * 1e3, (double)size / validate / 1e6, chunk_error_name(error));
+    fprintf(stderr, "chunk_node_build: %8.3f ms %.1f MB/s\n", build * 1e3, (double)size / build / 1e6);
+    fprintf(stderr, "validation is %.1f%% of load\n", (validate * 100) / (validate + build));
+
+    chunk_node_destroy(root);
+    free(data);
+    return 0;
+}
@@ -64,6 +64,111 @@ uint8_t* chunk_write_header(uint8_t* data, chunk_type_t type, uint64_t length) {
     return chunk_write_length_bytes(data, nr_length_bytes, length);
 }
 
+uint8_t chunk_varint_length_bytes(uint64_t length) {
+    uint8_t bytes = 1;
+    while (length >>= 7) bytes++;
+    return bytes;
+}
+
+uint8_t* chunk_write_varint(uint8_t* data, uint64_t length) {
+    while (length > 0x7f) {
+        *data = (length & 0x7f) | 0x80;
+        length >>= 7;
+        data++;
+    }
+    *data = length;
+    data++;
+    return data;
+}
+
+uint8_t* chunk_write_header_compact(uint8_t* data, chunk_type_t type, uint64_t length) {
+    *data = (CHUNK_LENGTH_VARINT << 4) | (type & 0x0f);
+    data++;
+    return chunk_write_varint(data, length);
+}
+
+uint8_t* chunk_write_varint_padded(uint8_t* data, uint64_t length, uint8_t nr_bytes) {
+    for (uint8_t i = 0; i < nr_bytes; i++) {
+        *data = (length & 0x7f);
+        if (i < (nr_bytes - 1)) {
+            *data |= 0x80;
+        }
+        length >>= 7;
+        data++;
+    }
+    return data;
+}
+
+uint8_t* chunk_write_header_aligned(uint8_t* data, uint64_t offset, chunk_type_t type, uint64_t length) {
+    uint8_t align = chunk_bytes_per_type(type);
+    if ((type == CHUNK_TYPE_SET) || (align <= 1)) {
+        return chunk_write_header(data, type, length);
+    }
+    for (uint8_t n = chunk_nr_length_bytes(length); n <= 8; n++) {
+        if (((offset + 1 + n) % align) == 0) {
+            *data = ((n & 0x0f) << 4) | (type & 0x0f);
+            return chunk_write_length_bytes(data + 1, n, length);
+        }
+    }
+    for (uint8_t n = chunk_varint_length_bytes(length); n <= CHUNK_VARINT_MAX; n++) {
+        if (((offset + 1 + n) % align) == 0) {
+            *data = (CHUNK_LENGTH_VARINT << 4) | (type & 0x0f);
+            return chunk_write_varint_padded(data + 1, length, n);
+        }
+    }
+    return chunk_write_header(data, type, length);
+}
+
+uint8_t* chunk_set_begin(uint8_t* data) {
+    return data + 1 + CHUNK_VARINT_MAX;
+}
+
+uint8_t* chunk_set_end(uint8_t* set, uint8_t* end) {
+    uint8_t* contents = set + 1 + CHUNK_VARINT_MAX;
+    uint64_t length = end - contents;
+    uint8_t* data = chunk_write_header_compact(set, CHUNK_TYPE_SET, length);
+    memmove(data, contents, length);
+    return data + length;
+}
+
+uint8_t* chunk_write_header_counted(uint8_t* data, uint64_t length, uint64_t nr_items) {
+    *data = (CHUNK_LENGTH_COUNTED << 4) | CHUNK_TYPE_SET;
+    data = chunk_write_varint(data + 1, length);
+    return chunk_write_varint(data, nr_items);
+}
+
+uint8_t* chunk_set_end_counted(uint8_t* set, uint8_t* end, uint64_t nr_items) {
+    uint8_t* contents = set + CHUNK_COUNTED_HEADER_MAX;
+    uint64_t length = end - contents;
+    uint8_t* data = chunk_write_header_counted(set, length, nr_items);
+    memmove(data, contents, length);
+    return data + length;
+}
+
+uint8_t chunk_is_counted(chunk_t chunk) {
+    if ((chunk.type != CHUNK_TYPE_SET) || (chunk.address == NULL)) {
+        return 0;
+    }
+    return ((chunk.address[0] >> 0x04) & 0x0f) == CHUNK_LENGTH_COUNTED;
+}
+
+uint64_t chunk_read_varint(uint8_t* data, uint64_t* value) {
+    uint64_t index = 0;
+    *value = 0;
+    // the 10th byte ends the varint and may only carry bit 63; anything more
+    // does not fit and gives a length no buffer can hold
+    while ((index < (CHUNK_VARINT_MAX - 1)) && (data[index] & 0x80)) {
+        *value |= ((uint64_t)(data[index] & 0x7f) << (7 * index));
+        index++;
+    }
+    if ((index == (CHUNK_VARINT_MAX - 1)) && (data[index] > 1)) {
+        *value = UINT64_MAX;
+        return index + 1;
+    }
+    *value |= ((uint64_t)data[index] << (7 * index));
+    return index + 1;
+}
+
 uint8_t* chunk_make(uint8_t* data, chunk_t chunk) {
     return chunk_write_header(data, chunk.type, chunk.data_length);
 }
@@ -80,8 +185,18 @@ chunk_t chunk_decode_head(uint8_t* start) {
 
 uint64_t chunk_calculate_length(uint8_t* start, chunk_t* chunk) {
     uint64_t index = 1;
+    if ((chunk->nr_length_bytes == CHUNK_LENGTH_VARINT) || (chunk->nr_length_bytes == CHUNK_LENGTH_COUNTED)) {
+        index += chunk_read_varint(&start[index], &chunk->data_length);
+        if (chunk->nr_length_bytes == CHUNK_LENGTH_COUNTED) {
+            uint64_t nr_items = 0;
+            index += chunk_read_varint(&start[index], &nr_items);
+        }
+        chunk->nr_length_bytes = index - 1;
+        chunk->total_length = index + chunk->data_length;
+        return index;
+    }
     for (uint8_t i = 0; i < chunk->nr_length_bytes; i++) {
-        chunk->data_length |= (start[index] << (0x08 * i));
+        chunk->data_length |= ((uint64_t)start[index] << (0x08 * i));
         index++;
     }
     chunk->total_length = 1 + chunk->nr_length_bytes + chunk->data_length;
@@ -133,30 +248,170 @@ uint8_t chunk_set_get_nth(uint8_t* data, chunk_t* dest, uint64_t nth) {
 }
 
 uint64_t chunk_byte_offset(uint8_t* data, uint32_t* idx, uint32_t nr_idx) {
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < nr_idx; i++) {
+        uint64_t child_offset = chunk_set_item_byte_offset(chunk_decode(&data[offset]), idx[i]);
+        if (child_offset == 0) {
+            return 0;
+        }
+        offset += child_offset;
+    }
+    return offset;
+}
+
+typedef struct chunk_path {
+    uint32_t* idx;
+    uint32_t nr_idx;
+    uint32_t order;
+} chunk_path_t;
+
+static int chunk_path_compare(const void* a, const void* b) {
+    const chunk_path_t* pa = a;
+    const chunk_path_t* pb = b;
+    uint32_t nr = (pa->nr_idx < pb->nr_idx) ? pa->nr_idx : pb->nr_idx;
+    for (uint32_t i = 0; i < nr; i++) {
+        if (pa->idx[i] != pb->idx[i]) {
+            return (pa->idx[i] < pb->idx[i]) ? -1 : 1;
+        }
+    }
+    if (pa->nr_idx != pb->nr_idx) {
+        return (pa->nr_idx < pb->nr_idx) ? -1 : 1;
+    }
+    return 0;
+}
+
+static void chunk_byte_offsets_resolve(uint8_t* data, uint64_t base, chunk_path_t* paths, uint32_t nr_paths, uint32_t depth, uint64_t* offsets) {
     chunk_t chunk = chunk_decode(data);
-    if (chunk.type != CHUNK_TYPE_SET) {
-        return 0;
+    uint64_t remaining = 0;
+    uint8_t* walk = NULL;
+    uint64_t count = 0;
+    uint64_t offset = 1 + chunk.nr_length_bytes;
+    if (chunk.type == CHUNK_TYPE_SET) {
+        remaining = chunk.data_length;
+        walk = chunk.data;
     }
-    uint64_t offset = chunk_set_item_byte_offset(chunk, idx[0]);
-    if (offset == 0) {
+
+    uint32_t i = 0;
+    while (i < nr_paths) {
+        uint32_t target = paths[i].idx[depth];
+        uint32_t end = i + 1;
+        while ((end < nr_paths) && (paths[end].idx[depth] == target)) {
+            end++;
+        }
+
+        chunk_t child;
+        while (remaining && (count < target)) {
+            child = chunk_decode(walk);
+            offset += child.total_length;
+            walk += child.total_length;
+            remaining -= child.total_length;
+            count++;
+        }
+
+        uint8_t found = (chunk.type == CHUNK_TYPE_SET) && (count == target);
+        uint8_t has_child = found && remaining;
+        for (; i < end; i++) {
+            if (!found) {
+                offsets[paths[i].order] = 0;
+                continue;
+            }
+            if (paths[i].nr_idx == (depth + 1)) {
+                offsets[paths[i].order] = base + offset;
+                continue;
+            }
+            if (!has_child) {
+                offsets[paths[i].order] = 0;
+                continue;
+            }
+            uint32_t start = i;
+            while ((i + 1 < end) && (paths[i + 1].nr_idx > (depth + 1))) {
+                i++;
+            }
+            chunk_byte_offsets_resolve(walk, base + offset, &paths[start], (i - start) + 1, depth + 1, offsets);
+        }
+    }
+}
+
+uint8_t chunk_byte_offsets(uint8_t* data, uint32_t** idx, uint32_t* nr_idx, uint32_t nr_paths, uint64_t* offsets) {
+    chunk_path_t* paths = malloc(sizeof(chunk_path_t) * nr_paths);
+    if ((paths == NULL) && (nr_paths > 0)) {
         return 0;
     }
-    nr_idx--;
-    if (nr_idx == 0) {
-        return offset;
+    uint32_t nr_valid = 0;
+    for (uint32_t i = 0; i < nr_paths; i++) {
+        offsets[i] = 0;
+        if (nr_idx[i] == 0) {
+            continue;
+        }
+        paths[nr_valid].idx = idx[i];
+        paths[nr_valid].nr_idx = nr_idx[i];
+        paths[nr_valid].order = i;
+        nr_valid++;
     }
-    data += offset;
-    uint64_t child_offset = chunk_byte_offset(data, &idx[1], nr_idx);
-    if (child_offset == 0) {
-        return 0;
+    qsort(paths, nr_valid, sizeof(chunk_path_t), chunk_path_compare);
+    if (nr_valid) {
+        chunk_byte_offsets_resolve(data, 0, paths, nr_valid, 0, offsets);
+    }
+    free(paths);
+    return 1;
+}
+
+void* chunk_view(chunk_t chunk, chunk_type_t type, uint64_t* nr_items) {
+    *nr_items = 0;
+    uint8_t bytes_per_type = chunk_bytes_per_type(type);
+    if ((chunk.type != type) || (bytes_per_type == 0)) {
+        return NULL;
     }
-    return offset + child_offset;
+    if (((uintptr_t)chunk.data % bytes_per_type) != 0) {
+        return NULL;
+    }
+    *nr_items = chunk.data_length / bytes_per_type;
+    return chunk.data;
+}
+
+uint16_t* chunk_view_uint16(chunk_t chunk, uint64_t* nr_items) {
+    return chunk_view(chunk, CHUNK_TYPE_UINT16, nr_items);
+}
+
+int16_t* chunk_view_int16(chunk_t chunk, uint64_t* nr_items) {
+    return chunk_view(chunk, CHUNK_TYPE_INT16, nr_items);
+}
+
+uint32_t* chunk_view_uint32(chunk_t chunk, uint64_t* nr_items) {
+    return chunk_view(chunk, CHUNK_TYPE_UINT32, nr_items);
+}
+
+int32_t* chunk_view_int32(chunk_t chunk, uint64_t* nr_items) {
+    return chunk_view(chunk, CHUNK_TYPE_INT32, nr_items);
+}
+
+uint64_t* chunk_view_uint64(chunk_t chunk, uint64_t* nr_items) {
+    return chunk_view(chunk, CHUNK_TYPE_UINT64, nr_items);
+}
+
+int64_t* chunk_view_int64(chunk_t chunk, uint64_t* nr_items) {
+    return chunk_view(chunk, CHUNK_TYPE_INT64, nr_items);
+}
+
+float* chunk_view_float32(chunk_t chunk, uint64_t* nr_items) {
+    return chunk_view(chunk, CHUNK_TYPE_FLOAT32, nr_items);
+}
+
+double* chunk_view_float64(chunk_t chunk, uint64_t* nr_items) {
+    return chunk_view(chunk, CHUNK_TYPE_FLOAT64, nr_items);
 }
 
 uint64_t chunk_set_nr_items(chunk_t chunk) {
     if (chunk.type != CHUNK_TYPE_SET) {
         return 0;
     }
+    if (chunk_is_counted(chunk)) {
+        uint64_t length = 0;
+        uint64_t nr_items = 0;
+        uint64_t index = 1 + chunk_read_varint(&chunk.address[1], &length);
+        chunk_read_varint(&chunk.address[index], &nr_items);
+        return nr_items;
+    }
     uint64_t remaining = chunk.data_length;
     uint8_t* data = chunk.data;
     uint64_t count = 0;
@@ -168,3 +423,287 @@ uint64_t chunk_set_nr_items(chunk_t chunk) {
     }
     return count;
 }
+
+static const char* chunk_error_names[] = {
+    "ok",
+    "truncated header",
+    "unknown type",
+    "bad length bytes",
+    "chunk overflows its parent",
+    "out of memory",
+    "set item count does not match its items"
+};
+
+const char* chunk_error_name(chunk_error_t error) {
+    return chunk_error_names[error];
+}
+
+static chunk_error_t chunk_validate_varint(uint8_t* data, uint64_t available, uint64_t* value, uint8_t* nr_bytes) {
+    uint8_t shift = 0;
+    *value = 0;
+    *nr_bytes = 0;
+    do {
+        if (*nr_bytes == available) {
+            return CHUNK_ERROR_TRUNCATED;
+        }
+        if (*nr_bytes == CHUNK_VARINT_MAX) {
+            return CHUNK_ERROR_LENGTH_BYTES;
+        }
+        if ((*nr_bytes == (CHUNK_VARINT_MAX - 1)) && (data[*nr_bytes] > 1)) {
+            return CHUNK_ERROR_LENGTH_BYTES;
+        }
+        *value |= ((uint64_t)(data[*nr_bytes] & 0x7f) << shift);
+        shift += 7;
+        (*nr_bytes)++;
+    } while (data[*nr_bytes - 1] & 0x80);
+    return CHUNK_OK;
+}
+
+static chunk_error_t chunk_validate_header(uint8_t* start, uint64_t pos, uint64_t end, chunk_t* chunk, uint64_t* nr_items) {
+    uint8_t head = start[pos];
+    uint8_t type = (head & 0x0f);
+    uint8_t nr_length_bytes = ((head >> 0x04) & 0x0f);
+    if (type > CHUNK_TYPE_SET) {
+        return CHUNK_ERROR_TYPE;
+    }
+    uint64_t available = end - pos - 1;
+    uint8_t* length = &start[pos + 1];
+    uint64_t data_length = 0;
+    *nr_items = CHUNK_NR_ITEMS_UNKNOWN;
+    if ((nr_length_bytes == CHUNK_LENGTH_VARINT) || (nr_length_bytes == CHUNK_LENGTH_COUNTED)) {
+        uint8_t counted = (nr_length_bytes == CHUNK_LENGTH_COUNTED);
+        if (counted && (type != CHUNK_TYPE_SET)) {
+            return CHUNK_ERROR_LENGTH_BYTES;
+        }
+        chunk_error_t error = chunk_validate_varint(length, available, &data_length, &nr_length_bytes);
+        if (error != CHUNK_OK) {
+            return error;
+        }
+        if (counted) {
+            uint8_t nr_count_bytes = 0;
+            error = chunk_validate_varint(&length[nr_length_bytes], available - nr_length_bytes, nr_items, &nr_count_bytes);
+            if (error != CHUNK_OK) {
+                return error;
+            }
+            nr_length_bytes += nr_count_bytes;
+        }
+    }
+    else {
+        if (nr_length_bytes > 8) {
+            return CHUNK_ERROR_LENGTH_BYTES;
+        }
+        if (nr_length_bytes > available) {
+            return CHUNK_ERROR_TRUNCATED;
+        }
+        for (uint8_t i = 0; i < nr_length_bytes; i++) {
+            data_length |= ((uint64_t)length[i] << (0x08 * i));
+        }
+    }
+    if (data_length > (available - nr_length_bytes)) {
+        return CHUNK_ERROR_OVERFLOW;
+    }
+    if ((data_length == 0) && (*nr_items != CHUNK_NR_ITEMS_UNKNOWN) && (*nr_items != 0)) {
+        return CHUNK_ERROR_COUNT;
+    }
+    chunk->type = type;
+    chunk->nr_length_bytes = nr_length_bytes;
+    chunk->data_length = data_length;
+    chunk->total_length = 1 + nr_length_bytes + data_length;
+    return CHUNK_OK;
+}
+
+typedef struct chunk_validate_open {
+    uint64_t offset;
+    uint64_t end;
+    uint64_t nr_items;
+    uint64_t expected;
+} chunk_validate_open_t;
+
+chunk_error_t chunk_validate(uint8_t* start, uint64_t size, uint64_t* error_offset) {
+    uint32_t nr_open = 0;
+    uint32_t capacity_open = 64;
+    chunk_validate_open_t* open = malloc(sizeof(chunk_validate_open_t) * capacity_open);
+    if (open == NULL) {
+        return CHUNK_ERROR_MEMORY;
+    }
+
+    chunk_error_t error = CHUNK_OK;
+    uint64_t pos = 0;
+    uint64_t end = size;
+    if (size == 0) {
+        error = CHUNK_ERROR_TRUNCATED;
+    }
+    while (error == CHUNK_OK) {
+        chunk_t chunk;
+        uint64_t nr_items = 0;
+        error = chunk_validate_header(start, pos, end, &chunk, &nr_items);
+        if (error != CHUNK_OK) {
+            break;
+        }
+        if (nr_open) {
+            open[nr_open - 1].nr_items++;
+        }
+        if ((chunk.type == CHUNK_TYPE_SET) && chunk.data_length) {
+            if (nr_open == capacity_open) {
+                chunk_validate_open_t* open_new = realloc(open, sizeof(chunk_validate_open_t) * capacity_open * 2);
+                if (open_new == NULL) {
+                    error = CHUNK_ERROR_MEMORY;
+                    break;
+                }
+                open = open_new;
+                capacity_open *= 2;
+            }
+            open[nr_open].offset = pos;
+            open[nr_open].end = end;
+            open[nr_open].nr_items = 0;
+            open[nr_open].expected = nr_items;
+            nr_open++;
+            end = pos + chunk.total_length;
+            pos += 1 + chunk.nr_length_bytes;
+            continue;
+        }
+        pos += chunk.total_length;
+        while (nr_open && (pos == end)) {
+            nr_open--;
+            chunk_validate_open_t* set = &open[nr_open];
+            if ((set->expected != CHUNK_NR_ITEMS_UNKNOWN) && (set->expected != set->nr_items)) {
+                error = CHUNK_ERROR_COUNT;
+                pos = set->offset;
+                break;
+            }
+            end = set->end;
+        }
+        if (nr_open == 0) {
+            break;
+        }
+    }
+
+    free(open);
+    if ((error != CHUNK_OK) && (error_offset != NULL)) {
+        *error_offset = pos;
+    }
+    return error;
+}
+
+void chunk_iter_init(chunk_iter_t* iter, uint8_t* start, chunk_iter_order_t order) {
+    iter->order = order;
+    iter->start = start;
+    iter->descend = 0;
+    iter->failed = 0;
+    iter->depth = 0;
+    iter->nr_open = 0;
+    iter->capacity_open = CHUNK_ITER_INLINE;
+    iter->open = iter->open_inline;
+}
+
+static uint8_t chunk_iter_push(chunk_iter_t* iter, chunk_t chunk) {
+    if (iter->nr_open == iter->capacity_open) {
+        uint32_t capacity = iter->capacity_open * 2;
+        chunk_iter_open_t* open = NULL;
+        if (iter->open == iter->open_inline) {
+            open = malloc(sizeof(chunk_iter_open_t) * capacity);
+            if (open != NULL) {
+                memcpy(open, iter->open_inline, sizeof(iter->open_inline));
+            }
+        }
+        else {
+            open = realloc(iter->open, sizeof(chunk_iter_open_t) * capacity);
+        }
+        if (open == NULL) {
+            iter->failed = 1;
+            return 0;
+        }
+        iter->open = open;
+        iter->capacity_open = capacity;
+    }
+    chunk_iter_open_t* top = &iter->open[iter->nr_open++];
+    top->chunk = chunk;
+    top->next = chunk.data;
+    top->remaining = (chunk.type == CHUNK_TYPE_SET) ? chunk.data_length : 0;
+    return 1;
+}
+
+static uint8_t chunk_iter_next_pre(chunk_iter_t* iter, chunk_t* chunk) {
+    if (iter->start != NULL) {
+        iter->last = chunk_decode(iter->start);
+        iter->start = NULL;
+        iter->descend = 1;
+        iter->depth = 0;
+        *chunk = iter->last;
+        return 1;
+    }
+    // the items of the set returned last are walked only now, so that it
+    // could be skipped in between
+    if (iter->descend && (iter->last.type == CHUNK_TYPE_SET) && iter->last.data_length) {
+        if (!chunk_iter_push(iter, iter->last)) {
+            return 0;
+        }
+    }
+    iter->descend = 0;
+    while (iter->nr_open) {
+        chunk_iter_open_t* top = &iter->open[iter->nr_open - 1];
+        if (top->remaining) {
+            iter->last = chunk_decode(top->next);
+            top->next += iter->last.total_length;
+            top->remaining -= iter->last.total_length;
+            iter->descend = 1;
+            iter->depth = iter->nr_open;
+            *chunk = iter->last;
+            return 1;
+        }
+        iter->nr_open--;
+    }
+    return 0;
+}
+
+static uint8_t chunk_iter_next_post(chunk_iter_t* iter, chunk_t* chunk) {
+    if (iter->start != NULL) {
+        if (!chunk_iter_push(iter, chunk_decode(iter->start))) {
+            return 0;
+        }
+        iter->start = NULL;
+    }
+    while (iter->nr_open) {
+        chunk_iter_open_t* top = &iter->open[iter->nr_open - 1];
+        if (top->remaining) {
+            chunk_t child = chunk_decode(top->next);
+            top->next += child.total_length;
+            top->remaining -= child.total_length;
+            // a chunk with nothing inside is done as soon as it is reached
+            if ((child.type != CHUNK_TYPE_SET) || !child.data_length) {
+                iter->depth = iter->nr_open;
+                *chunk = child;
+                return 1;
+            }
+            if (!chunk_iter_push(iter, child)) {
+                return 0;
+            }
+            continue;
+        }
+        iter->nr_open--;
+        iter->depth = iter->nr_open;
+        *chunk = top->chunk;
+        return 1;
+    }
+    return 0;
+}
+
+uint8_t chunk_iter_next(chunk_iter_t* iter, chunk_t* chunk) {
+    if (iter->order == CHUNK_ITER_POST_ORDER) {
+        return chunk_iter_next_post(iter, chunk);
+    }
+    return chunk_iter_next_pre(iter, chunk);
+}
+
+void chunk_iter_skip(chunk_iter_t* iter) {
+    iter->descend = 0;
+}
+
+void chunk_iter_destroy(chunk_iter_t* iter) {
+    if (iter->open != iter->open_inline) {
+        free(iter->open);
+    }
+    iter->open = iter->open_inline;
+    iter->nr_open = 0;
+    iter->capacity_open = CHUNK_ITER_INLINE;
+}
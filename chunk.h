@@ -20,6 +20,43 @@ typedef enum chunk_type {
     CHUNK_TYPE_SET = 0x0d
 } chunk_type_t;
 
+/**
+ * Length nibble value marking a compact header. The length follows the
+ * header byte as an unsigned LEB128 (7 bits per byte, high bit set when more
+ * bytes follow) instead of a fixed number of little-endian bytes.
+ */
+#define CHUNK_LENGTH_VARINT 0x0f
+
+/**
+ * Length nibble value marking a counted set header. The length follows the
+ * header byte as a LEB128 and is followed by the number of items in the set
+ * as a second LEB128, so the count can be read without walking the set. Both
+ * LEB128s are included in nr_length_bytes.
+ */
+#define CHUNK_LENGTH_COUNTED 0x0e
+
+/**
+ * Most bytes an unsigned LEB128 encoding of a 64 bit length can take.
+ */
+#define CHUNK_VARINT_MAX 10
+
+/**
+ * Most bytes a counted set header can take.
+ */
+#define CHUNK_COUNTED_HEADER_MAX (1 + (2 * CHUNK_VARINT_MAX))
+
+#define CHUNK_NR_ITEMS_UNKNOWN 0xffffffffffffffff
+
+typedef enum chunk_error {
+    CHUNK_OK = 0x00,
+    CHUNK_ERROR_TRUNCATED = 0x01,
+    CHUNK_ERROR_TYPE = 0x02,
+    CHUNK_ERROR_LENGTH_BYTES = 0x03,
+    CHUNK_ERROR_OVERFLOW = 0x04,
+    CHUNK_ERROR_MEMORY = 0x05,
+    CHUNK_ERROR_COUNT = 0x06
+} chunk_error_t;
+
 typedef struct chunk {
     uint8_t* address;
     chunk_type_t type;
@@ -60,6 +97,16 @@ const char* chunk_type_name(chunk_type_t type);
  */
 uint8_t chunk_nr_length_bytes(uint64_t length);
 
+/**
+ * @brief Write little-endian length bytes following a header byte
+ *
+ * @param data The destination for the length bytes
+ * @param nr_length_bytes The number of bytes to write
+ * @param length The length of the data
+ * @return One past the last byte written
+ */
+uint8_t* chunk_write_length_bytes(uint8_t* data, uint8_t nr_length_bytes, uint64_t length);
+
 /**
  * @brief Write a chunk header into a data address
  *
@@ -70,6 +117,115 @@ uint8_t chunk_nr_length_bytes(uint64_t length);
  */
 uint8_t* chunk_write_header(uint8_t* data, chunk_type_t type, uint64_t length);
 
+/**
+ * @brief Number of bytes for a LEB128 encoded length
+ *
+ * @param length The length of the data in the chunk
+ * @return The number of bytes needed to store that as a LEB128
+ */
+uint8_t chunk_varint_length_bytes(uint64_t length);
+
+/**
+ * @brief Write a compact chunk header into a data address
+ *
+ * Writes the header with CHUNK_LENGTH_VARINT in the length nibble followed by
+ * the length as a LEB128. A set holding one uint8 takes 2 header bytes this
+ * way instead of 9.
+ *
+ * @param The destination for the header
+ * @param The chunk type
+ * @param The length of the data
+ * @return Start of the data contents
+ */
+uint8_t* chunk_write_header_compact(uint8_t* data, chunk_type_t type, uint64_t length);
+
+/**
+ * @brief Write a LEB128 padded out to a number of bytes
+ *
+ * The extra bytes are continuation bytes carrying zero bits, which decoders
+ * read as the same value. nr_bytes must be at least
+ * chunk_varint_length_bytes(length).
+ *
+ * @param data The destination for the LEB128
+ * @param length The value to write
+ * @param nr_bytes The number of bytes to write, at most CHUNK_VARINT_MAX
+ * @return One past the last byte written
+ */
+uint8_t* chunk_write_varint_padded(uint8_t* data, uint64_t length, uint8_t nr_bytes);
+
+/**
+ * @brief Write a header that leaves the payload naturally aligned
+ *
+ * Numeric payloads are aligned to their element size by spending redundant
+ * length bytes (zero high bytes, or extra LEB128 continuation bytes) rather
+ * than by inserting padding, so existing decoders read the result unchanged.
+ * Alignment is always possible for payloads under 2MB. If it is not possible
+ * the smallest header is written.
+ *
+ * @param data The destination for the header
+ * @param offset Position of data relative to an 8 byte aligned base
+ * @param type The chunk type
+ * @param length The length of the data
+ * @return Start of the data contents
+ */
+uint8_t* chunk_write_header_aligned(uint8_t* data, uint64_t offset, chunk_type_t type, uint64_t length);
+
+/**
+ * @brief Start a compact set whose length is not yet known
+ *
+ * Reserves room for the largest possible compact header. The contents of the
+ * set are written at the returned address and chunk_set_end() is called once
+ * they are complete.
+ *
+ * @param data The destination for the set
+ * @return Start of the data contents
+ */
+uint8_t* chunk_set_begin(uint8_t* data);
+
+/**
+ * @brief Finish a set started with chunk_set_begin()
+ *
+ * Backpatches the compact header with the final length and moves the
+ * contents down over the unused part of the reserved header.
+ *
+ * @param set The address passed to chunk_set_begin()
+ * @param end One past the last byte written into the set
+ * @return One past the last byte of the finished set
+ */
+uint8_t* chunk_set_end(uint8_t* set, uint8_t* end);
+
+/**
+ * @brief Write a counted set header into a data address
+ *
+ * @param data The destination for the header
+ * @param length The length of the data
+ * @param nr_items The number of items in the set
+ * @return Start of the data contents
+ */
+uint8_t* chunk_write_header_counted(uint8_t* data, uint64_t length, uint64_t nr_items);
+
+/**
+ * @brief Finish a counted set
+ *
+ * Like chunk_set_end() but for a set whose contents were written after
+ * CHUNK_COUNTED_HEADER_MAX reserved bytes. The header is backpatched with
+ * the length and the item count.
+ *
+ * @param set The start of the reserved header
+ * @param end One past the last byte written into the set
+ * @param nr_items The number of items written into the set
+ * @return One past the last byte of the finished set
+ */
+uint8_t* chunk_set_end_counted(uint8_t* set, uint8_t* end, uint64_t nr_items);
+
+/**
+ * @brief Check whether a chunk is a set with a counted header
+ *
+ * @param chunk A chunk
+ * @return 1 if the item count is stored in the header, else 0
+ */
+uint8_t chunk_is_counted(chunk_t chunk);
+
 /**
  * @brief Pack a chunk header into memory
  *
@@ -81,6 +237,26 @@ uint8_t* chunk_write_header(uint8_t* data, chunk_type_t type, uint64_t length);
  */
 uint8_t* chunk_make(uint8_t* data, chunk_t chunk);
 
+/**
+ * @brief Decode the header byte of a chunk
+ *
+ * Fills in the type and the length nibble only. The length bytes are read by
+ * chunk_calculate_length() once they are available.
+ *
+ * @param start A pointer to the header byte
+ * @return A chunk structure with no length
+ */
+chunk_t chunk_decode_head(uint8_t* start);
+
+/**
+ * @brief Read the length bytes following a header
+ *
+ * @param start A pointer to the header byte
+ * @param chunk A chunk from chunk_decode_head()
+ * @return Offset of the data contents from start
+ */
+uint64_t chunk_calculate_length(uint8_t* start, chunk_t* chunk);
+
 /**
  * @brief Decode memory into a chunk
  *
@@ -125,12 +301,158 @@ uint8_t chunk_set_get_nth(uint8_t* data, chunk_t* dest, uint64_t nth);
  */
 uint64_t chunk_byte_offset(uint8_t* data, uint32_t* idx, uint32_t nr_idx);
 
+/**
+ * @brief Get the byte offsets of many indexed items in one traversal
+ *
+ * Resolves every path like chunk_byte_offset() but sorts them first so that
+ * paths sharing a prefix are resolved together. Each set is scanned at most
+ * once no matter how many paths pass through it.
+ *
+ * @param data Starting chunk address
+ * @param idx List of paths, each a list of 32 bit indexes
+ * @param nr_idx Number of indexes in each path
+ * @param nr_paths Number of paths
+ * @param offsets Receives the byte offset for each path in the callers order
+ * @return 1 on success, 0 if out of memory, in which case offsets is untouched
+ */
+uint8_t chunk_byte_offsets(uint8_t* data, uint32_t** idx, uint32_t* nr_idx, uint32_t nr_paths, uint64_t* offsets);
+
 /**
  * @brief Get number of elements in set
  *
+ * O(1) for sets with a counted header, otherwise walks every item.
+ *
  * @param chunk A chunk
  * @return Number of items in set
  */
 uint64_t chunk_set_nr_items(chunk_t chunk);
 
+/**
+ * @brief Typed view over the payload of a chunk
+ *
+ * Returns the payload in place, with no copy, if the chunk has the requested
+ * type and the payload is aligned for it. Elements are in the byte order of
+ * the file.
+ *
+ * @param chunk A chunk
+ * @param type The type the payload is expected to hold
+ * @param nr_items Receives the number of elements
+ * @return Pointer to the first element, or NULL
+ */
+void* chunk_view(chunk_t chunk, chunk_type_t type, uint64_t* nr_items);
+
+uint16_t* chunk_view_uint16(chunk_t chunk, uint64_t* nr_items);
+
+int16_t* chunk_view_int16(chunk_t chunk, uint64_t* nr_items);
+
+uint32_t* chunk_view_uint32(chunk_t chunk, uint64_t* nr_items);
+
+int32_t* chunk_view_int32(chunk_t chunk, uint64_t* nr_items);
+
+uint64_t* chunk_view_uint64(chunk_t chunk, uint64_t* nr_items);
+
+int64_t* chunk_view_int64(chunk_t chunk, uint64_t* nr_items);
+
+float* chunk_view_float32(chunk_t chunk, uint64_t* nr_items);
+
+double* chunk_view_float64(chunk_t chunk, uint64_t* nr_items);
+
+/**
+ * @brief Certify that a buffer holds well formed chunks
+ *
+ * Walks the buffer once without recursion and checks every header: the
+ * header and its length bytes are inside the buffer, the type and length
+ * nibbles are known, every chunk fits exactly inside its parent set and
+ * counted sets hold the number of items they claim. A buffer that passes can
+ * be given to the unchecked chunk_* functions.
+ *
+ * @param start A pointer to uint8_t bytes making up an encoded chunk
+ * @param size Number of bytes readable at start
+ * @param error_offset If not NULL receives the offset of the bad header
+ * @return CHUNK_OK or the first problem found
+ */
+chunk_error_t chunk_validate(uint8_t* start, uint64_t size, uint64_t* error_offset);
+
+/**
+ * @brief Describe a validation error
+ *
+ * @param error An error returned by chunk_validate()
+ * @return A short description
+ */
+const char* chunk_error_name(chunk_error_t error);
+
+typedef enum chunk_iter_order {
+    CHUNK_ITER_PRE_ORDER = 0x00,
+    CHUNK_ITER_POST_ORDER = 0x01
+} chunk_iter_order_t;
+
+/**
+ * Levels of nesting an iterator holds before it allocates its stack, which
+ * covers most walks.
+ */
+#define CHUNK_ITER_INLINE 16
+
+typedef struct chunk_iter_open {
+    chunk_t chunk;
+    uint8_t* next;
+    uint64_t remaining;
+} chunk_iter_open_t;
+
+typedef struct chunk_iter {
+    chunk_iter_order_t order;
+    uint8_t* start;
+    chunk_t last;
+    uint8_t descend;
+    uint8_t failed;
+    uint32_t depth;
+    uint32_t nr_open;
+    uint32_t capacity_open;
+    chunk_iter_open_t* open;
+    chunk_iter_open_t open_inline[CHUNK_ITER_INLINE];
+} chunk_iter_t;
+
+/**
+ * @brief Start walking every chunk below and including an encoded chunk
+ *
+ * The walk keeps the sets it is inside on its own stack rather than
+ * recursing, so nesting depth is only limited by memory. The stack moves to
+ * the heap past CHUNK_ITER_INLINE levels, and the iterator itself must not be
+ * copied while walking. Pre-order returns a
+ * set before its items, post-order after them.
+ *
+ * @param iter Iterator to initialise
+ * @param start A pointer to uint8_t bytes making up an encoded chunk
+ * @param order CHUNK_ITER_PRE_ORDER or CHUNK_ITER_POST_ORDER
+ */
+void chunk_iter_init(chunk_iter_t* iter, uint8_t* start, chunk_iter_order_t order);
+
+/**
+ * @brief Get the next chunk of a walk
+ *
+ * After a chunk is returned iter->depth holds its depth, 0 for the chunk the
+ * walk started at.
+ *
+ * @param iter An iterator
+ * @param chunk Receives the chunk
+ * @return 1 if a chunk was returned, 0 at the end or if memory ran out, in
+ *         which case iter->failed is set
+ */
+uint8_t chunk_iter_next(chunk_iter_t* iter, chunk_t* chunk);
+
+/**
+ * @brief Do not walk the items of the set returned last
+ *
+ * Only has an effect in pre-order, before the next call to chunk_iter_next().
+ *
+ * @param iter An iterator
+ */
+void chunk_iter_skip(chunk_iter_t* iter);
+
+/**
+ * @brief Free the stack of a walk
+ *
+ * @param iter An iterator
+ */
+void chunk_iter_destroy(chunk_iter_t* iter);
+
 #endif
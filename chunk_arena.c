@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include "chunk_arena.h"
+
+#define CHUNK_ARENA_ALIGN 16
+
+static uint64_t chunk_arena_header_size() {
+    return (sizeof(chunk_arena_block_t) + (CHUNK_ARENA_ALIGN - 1)) & ~(uint64_t)(CHUNK_ARENA_ALIGN - 1);
+}
+
+chunk_arena_t* chunk_arena_create(uint64_t block_size) {
+    chunk_arena_t* arena = malloc(sizeof(chunk_arena_t));
+    if (arena == NULL) {
+        return NULL;
+    }
+    memset(arena, 0, sizeof(chunk_arena_t));
+    if (block_size == 0) {
+        block_size = CHUNK_ARENA_BLOCK_SIZE;
+    }
+    arena->block_size = block_size;
+    return arena;
+}
+
+static chunk_arena_block_t* chunk_arena_block_make(chunk_arena_t* arena, uint64_t size) {
+    chunk_arena_block_t* block = malloc(chunk_arena_header_size() + size);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->size = size;
+    block->used = 0;
+    arena->nr_blocks++;
+    return block;
+}
+
+void* chunk_arena_alloc(chunk_arena_t* arena, uint64_t size) {
+    size = (size + (CHUNK_ARENA_ALIGN - 1)) & ~(uint64_t)(CHUNK_ARENA_ALIGN - 1);
+    chunk_arena_block_t* block = arena->head;
+
+    if (size > (arena->block_size / 4)) {
+        block = chunk_arena_block_make(arena, size);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->used = size;
+        if (arena->head != NULL) {
+            block->next = arena->head->next;
+            arena->head->next = block;
+        }
+        else {
+            block->next = NULL;
+            arena->head = block;
+        }
+    }
+    else {
+        if ((block == NULL) || ((block->size - block->used) < size)) {
+            block = chunk_arena_block_make(arena, arena->block_size);
+            if (block == NULL) {
+                return NULL;
+            }
+            block->next = arena->head;
+            arena->head = block;
+        }
+        block->used += size;
+    }
+
+    arena->nr_allocs++;
+    arena->nr_bytes += size;
+    return (uint8_t*)block + chunk_arena_header_size() + (block->used - size);
+}
+
+void chunk_arena_merge(chunk_arena_t* arena, chunk_arena_t* other) {
+    if (other->head != NULL) {
+        chunk_arena_block_t* tail = other->head;
+        while (tail->next != NULL) {
+            tail = tail->next;
+        }
+        if (arena->head != NULL) {
+            tail->next = arena->head->next;
+            arena->head->next = other->head;
+        }
+        else {
+            arena->head = other->head;
+        }
+    }
+    arena->nr_blocks += other->nr_blocks;
+    arena->nr_allocs += other->nr_allocs;
+    arena->nr_bytes += other->nr_bytes;
+    free(other);
+}
+
+void chunk_arena_destroy(chunk_arena_t* arena) {
+    chunk_arena_block_t* block = arena->head;
+    while (block != NULL) {
+        chunk_arena_block_t* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
@@ -0,0 +1,65 @@
+#ifndef H_CHUNK_ARENA
+#define H_CHUNK_ARENA
+
+#include <stdint.h>
+
+#define CHUNK_ARENA_BLOCK_SIZE (1024 * 1024)
+
+typedef struct chunk_arena_block chunk_arena_block_t;
+
+typedef struct chunk_arena_block {
+    chunk_arena_block_t* next;
+    uint64_t size;
+    uint64_t used;
+} chunk_arena_block_t;
+
+typedef struct chunk_arena {
+    chunk_arena_block_t* head;
+    uint64_t block_size;
+    uint64_t nr_blocks;
+    uint64_t nr_allocs;
+    uint64_t nr_bytes;
+} chunk_arena_t;
+
+/**
+ * @brief Create a bump allocator
+ *
+ * Memory is handed out from large blocks and is only returned all at once by
+ * chunk_arena_destroy().
+ *
+ * @param block_size Size of each block, or 0 for CHUNK_ARENA_BLOCK_SIZE
+ * @return The arena or NULL
+ */
+chunk_arena_t* chunk_arena_create(uint64_t block_size);
+
+/**
+ * @brief Allocate from an arena
+ *
+ * The memory is 16 byte aligned and not zeroed. Requests larger than a
+ * quarter of the block size get a block of their own.
+ *
+ * @param arena An arena
+ * @param size Number of bytes
+ * @return The memory or NULL
+ */
+void* chunk_arena_alloc(chunk_arena_t* arena, uint64_t size);
+
+/**
+ * @brief Move every block of one arena into another
+ *
+ * The memory handed out by other stays valid and is now released with arena.
+ * New allocations from arena keep using its current block.
+ *
+ * @param arena The arena that takes the blocks
+ * @param other An arena that is freed, without its blocks
+ */
+void chunk_arena_merge(chunk_arena_t* arena, chunk_arena_t* other);
+
+/**
+ * @brief Free every block of an arena and the arena itself
+ *
+ * @param arena An arena
+ */
+void chunk_arena_destroy(chunk_arena_t* arena);
+
+#endif
@@ -0,0 +1,419 @@
+#include <string.h>
+#include <stdlib.h>
+#include "chunk_btree.h"
+
+// Pages are at least half full after a split, so this covers far more items
+// than fit in memory.
+#define CHUNK_BTREE_MAX_DEPTH 16
+#define CHUNK_BTREE_MIN_CAPACITY 4
+
+static chunk_btree_page_t* chunk_btree_page_make(uint8_t leaf, uint32_t capacity, chunk_arena_t* arena) {
+    uint64_t size = sizeof(chunk_btree_page_t) + (capacity * sizeof(void*));
+    if (!leaf) {
+        size += capacity * sizeof(uint64_t);
+    }
+    chunk_btree_page_t* page = (arena != NULL) ? chunk_arena_alloc(arena, size) : malloc(size);
+    if (page == NULL) {
+        return NULL;
+    }
+    memset(page, 0, sizeof(chunk_btree_page_t));
+    page->leaf = leaf;
+    page->capacity = capacity;
+    page->arena = (arena != NULL);
+    if (!leaf) {
+        page->counts = (uint64_t*)&page->items[capacity];
+    }
+    return page;
+}
+
+static uint64_t chunk_btree_page_size(chunk_btree_page_t* page) {
+    uint64_t size = sizeof(chunk_btree_page_t) + (page->capacity * sizeof(void*));
+    if (!page->leaf) {
+        size += page->capacity * sizeof(uint64_t);
+    }
+    return size;
+}
+
+static void chunk_btree_page_free(chunk_btree_page_t* page) {
+    if (!page->arena) {
+        free(page);
+    }
+}
+
+static void chunk_btree_page_destroy(chunk_btree_page_t* page) {
+    if (!page->leaf) {
+        for (uint32_t i = 0; i < page->nr_items; i++) {
+            chunk_btree_page_destroy(page->items[i]);
+        }
+    }
+    chunk_btree_page_free(page);
+}
+
+static uint64_t chunk_btree_page_count(chunk_btree_page_t* page) {
+    if (page->leaf) {
+        return page->nr_items;
+    }
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < page->nr_items; i++) {
+        count += page->counts[i];
+    }
+    return count;
+}
+
+void chunk_btree_init(chunk_btree_t* tree) {
+    tree->root = NULL;
+    tree->nr_items = 0;
+}
+
+uint8_t chunk_btree_build(chunk_btree_t* tree, uint8_t* base, uint64_t stride, uint64_t nr_items, chunk_arena_t* arena) {
+    chunk_btree_init(tree);
+    if (nr_items == 0) {
+        return 1;
+    }
+    if (nr_items <= CHUNK_BTREE_ORDER) {
+        chunk_btree_page_t* page = chunk_btree_page_make(1, nr_items, arena);
+        if (page == NULL) {
+            return 0;
+        }
+        for (uint64_t i = 0; i < nr_items; i++) {
+            page->items[i] = base + (i * stride);
+        }
+        page->nr_items = nr_items;
+        tree->root = page;
+        tree->nr_items = nr_items;
+        return 1;
+    }
+
+    uint64_t nr_pages = (nr_items + CHUNK_BTREE_ORDER - 1) / CHUNK_BTREE_ORDER;
+    chunk_btree_page_t** pages = malloc(nr_pages * sizeof(chunk_btree_page_t*));
+    if (pages == NULL) {
+        return 0;
+    }
+
+    chunk_btree_page_t* prev = NULL;
+    for (uint64_t p = 0; p < nr_pages; p++) {
+        chunk_btree_page_t* page = chunk_btree_page_make(1, CHUNK_BTREE_ORDER, arena);
+        if (page == NULL) {
+            for (uint64_t i = 0; i < p; i++) {
+                chunk_btree_page_free(pages[i]);
+            }
+            free(pages);
+            return 0;
+        }
+        uint64_t first = p * CHUNK_BTREE_ORDER;
+        uint64_t count = nr_items - first;
+        if (count > CHUNK_BTREE_ORDER) {
+            count = CHUNK_BTREE_ORDER;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            page->items[i] = base + ((first + i) * stride);
+        }
+        page->nr_items = count;
+        page->prev = prev;
+        if (prev != NULL) {
+            prev->next = page;
+        }
+        prev = page;
+        pages[p] = page;
+    }
+
+    // each level is written over the front of the one below it, which is
+    // safe because parent p only reads children from p * ORDER onwards
+    while (nr_pages > 1) {
+        uint64_t nr_parents = (nr_pages + CHUNK_BTREE_ORDER - 1) / CHUNK_BTREE_ORDER;
+        for (uint64_t p = 0; p < nr_parents; p++) {
+            chunk_btree_page_t* parent = chunk_btree_page_make(0, CHUNK_BTREE_ORDER, arena);
+            if (parent == NULL) {
+                for (uint64_t i = 0; i < p; i++) {
+                    chunk_btree_page_destroy(pages[i]);
+                }
+                for (uint64_t i = p * CHUNK_BTREE_ORDER; i < nr_pages; i++) {
+                    chunk_btree_page_destroy(pages[i]);
+                }
+                free(pages);
+                return 0;
+            }
+            uint64_t first = p * CHUNK_BTREE_ORDER;
+            uint64_t count = nr_pages - first;
+            if (count > CHUNK_BTREE_ORDER) {
+                count = CHUNK_BTREE_ORDER;
+            }
+            for (uint64_t i = 0; i < count; i++) {
+                parent->items[i] = pages[first + i];
+                parent->counts[i] = chunk_btree_page_count(pages[first + i]);
+            }
+            parent->nr_items = count;
+            pages[p] = parent;
+        }
+        nr_pages = nr_parents;
+    }
+
+    tree->root = pages[0];
+    tree->nr_items = nr_items;
+    free(pages);
+    return 1;
+}
+
+void* chunk_btree_get(chunk_btree_t* tree, uint64_t idx) {
+    if (idx >= tree->nr_items) {
+        return NULL;
+    }
+    chunk_btree_page_t* page = tree->root;
+    while (!page->leaf) {
+        uint32_t i = 0;
+        while (idx >= page->counts[i]) {
+            idx -= page->counts[i];
+            i++;
+        }
+        page = page->items[i];
+    }
+    return page->items[idx];
+}
+
+uint8_t chunk_btree_insert(chunk_btree_t* tree, uint64_t idx, void* item) {
+    if ((idx > tree->nr_items) || (item == NULL)) {
+        return 0;
+    }
+    if (tree->root == NULL) {
+        tree->root = chunk_btree_page_make(1, CHUNK_BTREE_MIN_CAPACITY, NULL);
+        if (tree->root == NULL) {
+            return 0;
+        }
+    }
+
+    chunk_btree_page_t* path[CHUNK_BTREE_MAX_DEPTH];
+    uint32_t slots[CHUNK_BTREE_MAX_DEPTH];
+    uint32_t depth = 0;
+    uint64_t pos = idx;
+    chunk_btree_page_t* page = tree->root;
+    while (!page->leaf) {
+        uint32_t i = 0;
+        while (((i + 1) < page->nr_items) && (pos > page->counts[i])) {
+            pos -= page->counts[i];
+            i++;
+        }
+        path[depth] = page;
+        slots[depth] = i;
+        depth++;
+        page = page->items[i];
+    }
+
+    // a root leaf smaller than a full page grows in place instead of splitting
+    if ((page->nr_items == page->capacity) && (page->capacity < CHUNK_BTREE_ORDER)) {
+        uint32_t capacity = page->capacity * 2;
+        if (capacity > CHUNK_BTREE_ORDER) {
+            capacity = CHUNK_BTREE_ORDER;
+        }
+        chunk_btree_page_t* grown = chunk_btree_page_make(1, capacity, NULL);
+        if (grown == NULL) {
+            return 0;
+        }
+        memcpy(grown->items, page->items, page->nr_items * sizeof(void*));
+        grown->nr_items = page->nr_items;
+        chunk_btree_page_free(page);
+        tree->root = grown;
+        page = grown;
+    }
+
+    // every page that will split needs its sibling allocated up front, so
+    // running out of memory leaves the tree untouched
+    chunk_btree_page_t* spare[CHUNK_BTREE_MAX_DEPTH + 1];
+    uint32_t nr_spare = 0;
+    if (page->nr_items == page->capacity) {
+        nr_spare = 1;
+        uint32_t level = depth;
+        while ((level > 0) && (path[level - 1]->nr_items == CHUNK_BTREE_ORDER)) {
+            nr_spare++;
+            level--;
+        }
+        if (level == 0) {
+            nr_spare++;
+        }
+    }
+    for (uint32_t i = 0; i < nr_spare; i++) {
+        spare[i] = chunk_btree_page_make(i == 0, CHUNK_BTREE_ORDER, NULL);
+        if (spare[i] == NULL) {
+            for (uint32_t j = 0; j < i; j++) {
+                chunk_btree_page_free(spare[j]);
+            }
+            return 0;
+        }
+    }
+
+    chunk_btree_page_t* child = page;
+    chunk_btree_page_t* sibling = NULL;
+    if (page->nr_items == page->capacity) {
+        uint32_t half = CHUNK_BTREE_ORDER / 2;
+        sibling = spare[0];
+        memcpy(sibling->items, &page->items[half], (CHUNK_BTREE_ORDER - half) * sizeof(void*));
+        sibling->nr_items = CHUNK_BTREE_ORDER - half;
+        page->nr_items = half;
+        sibling->next = page->next;
+        if (page->next != NULL) {
+            page->next->prev = sibling;
+        }
+        sibling->prev = page;
+        page->next = sibling;
+        if (pos > half) {
+            page = sibling;
+            pos -= half;
+        }
+    }
+    memmove(&page->items[pos + 1], &page->items[pos], (page->nr_items - pos) * sizeof(void*));
+    page->items[pos] = item;
+    page->nr_items++;
+
+    uint32_t next_spare = 1;
+    for (uint32_t level = depth; level-- > 0;) {
+        chunk_btree_page_t* parent = path[level];
+        uint32_t slot = slots[level];
+        if (sibling == NULL) {
+            parent->counts[slot]++;
+            continue;
+        }
+        chunk_btree_page_t* target = parent;
+        chunk_btree_page_t* parent_sibling = NULL;
+        if (parent->nr_items == CHUNK_BTREE_ORDER) {
+            uint32_t half = CHUNK_BTREE_ORDER / 2;
+            parent_sibling = spare[next_spare++];
+            memcpy(parent_sibling->items, &parent->items[half], (CHUNK_BTREE_ORDER - half) * sizeof(void*));
+            memcpy(parent_sibling->counts, &parent->counts[half], (CHUNK_BTREE_ORDER - half) * sizeof(uint64_t));
+            parent_sibling->nr_items = CHUNK_BTREE_ORDER - half;
+            parent->nr_items = half;
+            if (slot >= half) {
+                target = parent_sibling;
+                slot -= half;
+            }
+        }
+        memmove(&target->items[slot + 2], &target->items[slot + 1], (target->nr_items - slot - 1) * sizeof(void*));
+        memmove(&target->counts[slot + 2], &target->counts[slot + 1], (target->nr_items - slot - 1) * sizeof(uint64_t));
+        target->items[slot + 1] = sibling;
+        target->counts[slot] = chunk_btree_page_count(child);
+        target->counts[slot + 1] = chunk_btree_page_count(sibling);
+        target->nr_items++;
+        child = parent;
+        sibling = parent_sibling;
+    }
+
+    if (sibling != NULL) {
+        chunk_btree_page_t* root = spare[next_spare];
+        root->items[0] = child;
+        root->items[1] = sibling;
+        root->counts[0] = chunk_btree_page_count(child);
+        root->counts[1] = chunk_btree_page_count(sibling);
+        root->nr_items = 2;
+        tree->root = root;
+    }
+
+    tree->nr_items++;
+    return 1;
+}
+
+void* chunk_btree_remove(chunk_btree_t* tree, uint64_t idx) {
+    if (idx >= tree->nr_items) {
+        return NULL;
+    }
+
+    chunk_btree_page_t* path[CHUNK_BTREE_MAX_DEPTH];
+    uint32_t slots[CHUNK_BTREE_MAX_DEPTH];
+    uint32_t depth = 0;
+    uint64_t pos = idx;
+    chunk_btree_page_t* page = tree->root;
+    while (!page->leaf) {
+        uint32_t i = 0;
+        while (pos >= page->counts[i]) {
+            pos -= page->counts[i];
+            i++;
+        }
+        path[depth] = page;
+        slots[depth] = i;
+        depth++;
+        page = page->items[i];
+    }
+
+    void* item = page->items[pos];
+    memmove(&page->items[pos], &page->items[pos + 1], (page->nr_items - pos - 1) * sizeof(void*));
+    page->nr_items--;
+    tree->nr_items--;
+
+    uint8_t gone = (page->nr_items == 0);
+    if (gone) {
+        if (page->prev != NULL) {
+            page->prev->next = page->next;
+        }
+        if (page->next != NULL) {
+            page->next->prev = page->prev;
+        }
+    }
+    chunk_btree_page_t* child = page;
+    for (uint32_t level = depth; level-- > 0;) {
+        chunk_btree_page_t* parent = path[level];
+        uint32_t slot = slots[level];
+        if (gone) {
+            chunk_btree_page_free(child);
+            memmove(&parent->items[slot], &parent->items[slot + 1], (parent->nr_items - slot - 1) * sizeof(void*));
+            memmove(&parent->counts[slot], &parent->counts[slot + 1], (parent->nr_items - slot - 1) * sizeof(uint64_t));
+            parent->nr_items--;
+            gone = (parent->nr_items == 0);
+        }
+        else {
+            parent->counts[slot]--;
+        }
+        child = parent;
+    }
+    if (gone) {
+        chunk_btree_page_free(child);
+        tree->root = NULL;
+        return item;
+    }
+
+    while (!tree->root->leaf && (tree->root->nr_items == 1)) {
+        chunk_btree_page_t* root = tree->root;
+        tree->root = root->items[0];
+        chunk_btree_page_free(root);
+    }
+    return item;
+}
+
+static uint64_t chunk_btree_page_memory(chunk_btree_page_t* page) {
+    uint64_t memory = page->arena ? 0 : chunk_btree_page_size(page);
+    if (!page->leaf) {
+        for (uint32_t i = 0; i < page->nr_items; i++) {
+            memory += chunk_btree_page_memory(page->items[i]);
+        }
+    }
+    return memory;
+}
+
+uint64_t chunk_btree_memory(chunk_btree_t* tree) {
+    if (tree->root == NULL) {
+        return 0;
+    }
+    return chunk_btree_page_memory(tree->root);
+}
+
+void chunk_btree_destroy(chunk_btree_t* tree) {
+    if (tree->root != NULL) {
+        chunk_btree_page_destroy(tree->root);
+    }
+    chunk_btree_init(tree);
+}
+
+void chunk_btree_iter_init(chunk_btree_iter_t* iter, chunk_btree_t* tree) {
+    iter->page = tree->root;
+    iter->idx = 0;
+    while ((iter->page != NULL) && !iter->page->leaf) {
+        iter->page = iter->page->items[0];
+    }
+}
+
+void* chunk_btree_iter_next(chunk_btree_iter_t* iter) {
+    while ((iter->page != NULL) && (iter->idx >= iter->page->nr_items)) {
+        iter->page = iter->page->next;
+        iter->idx = 0;
+    }
+    if (iter->page == NULL) {
+        return NULL;
+    }
+    return iter->page->items[iter->idx++];
+}
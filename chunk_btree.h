@@ -0,0 +1,122 @@
+#ifndef H_CHUNK_BTREE
+#define H_CHUNK_BTREE
+
+#include <stdint.h>
+#include "chunk_arena.h"
+
+#define CHUNK_BTREE_ORDER 64
+
+typedef struct chunk_btree_page chunk_btree_page_t;
+
+typedef struct chunk_btree_page {
+    chunk_btree_page_t* prev;
+    chunk_btree_page_t* next;
+    uint64_t* counts;
+    uint32_t nr_items;
+    uint32_t capacity;
+    uint8_t leaf;
+    uint8_t arena;
+    void* items[];
+} chunk_btree_page_t;
+
+typedef struct chunk_btree {
+    chunk_btree_page_t* root;
+    uint64_t nr_items;
+} chunk_btree_t;
+
+typedef struct chunk_btree_iter {
+    chunk_btree_page_t* page;
+    uint32_t idx;
+} chunk_btree_iter_t;
+
+/**
+ * @brief Initialise an empty counted B+tree
+ *
+ * Items are addressed by position. Internal pages record how many items sit
+ * under each child, so lookup, insert and remove are O(log n). Leaf pages are
+ * linked for in-order iteration. A tree that fits in one leaf is a single page
+ * sized to its contents.
+ *
+ * @param tree Tree to initialise
+ */
+void chunk_btree_init(chunk_btree_t* tree);
+
+/**
+ * @brief Bulk load a tree from items laid out at a fixed stride
+ *
+ * Item i is base + (i * stride), e.g. the elements of an array of structs.
+ * Leaf pages are filled completely.
+ *
+ * @param tree An empty tree
+ * @param base Address of the first item
+ * @param stride Bytes between items
+ * @param nr_items Number of items
+ * @param arena Arena for the pages, or NULL to use malloc
+ * @return 1 on success, 0 if out of memory
+ */
+uint8_t chunk_btree_build(chunk_btree_t* tree, uint8_t* base, uint64_t stride, uint64_t nr_items, chunk_arena_t* arena);
+
+/**
+ * @brief Item at a position
+ *
+ * @param tree A tree
+ * @param idx Position, less than nr_items
+ * @return The item or NULL if idx is out of range
+ */
+void* chunk_btree_get(chunk_btree_t* tree, uint64_t idx);
+
+/**
+ * @brief Insert an item so that it ends up at a position
+ *
+ * @param tree A tree
+ * @param idx Position, at most nr_items
+ * @param item Item, must not be NULL
+ * @return 1 on success, 0 if idx is out of range or out of memory
+ */
+uint8_t chunk_btree_insert(chunk_btree_t* tree, uint64_t idx, void* item);
+
+/**
+ * @brief Remove the item at a position
+ *
+ * Pages that become empty are freed. Pages are not merged otherwise.
+ *
+ * @param tree A tree
+ * @param idx Position, less than nr_items
+ * @return The removed item or NULL if idx is out of range
+ */
+void* chunk_btree_remove(chunk_btree_t* tree, uint64_t idx);
+
+/**
+ * @brief Heap bytes used by the pages, not counting arena pages
+ *
+ * @param tree A tree
+ * @return Number of bytes
+ */
+uint64_t chunk_btree_memory(chunk_btree_t* tree);
+
+/**
+ * @brief Free all pages, leaving an empty tree
+ *
+ * Items are not touched.
+ *
+ * @param tree A tree
+ */
+void chunk_btree_destroy(chunk_btree_t* tree);
+
+/**
+ * @brief Start an in-order iteration
+ *
+ * @param iter Iterator to initialise
+ * @param tree A tree, which must not change while iterating
+ */
+void chunk_btree_iter_init(chunk_btree_iter_t* iter, chunk_btree_t* tree);
+
+/**
+ * @brief Next item of an iteration
+ *
+ * @param iter An iterator
+ * @return The next item or NULL at the end
+ */
+void* chunk_btree_iter_next(chunk_btree_iter_t* iter);
+
+#endif
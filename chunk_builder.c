@@ -0,0 +1,218 @@
+#include <string.h>
+#include <stdlib.h>
+#include "chunk_builder.h"
+#include "chunk.h"
+#include "chunk_endian.h"
+
+uint8_t chunk_builder_init(chunk_builder_t* builder, uint8_t* data, uint64_t capacity, uint8_t flags) {
+    memset(builder, 0, sizeof(chunk_builder_t));
+    if (flags & CHUNK_BUILDER_ALIGNED) {
+        flags &= ~(CHUNK_BUILDER_COMPACT | CHUNK_BUILDER_COUNTED);
+    }
+    builder->flags = flags;
+    if (data == NULL) {
+        builder->growable = 1;
+        capacity = 256;
+        data = malloc(capacity);
+        if (data == NULL) {
+            return 0;
+        }
+    }
+    builder->data = data;
+    builder->capacity = capacity;
+    builder->capacity_open = 16;
+    builder->open = malloc(sizeof(chunk_builder_open_t) * builder->capacity_open);
+    if (builder->open == NULL) {
+        chunk_builder_destroy(builder);
+        return 0;
+    }
+    return 1;
+}
+
+static uint8_t chunk_builder_reserve(chunk_builder_t* builder, uint64_t nr_bytes) {
+    uint64_t needed = builder->size + nr_bytes;
+    if (needed <= builder->capacity) {
+        return 1;
+    }
+    if (!builder->growable) {
+        return 0;
+    }
+    uint64_t capacity = builder->capacity;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    uint8_t* data = realloc(builder->data, capacity);
+    if (data == NULL) {
+        return 0;
+    }
+    builder->data = data;
+    builder->capacity = capacity;
+    return 1;
+}
+
+static uint8_t chunk_builder_set_header_length(chunk_builder_t* builder) {
+    if (builder->flags & CHUNK_BUILDER_COUNTED) {
+        return CHUNK_COUNTED_HEADER_MAX;
+    }
+    if (builder->flags & CHUNK_BUILDER_COMPACT) {
+        return 1 + CHUNK_VARINT_MAX;
+    }
+    return 9;
+}
+
+// Bytes a set's final compact or counted header takes.
+static uint8_t chunk_builder_set_header_final(chunk_builder_t* builder, chunk_builder_set_t* set) {
+    uint8_t header_length = 1 + chunk_varint_length_bytes(set->data_length);
+    if (builder->flags & CHUNK_BUILDER_COUNTED) {
+        header_length += chunk_varint_length_bytes(set->nr_items);
+    }
+    return header_length;
+}
+
+// Sets move once their headers are final, so the length of a compact or
+// counted set is recorded when it closes and nothing is written until the
+// outermost one closes.
+static uint8_t chunk_builder_set_add(chunk_builder_t* builder) {
+    if (builder->nr_sets == builder->capacity_sets) {
+        uint64_t capacity = builder->capacity_sets ? builder->capacity_sets * 2 : 16;
+        chunk_builder_set_t* sets = realloc(builder->sets, sizeof(chunk_builder_set_t) * capacity);
+        if (sets == NULL) {
+            return 0;
+        }
+        builder->sets = sets;
+        builder->capacity_sets = capacity;
+    }
+    builder->sets[builder->nr_sets].offset = builder->size;
+    builder->nr_sets++;
+    return 1;
+}
+
+// Write the recorded headers front to back, each over the room left for it,
+// moving what lies between them down as the headers shrink.
+static void chunk_builder_compact(chunk_builder_t* builder) {
+    uint8_t header_length = chunk_builder_set_header_length(builder);
+    uint64_t from = builder->sets[0].offset;
+    uint64_t to = from;
+    for (uint64_t i = 0; i < builder->nr_sets; i++) {
+        chunk_builder_set_t* set = &builder->sets[i];
+        memmove(&builder->data[to], &builder->data[from], set->offset - from);
+        uint8_t* header = &builder->data[to + (set->offset - from)];
+        if (builder->flags & CHUNK_BUILDER_COUNTED) {
+            header = chunk_write_header_counted(header, set->data_length, set->nr_items);
+        }
+        else {
+            header = chunk_write_header_compact(header, CHUNK_TYPE_SET, set->data_length);
+        }
+        to = header - builder->data;
+        from = set->offset + header_length;
+    }
+    memmove(&builder->data[to], &builder->data[from], builder->size - from);
+    builder->size = to + (builder->size - from);
+    builder->nr_sets = 0;
+}
+
+uint8_t chunk_builder_begin_set(chunk_builder_t* builder) {
+    uint8_t header_length = chunk_builder_set_header_length(builder);
+    if (!chunk_builder_reserve(builder, header_length)) {
+        return 0;
+    }
+    uint8_t deferred = builder->flags & (CHUNK_BUILDER_COMPACT | CHUNK_BUILDER_COUNTED);
+    if (deferred && !chunk_builder_set_add(builder)) {
+        return 0;
+    }
+    if (builder->depth == builder->capacity_open) {
+        chunk_builder_open_t* open = realloc(builder->open, sizeof(chunk_builder_open_t) * builder->capacity_open * 2);
+        if (open == NULL) {
+            return 0;
+        }
+        builder->open = open;
+        builder->capacity_open *= 2;
+    }
+    if (builder->depth) {
+        builder->open[builder->depth - 1].nr_items++;
+    }
+    builder->open[builder->depth].offset = builder->size;
+    builder->open[builder->depth].nr_items = 0;
+    builder->open[builder->depth].shrink = 0;
+    builder->open[builder->depth].set = builder->nr_sets - 1;
+    builder->depth++;
+    builder->size += header_length;
+    return 1;
+}
+
+uint8_t chunk_builder_append(chunk_builder_t* builder, chunk_type_t type, uint8_t* data, uint64_t length) {
+    uint64_t header_length = 1 + chunk_nr_length_bytes(length);
+    if (builder->flags & CHUNK_BUILDER_ALIGNED) {
+        header_length = 1 + CHUNK_VARINT_MAX;
+    }
+    if (!chunk_builder_reserve(builder, header_length + length)) {
+        return 0;
+    }
+    uint8_t* dest = NULL;
+    if (builder->flags & CHUNK_BUILDER_ALIGNED) {
+        dest = chunk_write_header_aligned(&builder->data[builder->size], builder->size, type, length);
+    }
+    else {
+        dest = chunk_write_header(&builder->data[builder->size], type, length);
+    }
+    if (builder->depth) {
+        builder->open[builder->depth - 1].nr_items++;
+    }
+    if (data != NULL) {
+        chunk_copy_from_host(dest, data, type, length);
+    }
+    else {
+        memset(dest, 0, length);
+    }
+    builder->size = (dest - builder->data) + length;
+    return 1;
+}
+
+uint8_t chunk_builder_end_set(chunk_builder_t* builder) {
+    if (builder->depth == 0) {
+        return 0;
+    }
+    builder->depth--;
+    chunk_builder_open_t* open = &builder->open[builder->depth];
+    if (builder->flags & (CHUNK_BUILDER_COMPACT | CHUNK_BUILDER_COUNTED)) {
+        uint8_t header_length = chunk_builder_set_header_length(builder);
+        // the sets closed inside this one will give back open->shrink bytes
+        chunk_builder_set_t* set = &builder->sets[open->set];
+        set->data_length = (builder->size - open->offset) - header_length - open->shrink;
+        set->nr_items = open->nr_items;
+        if (builder->depth) {
+            builder->open[builder->depth - 1].shrink += open->shrink + (header_length - chunk_builder_set_header_final(builder, set));
+            return 1;
+        }
+        chunk_builder_compact(builder);
+        return 1;
+    }
+    uint8_t* set = &builder->data[open->offset];
+    chunk_write_header(set, CHUNK_TYPE_SET, (builder->size - open->offset) - 9);
+    return 1;
+}
+
+uint8_t* chunk_builder_finish(chunk_builder_t* builder, uint64_t* size) {
+    if (builder->depth) {
+        return NULL;
+    }
+    *size = builder->size;
+    return builder->data;
+}
+
+void chunk_builder_destroy(chunk_builder_t* builder) {
+    if (builder->growable && (builder->data != NULL)) {
+        free(builder->data);
+    }
+    if (builder->open != NULL) {
+        free(builder->open);
+    }
+    free(builder->sets);
+    builder->data = NULL;
+    builder->open = NULL;
+    builder->sets = NULL;
+    builder->nr_sets = 0;
+    builder->capacity_sets = 0;
+    builder->size = 0;
+    builder->depth = 0;
+}
@@ -0,0 +1,115 @@
+#ifndef H_CHUNK_BUILDER
+#define H_CHUNK_BUILDER
+
+#include <stdint.h>
+#include "chunk.h"
+
+#define CHUNK_BUILDER_COMPACT 0x01
+#define CHUNK_BUILDER_ALIGNED 0x02
+#define CHUNK_BUILDER_COUNTED 0x04
+
+typedef struct chunk_builder_open {
+    uint64_t offset;
+    uint64_t nr_items;
+    uint64_t shrink;
+    uint64_t set;
+} chunk_builder_open_t;
+
+typedef struct chunk_builder_set {
+    uint64_t offset;
+    uint64_t data_length;
+    uint64_t nr_items;
+} chunk_builder_set_t;
+
+typedef struct chunk_builder {
+    uint8_t* data;
+    uint64_t size;
+    uint64_t capacity;
+    uint8_t growable;
+    uint8_t flags;
+    uint32_t depth;
+    uint32_t capacity_open;
+    chunk_builder_open_t* open;
+    uint64_t nr_sets;
+    uint64_t capacity_sets;
+    chunk_builder_set_t* sets;
+} chunk_builder_t;
+
+/**
+ * @brief Prepare a builder
+ *
+ * If data is NULL the builder allocates and grows its own buffer, otherwise
+ * it writes into the capacity bytes given and fails once they run out. With
+ * CHUNK_BUILDER_COMPACT set headers use LEB128 lengths, otherwise the usual 8
+ * length bytes. With CHUNK_BUILDER_COUNTED sets get counted headers holding
+ * their item count. With CHUNK_BUILDER_ALIGNED numeric payloads are aligned
+ * to their element size relative to the start of the buffer; compact and
+ * counted set headers are not used in that mode because closing one moves
+ * its contents. Compact and counted sets keep room for their longest header
+ * until the outermost set is closed, so a caller provided buffer needs that
+ * much more for each set open or closed inside it.
+ *
+ * @param builder The builder to initialise
+ * @param data A caller provided buffer or NULL
+ * @param capacity Size of the caller provided buffer
+ * @param flags Zero or any of the CHUNK_BUILDER_ flags
+ * @return 1 on success, else 0
+ */
+uint8_t chunk_builder_init(chunk_builder_t* builder, uint8_t* data, uint64_t capacity, uint8_t flags);
+
+/**
+ * @brief Open a set
+ *
+ * Room is left for the header, which is written when the set is closed.
+ *
+ * @param builder An initialised builder
+ * @return 1 on success, else 0
+ */
+uint8_t chunk_builder_begin_set(chunk_builder_t* builder);
+
+/**
+ * @brief Append a leaf to the innermost open set
+ *
+ * @param builder An initialised builder
+ * @param type The chunk type
+ * @param data The payload in host byte order, or NULL to leave it zeroed
+ * @param length The length of the payload in bytes
+ * @return 1 on success, else 0
+ */
+uint8_t chunk_builder_append(chunk_builder_t* builder, chunk_type_t type, uint8_t* data, uint64_t length);
+
+/**
+ * @brief Close the innermost open set
+ *
+ * Patches the set header with the length of everything written since the
+ * matching chunk_builder_begin_set(), and the item count for counted sets.
+ * Compact and counted headers are shorter than the room left for them, so
+ * in those modes a nested set only records its length and count. Closing the
+ * outermost set writes every header under it and moves the contents down in
+ * one pass, so the cost is the size of the document whatever its depth.
+ *
+ * @param builder An initialised builder
+ * @return 1 on success, 0 if no set is open
+ */
+uint8_t chunk_builder_end_set(chunk_builder_t* builder);
+
+/**
+ * @brief Get the finished document
+ *
+ * @param builder An initialised builder
+ * @param size Receives the number of bytes written
+ * @return The encoded document, or NULL if a set is still open
+ */
+uint8_t* chunk_builder_finish(chunk_builder_t* builder, uint64_t* size);
+
+/**
+ * @brief Free the buffers held by a builder
+ *
+ * A buffer the builder allocated itself is freed too, so take a copy of the
+ * result from chunk_builder_finish() first if it must outlive the builder.
+ *
+ * @param builder An initialised builder
+ */
+void chunk_builder_destroy(chunk_builder_t* builder);
+
+#endif
@@ -0,0 +1,118 @@
+#include <string.h>
+#include <stdlib.h>
+#include "chunk_cursor.h"
+#include "bitwise.h"
+
+static void chunk_cursor_focus(chunk_cursor_t* cursor, chunk_node_t* node) {
+    if (cursor->node != NULL) {
+        BIT_UNSET(cursor->node->flags, NODE_FLAG_FOCUS);
+    }
+    cursor->node = node;
+    BIT_SET(node->flags, NODE_FLAG_FOCUS);
+}
+
+static uint8_t chunk_cursor_reserve(chunk_cursor_t* cursor, uint64_t depth) {
+    if (depth <= cursor->capacity) {
+        return 1;
+    }
+    uint64_t capacity = cursor->capacity ? cursor->capacity : 16;
+    while (capacity < depth) {
+        capacity *= 2;
+    }
+    uint64_t* path = realloc(cursor->path, capacity * sizeof(uint64_t));
+    if (path == NULL) {
+        return 0;
+    }
+    cursor->path = path;
+    cursor->capacity = capacity;
+    return 1;
+}
+
+uint8_t chunk_cursor_init(chunk_cursor_t* cursor, chunk_node_t* root) {
+    memset(cursor, 0, sizeof(chunk_cursor_t));
+    if (!chunk_cursor_reserve(cursor, 16)) {
+        return 0;
+    }
+    chunk_cursor_focus(cursor, root);
+    return 1;
+}
+
+uint8_t chunk_cursor_down(chunk_cursor_t* cursor) {
+    chunk_node_t* child = chunk_node_child(cursor->node, 0);
+    if ((child == NULL) || !chunk_cursor_reserve(cursor, cursor->depth + 1)) {
+        return 0;
+    }
+    cursor->path[cursor->depth] = 0;
+    cursor->depth++;
+    chunk_cursor_focus(cursor, child);
+    return 1;
+}
+
+uint8_t chunk_cursor_up(chunk_cursor_t* cursor) {
+    if ((cursor->depth == 0) || (cursor->node->parent == NULL)) {
+        return 0;
+    }
+    cursor->depth--;
+    chunk_cursor_focus(cursor, cursor->node->parent);
+    return 1;
+}
+
+uint8_t chunk_cursor_seek(chunk_cursor_t* cursor, uint64_t idx) {
+    if ((cursor->depth == 0) || (cursor->node->parent == NULL)) {
+        return 0;
+    }
+    chunk_node_t* sibling = chunk_node_child(cursor->node->parent, idx);
+    if (sibling == NULL) {
+        return 0;
+    }
+    cursor->path[cursor->depth - 1] = idx;
+    chunk_cursor_focus(cursor, sibling);
+    return 1;
+}
+
+uint8_t chunk_cursor_next(chunk_cursor_t* cursor) {
+    if (cursor->depth == 0) {
+        return 0;
+    }
+    return chunk_cursor_seek(cursor, cursor->path[cursor->depth - 1] + 1);
+}
+
+uint8_t chunk_cursor_prev(chunk_cursor_t* cursor) {
+    if ((cursor->depth == 0) || (cursor->path[cursor->depth - 1] == 0)) {
+        return 0;
+    }
+    return chunk_cursor_seek(cursor, cursor->path[cursor->depth - 1] - 1);
+}
+
+uint8_t chunk_cursor_select(chunk_cursor_t* cursor, chunk_node_t* root, uint64_t* path, uint64_t depth) {
+    if (!chunk_cursor_reserve(cursor, depth)) {
+        return 0;
+    }
+    cursor->node = NULL;
+    chunk_node_t* node = root;
+    uint64_t reached = 0;
+    while (reached < depth) {
+        chunk_node_t* child = chunk_node_child(node, path[reached]);
+        if (child == NULL) {
+            break;
+        }
+        cursor->path[reached] = path[reached];
+        node = child;
+        reached++;
+    }
+    cursor->depth = reached;
+    chunk_cursor_focus(cursor, node);
+    return reached == depth;
+}
+
+uint64_t chunk_cursor_index(chunk_cursor_t* cursor) {
+    if (cursor->depth == 0) {
+        return 0;
+    }
+    return cursor->path[cursor->depth - 1];
+}
+
+void chunk_cursor_destroy(chunk_cursor_t* cursor) {
+    free(cursor->path);
+    memset(cursor, 0, sizeof(chunk_cursor_t));
+}
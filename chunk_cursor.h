@@ -0,0 +1,102 @@
+#ifndef H_CHUNK_CURSOR
+#define H_CHUNK_CURSOR
+
+#include <stdint.h>
+#include "chunk_node.h"
+
+typedef struct chunk_cursor {
+    chunk_node_t* node;
+    uint64_t* path;
+    uint64_t depth;
+    uint64_t capacity;
+} chunk_cursor_t;
+
+/**
+ * @brief Put a cursor on the root of a tree
+ *
+ * A cursor holds the focused node and the indexes leading to it from the
+ * root. Moving to the parent follows the node's parent link and moving to a
+ * sibling indexes the parent's children directly, so no move walks down from
+ * the root. The path grows as needed, so depth is not limited.
+ *
+ * The focused node carries NODE_FLAG_FOCUS, which keeps it and its ancestors
+ * from being trimmed. Moves clear the flag on the node left behind.
+ *
+ * @param cursor Cursor to initialise
+ * @param root Root of the tree
+ * @return 1 on success, 0 if out of memory
+ */
+uint8_t chunk_cursor_init(chunk_cursor_t* cursor, chunk_node_t* root);
+
+/**
+ * @brief Move to the first child of the focused set
+ *
+ * @param cursor A cursor
+ * @return 1 if moved, 0 if the node is not a set, is empty or out of memory
+ */
+uint8_t chunk_cursor_down(chunk_cursor_t* cursor);
+
+/**
+ * @brief Move to the parent of the focused node
+ *
+ * @param cursor A cursor
+ * @return 1 if moved, 0 at the root
+ */
+uint8_t chunk_cursor_up(chunk_cursor_t* cursor);
+
+/**
+ * @brief Move to the next sibling
+ *
+ * @param cursor A cursor
+ * @return 1 if moved, 0 at the last child or the root
+ */
+uint8_t chunk_cursor_next(chunk_cursor_t* cursor);
+
+/**
+ * @brief Move to the previous sibling
+ *
+ * @param cursor A cursor
+ * @return 1 if moved, 0 at the first child or the root
+ */
+uint8_t chunk_cursor_prev(chunk_cursor_t* cursor);
+
+/**
+ * @brief Move to the sibling at an index
+ *
+ * @param cursor A cursor
+ * @param idx Index in the parent
+ * @return 1 if moved, 0 if idx is out of range or at the root
+ */
+uint8_t chunk_cursor_seek(chunk_cursor_t* cursor, uint64_t idx);
+
+/**
+ * @brief Move to a node given by its path from the root
+ *
+ * For when the tree was rebuilt or the focused node may have been freed: the
+ * node the cursor was on is not touched. If the path leads out of the tree
+ * the cursor stops at the deepest node that exists.
+ *
+ * @param cursor A cursor
+ * @param root Root of the tree
+ * @param path Indexes from root, may be the cursor's own path
+ * @param depth Number of indexes
+ * @return 1 if the whole path was followed, 0 otherwise
+ */
+uint8_t chunk_cursor_select(chunk_cursor_t* cursor, chunk_node_t* root, uint64_t* path, uint64_t depth);
+
+/**
+ * @brief Index of the focused node in its parent
+ *
+ * @param cursor A cursor
+ * @return The index, or 0 at the root
+ */
+uint64_t chunk_cursor_index(chunk_cursor_t* cursor);
+
+/**
+ * @brief Free the path of a cursor
+ *
+ * @param cursor A cursor
+ */
+void chunk_cursor_destroy(chunk_cursor_t* cursor);
+
+#endif
@@ -0,0 +1,93 @@
+#include <string.h>
+#include "chunk_endian.h"
+#include "chunk.h"
+
+uint8_t chunk_host_little_endian() {
+    uint16_t probe = 0x0001;
+    return *(uint8_t*)&probe;
+}
+
+static void chunk_byteswap16(uint8_t* dest, uint8_t* src, uint64_t nr_items) {
+    for (uint64_t i = 0; i < nr_items; i++) {
+        uint16_t v;
+        memcpy(&v, &src[i * 2], 2);
+        v = __builtin_bswap16(v);
+        memcpy(&dest[i * 2], &v, 2);
+    }
+}
+
+static void chunk_byteswap32(uint8_t* dest, uint8_t* src, uint64_t nr_items) {
+    for (uint64_t i = 0; i < nr_items; i++) {
+        uint32_t v;
+        memcpy(&v, &src[i * 4], 4);
+        v = __builtin_bswap32(v);
+        memcpy(&dest[i * 4], &v, 4);
+    }
+}
+
+static void chunk_byteswap64(uint8_t* dest, uint8_t* src, uint64_t nr_items) {
+    for (uint64_t i = 0; i < nr_items; i++) {
+        uint64_t v;
+        memcpy(&v, &src[i * 8], 8);
+        v = __builtin_bswap64(v);
+        memcpy(&dest[i * 8], &v, 8);
+    }
+}
+
+void chunk_byteswap(uint8_t* dest, uint8_t* src, chunk_type_t type, uint64_t nr_items) {
+    if (type == CHUNK_TYPE_SET) {
+        return;
+    }
+    switch (chunk_bytes_per_type(type)) {
+        case 2:
+            chunk_byteswap16(dest, src, nr_items);
+            break;
+        case 4:
+            chunk_byteswap32(dest, src, nr_items);
+            break;
+        case 8:
+            chunk_byteswap64(dest, src, nr_items);
+            break;
+        default:
+            if (dest != src) {
+                memcpy(dest, src, nr_items * chunk_bytes_per_type(type));
+            }
+            break;
+    }
+}
+
+static void chunk_copy_swapped(uint8_t* dest, uint8_t* src, chunk_type_t type, uint64_t length) {
+    uint8_t bytes_per_type = chunk_bytes_per_type(type);
+    if (chunk_host_little_endian() || (bytes_per_type < 2) || (type == CHUNK_TYPE_SET)) {
+        memcpy(dest, src, length);
+        return;
+    }
+    uint64_t nr_items = length / bytes_per_type;
+    chunk_byteswap(dest, src, type, nr_items);
+    memcpy(&dest[nr_items * bytes_per_type], &src[nr_items * bytes_per_type], length % bytes_per_type);
+}
+
+void chunk_copy_to_host(uint8_t* dest, chunk_t chunk) {
+    chunk_copy_swapped(dest, chunk.data, chunk.type, chunk.data_length);
+}
+
+void chunk_copy_from_host(uint8_t* dest, uint8_t* src, chunk_type_t type, uint64_t length) {
+    chunk_copy_swapped(dest, src, type, length);
+}
+
+void chunk_byteswap_all(uint8_t* start) {
+    chunk_t root = chunk_decode(start);
+    uint64_t pos = 0;
+    while (pos < root.total_length) {
+        chunk_t chunk = chunk_decode(&start[pos]);
+        if (chunk.type == CHUNK_TYPE_SET) {
+            pos += 1 + chunk.nr_length_bytes;
+            continue;
+        }
+        uint8_t bytes_per_type = chunk_bytes_per_type(chunk.type);
+        if (bytes_per_type > 1) {
+            chunk_byteswap(chunk.data, chunk.data, chunk.type, chunk.data_length / bytes_per_type);
+        }
+        pos += chunk.total_length;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef H_CHUNK_ENDIAN
+#define H_CHUNK_ENDIAN
+
+#include <stdint.h>
+#include "chunk.h"
+
+/*
+ * Numeric payloads (UINT16 to FLOAT64) are stored little-endian, the same
+ * order as the length bytes. Writers on big-endian hosts convert on the way
+ * out and readers convert on the way in; on little-endian hosts both are
+ * no-ops and payloads can be used in place.
+ */
+
+/**
+ * @brief Check the byte order of this host
+ *
+ * @return 1 if the host is little-endian, else 0
+ */
+uint8_t chunk_host_little_endian();
+
+/**
+ * @brief Reverse the bytes of every element in an array
+ *
+ * Works in place when dest and src are the same and neither needs to be
+ * aligned. The loops are written so the compiler can vectorise them.
+ *
+ * @param dest Where the swapped elements go
+ * @param src The elements to swap
+ * @param type The element type
+ * @param nr_items Number of elements
+ */
+void chunk_byteswap(uint8_t* dest, uint8_t* src, chunk_type_t type, uint64_t nr_items);
+
+/**
+ * @brief Copy a payload converting from file to host byte order
+ *
+ * @param dest Where the converted payload goes, chunk.data_length bytes
+ * @param chunk A leaf chunk
+ */
+void chunk_copy_to_host(uint8_t* dest, chunk_t chunk);
+
+/**
+ * @brief Copy a payload converting from host to file byte order
+ *
+ * @param dest Where the converted payload goes
+ * @param src The payload in host order
+ * @param type The element type
+ * @param length Length of the payload in bytes
+ */
+void chunk_copy_from_host(uint8_t* dest, uint8_t* src, chunk_type_t type, uint64_t length);
+
+/**
+ * @brief Byte swap every numeric leaf in a document in place
+ *
+ * Repairs documents written by big-endian hosts that stored payloads in host
+ * order. Walks the headers linearly without recursion.
+ *
+ * @param start A pointer to uint8_t bytes making up an encoded chunk
+ */
+void chunk_byteswap_all(uint8_t* start);
+
+#endif
@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <string.h>
+#include "chunk_gap.h"
+
+uint8_t chunk_gap_init(chunk_gap_t* gap, uint8_t* data, uint64_t length) {
+    uint64_t capacity = CHUNK_GAP_MIN_CAPACITY;
+    while (capacity < length + (length / 2)) {
+        capacity *= 2;
+    }
+    gap->data = malloc(capacity);
+    if (gap->data == NULL) {
+        return 0;
+    }
+    if (length > 0) {
+        memcpy(gap->data, data, length);
+    }
+    gap->capacity = capacity;
+    gap->gap_start = length;
+    gap->gap_end = capacity;
+    return 1;
+}
+
+uint64_t chunk_gap_length(chunk_gap_t* gap) {
+    return gap->capacity - (gap->gap_end - gap->gap_start);
+}
+
+static void chunk_gap_move(chunk_gap_t* gap, uint64_t location) {
+    if (location < gap->gap_start) {
+        uint64_t nr_bytes = gap->gap_start - location;
+        memmove(&gap->data[gap->gap_end - nr_bytes], &gap->data[location], nr_bytes);
+        gap->gap_start -= nr_bytes;
+        gap->gap_end -= nr_bytes;
+    }
+    else if (location > gap->gap_start) {
+        uint64_t nr_bytes = location - gap->gap_start;
+        memmove(&gap->data[gap->gap_start], &gap->data[gap->gap_end], nr_bytes);
+        gap->gap_start += nr_bytes;
+        gap->gap_end += nr_bytes;
+    }
+}
+
+static uint8_t chunk_gap_grow(chunk_gap_t* gap, uint64_t nr_bytes) {
+    uint64_t length = chunk_gap_length(gap);
+    uint64_t capacity = gap->capacity;
+    while ((capacity - length) < nr_bytes) {
+        capacity *= 2;
+    }
+    if (capacity == gap->capacity) {
+        return 1;
+    }
+    uint8_t* data = realloc(gap->data, capacity);
+    if (data == NULL) {
+        return 0;
+    }
+    uint64_t tail = gap->capacity - gap->gap_end;
+    memmove(&data[capacity - tail], &data[gap->gap_end], tail);
+    gap->data = data;
+    gap->gap_end = capacity - tail;
+    gap->capacity = capacity;
+    return 1;
+}
+
+uint8_t chunk_gap_insert(chunk_gap_t* gap, uint64_t location, uint8_t* data, uint64_t nr_bytes) {
+    if (location > chunk_gap_length(gap)) {
+        return 0;
+    }
+    if (!chunk_gap_grow(gap, nr_bytes)) {
+        return 0;
+    }
+    chunk_gap_move(gap, location);
+    memcpy(&gap->data[gap->gap_start], data, nr_bytes);
+    gap->gap_start += nr_bytes;
+    return 1;
+}
+
+uint8_t chunk_gap_delete(chunk_gap_t* gap, uint64_t location, uint64_t nr_bytes, uint8_t** deleted) {
+    if ((location > chunk_gap_length(gap)) || (nr_bytes > (chunk_gap_length(gap) - location))) {
+        return 0;
+    }
+    chunk_gap_move(gap, location);
+    if (deleted != NULL) {
+        *deleted = &gap->data[gap->gap_end];
+    }
+    gap->gap_end += nr_bytes;
+    return 1;
+}
+
+uint8_t chunk_gap_get(chunk_gap_t* gap, uint64_t idx) {
+    if (idx < gap->gap_start) {
+        return gap->data[idx];
+    }
+    return gap->data[idx + (gap->gap_end - gap->gap_start)];
+}
+
+void chunk_gap_copy(chunk_gap_t* gap, uint8_t* dest) {
+    memcpy(dest, gap->data, gap->gap_start);
+    memcpy(&dest[gap->gap_start], &gap->data[gap->gap_end], gap->capacity - gap->gap_end);
+}
+
+void chunk_gap_copy_range(chunk_gap_t* gap, uint64_t location, uint64_t nr_bytes, uint8_t* dest) {
+    uint64_t before = 0;
+    if (location < gap->gap_start) {
+        before = gap->gap_start - location;
+        if (before > nr_bytes) {
+            before = nr_bytes;
+        }
+        memcpy(dest, &gap->data[location], before);
+    }
+    if (nr_bytes > before) {
+        memcpy(&dest[before], &gap->data[location + before + (gap->gap_end - gap->gap_start)], nr_bytes - before);
+    }
+}
+
+uint8_t* chunk_gap_flatten(chunk_gap_t* gap) {
+    chunk_gap_move(gap, chunk_gap_length(gap));
+    return gap->data;
+}
+
+void chunk_gap_destroy(chunk_gap_t* gap) {
+    free(gap->data);
+    gap->data = NULL;
+    gap->capacity = 0;
+    gap->gap_start = 0;
+    gap->gap_end = 0;
+}
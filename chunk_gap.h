@@ -0,0 +1,103 @@
+#ifndef H_CHUNK_GAP
+#define H_CHUNK_GAP
+
+#include <stdint.h>
+
+#define CHUNK_GAP_MIN_CAPACITY 64
+
+typedef struct chunk_gap {
+    uint8_t* data;
+    uint64_t capacity;
+    uint64_t gap_start;
+    uint64_t gap_end;
+} chunk_gap_t;
+
+/**
+ * @brief Initialise a gap buffer holding a copy of some bytes
+ *
+ * The gap starts at the end, so appending is free until it fills up.
+ *
+ * @param gap Gap buffer to initialise
+ * @param data Initial contents, may be NULL if length is 0
+ * @param length Number of bytes in data
+ * @return 1 on success, 0 if out of memory
+ */
+uint8_t chunk_gap_init(chunk_gap_t* gap, uint8_t* data, uint64_t length);
+
+/**
+ * @brief Number of bytes held, not counting the gap
+ *
+ * @param gap A gap buffer
+ * @return Length of the contents
+ */
+uint64_t chunk_gap_length(chunk_gap_t* gap);
+
+/**
+ * @brief Insert bytes at a position
+ *
+ * The gap is moved to location first, so consecutive inserts at the cursor
+ * are amortized O(1) per byte.
+ *
+ * @param gap A gap buffer
+ * @param location Offset in the contents, at most chunk_gap_length()
+ * @param data Bytes to insert
+ * @param nr_bytes Number of bytes to insert
+ * @return 1 on success, 0 if location is out of range or out of memory
+ */
+uint8_t chunk_gap_insert(chunk_gap_t* gap, uint64_t location, uint8_t* data, uint64_t nr_bytes);
+
+/**
+ * @brief Delete bytes at a position
+ *
+ * @param gap A gap buffer
+ * @param location Offset of the first byte to delete
+ * @param nr_bytes Number of bytes to delete
+ * @param deleted If not NULL, receives a pointer to the deleted bytes. They
+ *                stay readable until the next insert.
+ * @return 1 on success, 0 if the range is out of bounds
+ */
+uint8_t chunk_gap_delete(chunk_gap_t* gap, uint64_t location, uint64_t nr_bytes, uint8_t** deleted);
+
+/**
+ * @brief Byte at an offset in the contents
+ *
+ * @param gap A gap buffer
+ * @param idx Offset, less than chunk_gap_length()
+ * @return The byte
+ */
+uint8_t chunk_gap_get(chunk_gap_t* gap, uint64_t idx);
+
+/**
+ * @brief Copy the contents out without moving the gap
+ *
+ * @param gap A gap buffer
+ * @param dest At least chunk_gap_length() bytes
+ */
+void chunk_gap_copy(chunk_gap_t* gap, uint8_t* dest);
+
+/**
+ * @brief Copy part of the contents out without moving the gap
+ *
+ * @param gap A gap buffer
+ * @param location Offset of the first byte
+ * @param nr_bytes Number of bytes, location + nr_bytes at most chunk_gap_length()
+ * @param dest At least nr_bytes bytes
+ */
+void chunk_gap_copy_range(chunk_gap_t* gap, uint64_t location, uint64_t nr_bytes, uint8_t* dest);
+
+/**
+ * @brief Move the gap to the end and return the contents as one block
+ *
+ * @param gap A gap buffer
+ * @return Contiguous contents, valid until the next insert or delete
+ */
+uint8_t* chunk_gap_flatten(chunk_gap_t* gap);
+
+/**
+ * @brief Free the buffer
+ *
+ * @param gap A gap buffer
+ */
+void chunk_gap_destroy(chunk_gap_t* gap);
+
+#endif
@@ -0,0 +1,69 @@
+#include <string.h>
+#include <stdlib.h>
+#include "chunk_index.h"
+#include "chunk.h"
+
+uint8_t chunk_index_init(chunk_index_t* index, chunk_t chunk) {
+    memset(index, 0, sizeof(chunk_index_t));
+    if (chunk.type != CHUNK_TYPE_SET) {
+        return 0;
+    }
+    index->chunk = chunk;
+    return 1;
+}
+
+uint8_t chunk_index_build(chunk_index_t* index) {
+    if (index->chunk.type != CHUNK_TYPE_SET) {
+        return 0;
+    }
+    if (index->offsets != NULL) {
+        return 1;
+    }
+    uint64_t nr_items = chunk_set_nr_items(index->chunk);
+    uint64_t* offsets = malloc(sizeof(uint64_t) * (nr_items + 1));
+    if (offsets == NULL) {
+        return 0;
+    }
+    uint8_t* data = index->chunk.data;
+    uint64_t offset = 1 + index->chunk.nr_length_bytes;
+    for (uint64_t i = 0; i < nr_items; i++) {
+        offsets[i] = offset;
+        chunk_t child = chunk_decode(data);
+        offset += child.total_length;
+        data += child.total_length;
+    }
+    offsets[nr_items] = offset;
+    index->nr_items = nr_items;
+    index->offsets = offsets;
+    return 1;
+}
+
+uint64_t chunk_index_item_byte_offset(chunk_index_t* index, uint64_t idx) {
+    if (!chunk_index_build(index)) {
+        return 0;
+    }
+    if (idx > index->nr_items) {
+        return 0;
+    }
+    return index->offsets[idx];
+}
+
+uint8_t chunk_index_get_nth(chunk_index_t* index, chunk_t* dest, uint64_t nth) {
+    if (!chunk_index_build(index)) {
+        return 0;
+    }
+    if (nth >= index->nr_items) {
+        return 0;
+    }
+    chunk_t child = chunk_decode(index->chunk.address + index->offsets[nth]);
+    memcpy(dest, &child, sizeof(chunk_t));
+    return 1;
+}
+
+void chunk_index_destroy(chunk_index_t* index) {
+    if (index->offsets != NULL) {
+        free(index->offsets);
+    }
+    index->offsets = NULL;
+    index->nr_items = 0;
+}
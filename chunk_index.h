@@ -0,0 +1,67 @@
+#ifndef H_CHUNK_INDEX
+#define H_CHUNK_INDEX
+
+#include <stdint.h>
+#include "chunk.h"
+
+typedef struct chunk_index {
+    chunk_t chunk;
+    uint64_t nr_items;
+    uint64_t* offsets;
+} chunk_index_t;
+
+/**
+ * @brief Prepare an offset index for a set
+ *
+ * The offsets are not computed until the first lookup, so an index can be
+ * attached to every set cheaply and only the sets that are actually searched
+ * pay for the scan.
+ *
+ * @param index The index to initialise
+ * @param chunk A chunk of type set
+ * @return 1 if the chunk is a set, else 0
+ */
+uint8_t chunk_index_init(chunk_index_t* index, chunk_t chunk);
+
+/**
+ * @brief Scan the set and record the offset of every item
+ *
+ * Walks the set once. The offsets array holds nr_items + 1 entries so that
+ * the offset just past the last item is available like it is from
+ * chunk_set_item_byte_offset().
+ *
+ * @param index An initialised index
+ * @return 1 on success, else 0
+ */
+uint8_t chunk_index_build(chunk_index_t* index);
+
+/**
+ * @brief Get the byte offset of an indexed item
+ *
+ * Same result as chunk_set_item_byte_offset() but O(1) once the index is
+ * built.
+ *
+ * @param index An initialised index
+ * @param idx The item index
+ * @return Byte offset from the start of the set, or 0 if out of range
+ */
+uint64_t chunk_index_item_byte_offset(chunk_index_t* index, uint64_t idx);
+
+/**
+ * @brief Get the N'th element from an indexed set
+ *
+ * @param index An initialised index
+ * @param dest If found the chunk will be copied here
+ * @param nth The item index
+ * @return 1 or 0
+ */
+uint8_t chunk_index_get_nth(chunk_index_t* index, chunk_t* dest, uint64_t nth);
+
+/**
+ * @brief Free the offsets held by an index
+ *
+ * @param index An initialised index
+ */
+void chunk_index_destroy(chunk_index_t* index);
+
+#endif
@@ -0,0 +1,348 @@
+#include <string.h>
+#include <stdlib.h>
+#include "chunk_journal.h"
+#include "chunk_snap.h"
+#include "chunk_endian.h"
+
+#define CHUNK_JOURNAL_MAX_FIELDS 5
+
+void chunk_journal_init(chunk_journal_t* journal) {
+    memset(journal, 0, sizeof(chunk_journal_t));
+}
+
+static uint64_t chunk_journal_leaf_size(uint64_t length) {
+    return 1 + chunk_nr_length_bytes(length) + length;
+}
+
+static uint8_t* chunk_journal_leaf(uint8_t* data, chunk_type_t type, void* bytes, uint64_t length) {
+    data = chunk_write_header(data, type, length);
+    if (length > 0) {
+        memcpy(data, bytes, length);
+    }
+    return data + length;
+}
+
+// A leaf of uint64 words, stored little-endian like any other payload.
+static uint8_t* chunk_journal_words(uint8_t* data, uint64_t* words, uint64_t nr_words) {
+    data = chunk_write_header(data, CHUNK_TYPE_UINT64, nr_words * sizeof(uint64_t));
+    chunk_copy_from_host(data, (uint8_t*)words, CHUNK_TYPE_UINT64, nr_words * sizeof(uint64_t));
+    return data + nr_words * sizeof(uint64_t);
+}
+
+// Word idx of a leaf written by chunk_journal_words(), in host order.
+static uint64_t chunk_journal_word(chunk_t words, uint64_t idx) {
+    uint64_t word = 0;
+    words.type = CHUNK_TYPE_UINT64;
+    words.data += idx * sizeof(uint64_t);
+    words.data_length = sizeof(uint64_t);
+    chunk_copy_to_host((uint8_t*)&word, words);
+    return word;
+}
+
+// Make room for an entry with data_length bytes of fields. The entry is built
+// past the end of the journal, so the entries that could still be redone are
+// only dropped once it has been applied. Returns where the fields go.
+static uint8_t* chunk_journal_begin(chunk_journal_t* journal, uint64_t data_length) {
+    uint64_t start = journal->length;
+    uint64_t length = start + 9 + data_length;
+    if (length > journal->capacity) {
+        uint64_t capacity = journal->capacity ? journal->capacity : 256;
+        while (capacity < length) {
+            capacity *= 2;
+        }
+        uint8_t* data = realloc(journal->data, capacity);
+        if (data == NULL) {
+            return NULL;
+        }
+        journal->data = data;
+        journal->capacity = capacity;
+    }
+    if (journal->nr_applied == journal->nr_offsets) {
+        uint64_t nr_offsets = journal->nr_offsets ? journal->nr_offsets * 2 : 64;
+        uint64_t* offsets = realloc(journal->offsets, nr_offsets * sizeof(uint64_t));
+        if (offsets == NULL) {
+            return NULL;
+        }
+        journal->offsets = offsets;
+        journal->nr_offsets = nr_offsets;
+    }
+    return chunk_write_header(&journal->data[start], CHUNK_TYPE_SET, data_length);
+}
+
+// The entry from chunk_journal_begin() has been applied. Move it down over
+// the entries that could have been redone and make it the last one.
+static void chunk_journal_commit(chunk_journal_t* journal) {
+    uint64_t start = journal->length;
+    if (journal->nr_applied < journal->nr_entries) {
+        start = journal->offsets[journal->nr_applied];
+    }
+    uint64_t total_length = chunk_decode(&journal->data[journal->length]).total_length;
+    memmove(&journal->data[start], &journal->data[journal->length], total_length);
+    journal->offsets[journal->nr_applied] = start;
+    journal->nr_applied++;
+    journal->nr_entries = journal->nr_applied;
+    journal->length = start + total_length;
+}
+
+static uint8_t* chunk_journal_head(uint8_t* data, chunk_journal_op_t op, uint64_t* path, uint64_t depth) {
+    uint8_t code = op;
+    data = chunk_journal_leaf(data, CHUNK_TYPE_UINT8, &code, 1);
+    return chunk_journal_words(data, path, depth);
+}
+
+static uint64_t chunk_journal_head_size(uint64_t depth) {
+    return chunk_journal_leaf_size(1) + chunk_journal_leaf_size(depth * sizeof(uint64_t));
+}
+
+static uint8_t chunk_journal_fields(uint8_t* entry, uint64_t length, chunk_t* fields) {
+    chunk_t chunk = chunk_decode(entry);
+    if ((chunk.type != CHUNK_TYPE_SET) || (chunk.total_length > length)) {
+        return 0;
+    }
+    uint8_t nr_fields = 0;
+    uint64_t offset = 0;
+    while ((offset < chunk.data_length) && (nr_fields < CHUNK_JOURNAL_MAX_FIELDS)) {
+        fields[nr_fields] = chunk_decode(&chunk.data[offset]);
+        offset += fields[nr_fields].total_length;
+        nr_fields++;
+    }
+    if ((offset != chunk.data_length) || (nr_fields < 2) || (fields[0].data_length != 1)) {
+        return 0;
+    }
+    return nr_fields;
+}
+
+static chunk_node_t* chunk_journal_select(chunk_node_t* root, chunk_t path) {
+    chunk_node_t* node = root;
+    uint64_t depth = path.data_length / sizeof(uint64_t);
+    for (uint64_t i = 0; (i < depth) && (node != NULL); i++) {
+        node = chunk_node_child(node, chunk_journal_word(path, i));
+    }
+    return node;
+}
+
+static chunk_node_t* chunk_journal_find(chunk_node_t* root, uint64_t* path, uint64_t depth) {
+    chunk_node_t* node = root;
+    for (uint64_t i = 0; (i < depth) && (node != NULL); i++) {
+        node = chunk_node_child(node, path[i]);
+    }
+    return node;
+}
+
+static uint8_t chunk_journal_splice(chunk_node_t* node, uint64_t location, chunk_t from, chunk_t to) {
+    if (!chunk_node_data_delete(node, location, from.data_length)) {
+        return 0;
+    }
+    if (!chunk_node_data_insert(node, location, to.data, to.data_length)) {
+        chunk_node_data_insert(node, location, from.data, from.data_length);
+        return 0;
+    }
+    return 1;
+}
+
+// Apply an entry forwards or, with undo set, its inverse.
+static uint8_t chunk_journal_apply(chunk_node_t* root, uint8_t* entry, uint64_t length, uint8_t undo) {
+    chunk_t fields[CHUNK_JOURNAL_MAX_FIELDS];
+    uint8_t nr_fields = chunk_journal_fields(entry, length, fields);
+    if (nr_fields < 3) {
+        return 0;
+    }
+    chunk_node_t* node = chunk_journal_select(root, fields[1]);
+    if (node == NULL) {
+        return 0;
+    }
+    uint8_t op = fields[0].data[0];
+    if (op == CHUNK_JOURNAL_TYPE) {
+        if (fields[2].data_length != 2) {
+            return 0;
+        }
+        if (fields[2].data[undo ? 0 : 1] > CHUNK_TYPE_SET) {
+            return 0;
+        }
+        return chunk_node_set_type(node, fields[2].data[undo ? 0 : 1]);
+    }
+    if ((nr_fields < 4) || (fields[2].data_length != sizeof(uint64_t))) {
+        return 0;
+    }
+    uint64_t location = chunk_journal_word(fields[2], 0);
+    if (op == CHUNK_JOURNAL_PAYLOAD) {
+        if (nr_fields < 5) {
+            return 0;
+        }
+        return undo ? chunk_journal_splice(node, location, fields[4], fields[3]) : chunk_journal_splice(node, location, fields[3], fields[4]);
+    }
+    if ((op != CHUNK_JOURNAL_INSERT) && (op != CHUNK_JOURNAL_DELETE)) {
+        return 0;
+    }
+    // undoing a delete is an insert and the other way round
+    if ((op == CHUNK_JOURNAL_INSERT) != (undo != 0)) {
+        return chunk_node_set_insert_chunk(node, location, fields[3].address) != NULL;
+    }
+    return chunk_node_set_delete(node, location);
+}
+
+// Apply the entry from chunk_journal_begin(). If it fails the journal is left
+// as it was, redo entries included.
+static uint8_t chunk_journal_apply_last(chunk_journal_t* journal, chunk_node_t* root) {
+    uint64_t start = journal->length;
+    if (!chunk_journal_apply(root, &journal->data[start], journal->capacity - start, 0)) {
+        return 0;
+    }
+    chunk_journal_commit(journal);
+    return 1;
+}
+
+chunk_node_t* chunk_journal_set_insert(chunk_journal_t* journal, chunk_node_t* root, uint64_t* path, uint64_t depth, uint64_t location, chunk_type_t type) {
+    uint8_t empty[9];
+    uint64_t empty_length = chunk_write_header(empty, type, 0) - empty;
+    uint8_t* data = chunk_journal_begin(journal, chunk_journal_head_size(depth) + chunk_journal_leaf_size(sizeof(uint64_t)) + empty_length);
+    if (data == NULL) {
+        return NULL;
+    }
+    data = chunk_journal_head(data, CHUNK_JOURNAL_INSERT, path, depth);
+    data = chunk_journal_words(data, &location, 1);
+    memcpy(data, empty, empty_length);
+    if (!chunk_journal_apply_last(journal, root)) {
+        return NULL;
+    }
+    return chunk_node_child(chunk_journal_find(root, path, depth), location);
+}
+
+uint8_t chunk_journal_set_delete(chunk_journal_t* journal, chunk_node_t* root, uint64_t* path, uint64_t depth, uint64_t location) {
+    chunk_node_t* node = chunk_journal_find(root, path, depth);
+    chunk_node_t* child = (node != NULL) ? chunk_node_child(node, location) : NULL;
+    if (child == NULL) {
+        return 0;
+    }
+    chunk_snap_t* snap = chunk_snap_take(child);
+    if (snap == NULL) {
+        return 0;
+    }
+    uint8_t* data = chunk_journal_begin(journal, chunk_journal_head_size(depth) + chunk_journal_leaf_size(sizeof(uint64_t)) + chunk_snap_size(snap));
+    if (data == NULL) {
+        chunk_snap_release(snap);
+        return 0;
+    }
+    data = chunk_journal_head(data, CHUNK_JOURNAL_DELETE, path, depth);
+    data = chunk_journal_words(data, &location, 1);
+    data = chunk_snap_encode(snap, data);
+    chunk_snap_release(snap);
+    if (data == NULL) {
+        return 0;
+    }
+    return chunk_journal_apply_last(journal, root);
+}
+
+uint8_t chunk_journal_data_replace(chunk_journal_t* journal, chunk_node_t* root, uint64_t* path, uint64_t depth, uint64_t location, uint64_t nr_delete, uint8_t* data, uint64_t nr_insert) {
+    chunk_node_t* node = chunk_journal_find(root, path, depth);
+    if ((node == NULL) || (node->type == CHUNK_TYPE_SET)) {
+        return 0;
+    }
+    if ((location > node->data_length) || (nr_delete > (node->data_length - location))) {
+        return 0;
+    }
+    uint64_t data_length = chunk_journal_head_size(depth) + chunk_journal_leaf_size(sizeof(uint64_t));
+    data_length += chunk_journal_leaf_size(nr_delete) + chunk_journal_leaf_size(nr_insert);
+    uint8_t* fields = chunk_journal_begin(journal, data_length);
+    if (fields == NULL) {
+        return 0;
+    }
+    fields = chunk_journal_head(fields, CHUNK_JOURNAL_PAYLOAD, path, depth);
+    fields = chunk_journal_words(fields, &location, 1);
+    // copied around the gap, so an edit costs what it removes and not the
+    // size of the leaf
+    fields = chunk_write_header(fields, CHUNK_TYPE_UINT8, nr_delete);
+    chunk_node_data_copy(node, location, nr_delete, fields);
+    fields += nr_delete;
+    chunk_journal_leaf(fields, CHUNK_TYPE_UINT8, data, nr_insert);
+    return chunk_journal_apply_last(journal, root);
+}
+
+uint8_t chunk_journal_set_type(chunk_journal_t* journal, chunk_node_t* root, uint64_t* path, uint64_t depth, chunk_type_t type) {
+    chunk_node_t* node = chunk_journal_find(root, path, depth);
+    if (node == NULL) {
+        return 0;
+    }
+    uint8_t types[2] = {node->type, type};
+    uint8_t* data = chunk_journal_begin(journal, chunk_journal_head_size(depth) + chunk_journal_leaf_size(2));
+    if (data == NULL) {
+        return 0;
+    }
+    data = chunk_journal_head(data, CHUNK_JOURNAL_TYPE, path, depth);
+    chunk_journal_leaf(data, CHUNK_TYPE_UINT8, types, 2);
+    return chunk_journal_apply_last(journal, root);
+}
+
+uint8_t chunk_journal_undo(chunk_journal_t* journal, chunk_node_t* root) {
+    if (journal->nr_applied == 0) {
+        return 0;
+    }
+    uint64_t start = journal->offsets[journal->nr_applied - 1];
+    if (!chunk_journal_apply(root, &journal->data[start], journal->length - start, 1)) {
+        return 0;
+    }
+    journal->nr_applied--;
+    return 1;
+}
+
+uint8_t chunk_journal_redo(chunk_journal_t* journal, chunk_node_t* root) {
+    if (journal->nr_applied == journal->nr_entries) {
+        return 0;
+    }
+    uint64_t start = journal->offsets[journal->nr_applied];
+    if (!chunk_journal_apply(root, &journal->data[start], journal->length - start, 0)) {
+        return 0;
+    }
+    journal->nr_applied++;
+    return 1;
+}
+
+uint8_t chunk_journal_entry(chunk_journal_t* journal, uint64_t idx, chunk_journal_entry_t* entry) {
+    if (idx >= journal->nr_entries) {
+        return 0;
+    }
+    uint64_t start = journal->offsets[idx];
+    chunk_t fields[CHUNK_JOURNAL_MAX_FIELDS];
+    uint8_t nr_fields = chunk_journal_fields(&journal->data[start], journal->length - start, fields);
+    if (nr_fields < 3) {
+        return 0;
+    }
+    entry->op = fields[0].data[0];
+    entry->path = fields[1].data;
+    entry->depth = fields[1].data_length / sizeof(uint64_t);
+    entry->location = 0;
+    if ((entry->op != CHUNK_JOURNAL_TYPE) && (fields[2].data_length == sizeof(uint64_t))) {
+        entry->location = chunk_journal_word(fields[2], 0);
+    }
+    return 1;
+}
+
+uint64_t chunk_journal_length(chunk_journal_t* journal) {
+    if (journal->nr_applied < journal->nr_entries) {
+        return journal->offsets[journal->nr_applied];
+    }
+    return journal->length;
+}
+
+uint64_t chunk_journal_replay(chunk_node_t* root, uint8_t* data, uint64_t length) {
+    uint64_t nr_applied = 0;
+    uint64_t offset = 0;
+    while (offset < length) {
+        // entries read back from disk are checked before anything decodes them
+        if (chunk_validate(&data[offset], length - offset, NULL) != CHUNK_OK) {
+            break;
+        }
+        if (!chunk_journal_apply(root, &data[offset], length - offset, 0)) {
+            break;
+        }
+        offset += chunk_decode(&data[offset]).total_length;
+        nr_applied++;
+    }
+    return nr_applied;
+}
+
+void chunk_journal_destroy(chunk_journal_t* journal) {
+    free(journal->data);
+    free(journal->offsets);
+    memset(journal, 0, sizeof(chunk_journal_t));
+}
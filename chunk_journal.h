@@ -0,0 +1,168 @@
+#ifndef H_CHUNK_JOURNAL
+#define H_CHUNK_JOURNAL
+
+#include <stdint.h>
+#include "chunk.h"
+#include "chunk_node.h"
+
+typedef enum chunk_journal_op {
+    CHUNK_JOURNAL_INSERT = 0x01,
+    CHUNK_JOURNAL_DELETE = 0x02,
+    CHUNK_JOURNAL_PAYLOAD = 0x03,
+    CHUNK_JOURNAL_TYPE = 0x04,
+} chunk_journal_op_t;
+
+typedef struct chunk_journal {
+    uint8_t* data;
+    uint64_t length;
+    uint64_t capacity;
+    uint64_t* offsets;
+    uint64_t nr_entries;
+    uint64_t nr_offsets;
+    uint64_t nr_applied;
+} chunk_journal_t;
+
+typedef struct chunk_journal_entry {
+    chunk_journal_op_t op;
+    uint8_t* path;
+    uint64_t depth;
+    uint64_t location;
+} chunk_journal_entry_t;
+
+/**
+ * @brief Initialise an empty journal
+ *
+ * A journal records edits made through it so they can be undone, redone and
+ * replayed. Each entry is a set chunk, and the entries are stored back to
+ * back, so the applied part of the journal is itself a valid chunk stream:
+ *
+ *   [0] uint8    operation
+ *   [1] uint64[] path of indexes from the root
+ *   [2] uint64   location, or for TYPE a uint8[2] of old and new type
+ *   [3] INSERT and DELETE: the encoded subtree
+ *       PAYLOAD: uint8[] bytes removed
+ *   [4] PAYLOAD: uint8[] bytes inserted
+ *
+ * Entries carry what is needed to apply them in either direction, so undo
+ * and redo cost the depth of the path plus the bytes of the entry. Paths and
+ * locations are little-endian like any other payload, so a journal written on
+ * one host replays on another.
+ *
+ * @param journal Journal to initialise
+ */
+void chunk_journal_init(chunk_journal_t* journal);
+
+/**
+ * @brief Insert an empty node of a type into a set
+ *
+ * @param journal A journal
+ * @param root Root of the tree
+ * @param path Indexes of the set from root
+ * @param depth Number of indexes, 0 for root itself
+ * @param location Position of the new child
+ * @param type Type of the new child
+ * @return The new child or NULL
+ */
+chunk_node_t* chunk_journal_set_insert(chunk_journal_t* journal, chunk_node_t* root, uint64_t* path, uint64_t depth, uint64_t location, chunk_type_t type);
+
+/**
+ * @brief Remove a child of a set
+ *
+ * The child is encoded into the journal so that undo can put it back.
+ *
+ * @param journal A journal
+ * @param root Root of the tree
+ * @param path Indexes of the set from root
+ * @param depth Number of indexes, 0 for root itself
+ * @param location Position of the child
+ * @return 1 on success, 0 on failure
+ */
+uint8_t chunk_journal_set_delete(chunk_journal_t* journal, chunk_node_t* root, uint64_t* path, uint64_t depth, uint64_t location);
+
+/**
+ * @brief Replace a range of a leaf's payload
+ *
+ * @param journal A journal
+ * @param root Root of the tree
+ * @param path Indexes of the leaf from root
+ * @param depth Number of indexes
+ * @param location First byte to replace
+ * @param nr_delete Number of bytes removed at location
+ * @param data Bytes inserted at location
+ * @param nr_insert Number of bytes in data
+ * @return 1 on success, 0 on failure
+ */
+uint8_t chunk_journal_data_replace(chunk_journal_t* journal, chunk_node_t* root, uint64_t* path, uint64_t depth, uint64_t location, uint64_t nr_delete, uint8_t* data, uint64_t nr_insert);
+
+/**
+ * @brief Change the type of an empty node
+ *
+ * @param journal A journal
+ * @param root Root of the tree
+ * @param path Indexes of the node from root
+ * @param depth Number of indexes
+ * @param type The new type
+ * @return 1 on success, 0 if the node is not empty or on failure
+ */
+uint8_t chunk_journal_set_type(chunk_journal_t* journal, chunk_node_t* root, uint64_t* path, uint64_t depth, chunk_type_t type);
+
+/**
+ * @brief Apply the inverse of the last applied entry
+ *
+ * @param journal A journal
+ * @param root Root of the tree the entries were applied to
+ * @return 1 on success, 0 if there is nothing to undo or it failed
+ */
+uint8_t chunk_journal_undo(chunk_journal_t* journal, chunk_node_t* root);
+
+/**
+ * @brief Apply the entry after the last applied one again
+ *
+ * A new edit discards the entries that could be redone once it has been
+ * applied. An edit that fails keeps them.
+ *
+ * @param journal A journal
+ * @param root Root of the tree the entries were applied to
+ * @return 1 on success, 0 if there is nothing to redo or it failed
+ */
+uint8_t chunk_journal_redo(chunk_journal_t* journal, chunk_node_t* root);
+
+/**
+ * @brief Decode an entry
+ *
+ * @param journal A journal
+ * @param idx Index of the entry, less than nr_entries
+ * @param entry Receives the operation, path and location. Path elements are
+ *              little-endian uint64 values and may not be aligned; read
+ *              them with chunk_copy_to_host().
+ * @return 1 on success, 0 if idx is out of range
+ */
+uint8_t chunk_journal_entry(chunk_journal_t* journal, uint64_t idx, chunk_journal_entry_t* entry);
+
+/**
+ * @brief Bytes of the applied entries, starting at journal->data
+ *
+ * @param journal A journal
+ * @return Number of bytes to write out to keep the session
+ */
+uint64_t chunk_journal_length(chunk_journal_t* journal);
+
+/**
+ * @brief Apply a stream of entries written by a journal, in order
+ *
+ * @param root Root of the tree the session started from
+ * @param data The entries
+ * @param length Number of bytes in data
+ * @return Number of entries applied, stopping at the first that is malformed
+ *         or fails
+ */
+uint64_t chunk_journal_replay(chunk_node_t* root, uint8_t* data, uint64_t length);
+
+/**
+ * @brief Free the memory held by a journal
+ *
+ * @param journal A journal
+ */
+void chunk_journal_destroy(chunk_journal_t* journal);
+
+#endif
@@ -1,57 +1,381 @@
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "chunk_node.h"
+#include "chunk_snap.h"
 #include "chunk.h"
-#include "utf8.h"
+#include "bitwise.h"
 
-uint64_t chunk_node_size(chunk_node_t* node) {
-    uint64_t size = 0;
-    if (node->type == CHUNK_TYPE_SET) {
-        size = 9;
-        for (uint64_t i = 0; i < node->nr_children; i++) {
-            chunk_node_t* child = &node->children[i];
-            size += chunk_node_size(child);
+void chunk_node_destroy_tree(chunk_node_t* node);
+
+void chunk_node_iter_init(chunk_node_iter_t* iter, chunk_node_t* node, chunk_iter_order_t order) {
+    iter->order = order;
+    iter->start = node;
+    iter->last = NULL;
+    iter->failed = 0;
+    iter->depth = 0;
+    iter->nr_open = 0;
+    iter->capacity_open = CHUNK_ITER_INLINE;
+    iter->open = iter->open_inline;
+}
+
+static uint8_t chunk_node_iter_enter(chunk_node_t* node) {
+    return (node->type == CHUNK_TYPE_SET) && node->nr_children && BIT_TEST(node->flags, NODE_FLAG_REALISED);
+}
+
+static uint8_t chunk_node_iter_push(chunk_node_iter_t* iter, chunk_node_t* node) {
+    if (iter->nr_open == iter->capacity_open) {
+        uint32_t capacity = iter->capacity_open * 2;
+        chunk_node_iter_open_t* open = NULL;
+        if (iter->open == iter->open_inline) {
+            open = malloc(sizeof(chunk_node_iter_open_t) * capacity);
+            if (open != NULL) {
+                memcpy(open, iter->open_inline, sizeof(iter->open_inline));
+            }
+        }
+        else {
+            open = realloc(iter->open, sizeof(chunk_node_iter_open_t) * capacity);
+        }
+        if (open == NULL) {
+            iter->failed = 1;
+            return 0;
+        }
+        iter->open = open;
+        iter->capacity_open = capacity;
+    }
+    chunk_node_iter_open_t* top = &iter->open[iter->nr_open++];
+    top->node = node;
+    // only the node a post-order walk starts at can have nothing to walk
+    top->children.page = NULL;
+    top->children.idx = 0;
+    if (chunk_node_iter_enter(node)) {
+        chunk_btree_iter_init(&top->children, &node->children);
+    }
+    return 1;
+}
+
+static chunk_node_t* chunk_node_iter_next_pre(chunk_node_iter_t* iter) {
+    if (iter->start != NULL) {
+        iter->last = iter->start;
+        iter->start = NULL;
+        iter->depth = 0;
+        return iter->last;
+    }
+    // the children of the node returned last are looked at only now, so
+    // that it could be realised or skipped in between
+    if ((iter->last != NULL) && chunk_node_iter_enter(iter->last)) {
+        if (!chunk_node_iter_push(iter, iter->last)) {
+            return NULL;
+        }
+    }
+    iter->last = NULL;
+    while (iter->nr_open) {
+        chunk_node_t* child = chunk_btree_iter_next(&iter->open[iter->nr_open - 1].children);
+        if (child != NULL) {
+            iter->last = child;
+            iter->depth = iter->nr_open;
+            return child;
+        }
+        iter->nr_open--;
+    }
+    return NULL;
+}
+
+static chunk_node_t* chunk_node_iter_next_post(chunk_node_iter_t* iter) {
+    if (iter->start != NULL) {
+        if (!chunk_node_iter_push(iter, iter->start)) {
+            return NULL;
+        }
+        iter->start = NULL;
+    }
+    while (iter->nr_open) {
+        chunk_node_iter_open_t* top = &iter->open[iter->nr_open - 1];
+        chunk_node_t* child = chunk_btree_iter_next(&top->children);
+        if (child != NULL) {
+            // a node with nothing below it is done as soon as it is reached
+            if (!chunk_node_iter_enter(child)) {
+                iter->depth = iter->nr_open;
+                return child;
+            }
+            if (!chunk_node_iter_push(iter, child)) {
+                return NULL;
+            }
+            continue;
+        }
+        iter->nr_open--;
+        iter->depth = iter->nr_open;
+        return top->node;
+    }
+    return NULL;
+}
+
+// Walkers in this file call the step for their order directly.
+chunk_node_t* chunk_node_iter_next(chunk_node_iter_t* iter) {
+    if (iter->order == CHUNK_ITER_POST_ORDER) {
+        return chunk_node_iter_next_post(iter);
+    }
+    return chunk_node_iter_next_pre(iter);
+}
+
+void chunk_node_iter_skip(chunk_node_iter_t* iter) {
+    iter->last = NULL;
+}
+
+void chunk_node_iter_destroy(chunk_node_iter_t* iter) {
+    if (iter->open != iter->open_inline) {
+        free(iter->open);
+    }
+    iter->open = iter->open_inline;
+    iter->nr_open = 0;
+    iter->capacity_open = CHUNK_ITER_INLINE;
+}
+
+// Bytes taken by the varint at data, padding included.
+static uint8_t chunk_node_varint_width(uint8_t* data) {
+    uint8_t width = 1;
+    while ((width < CHUNK_VARINT_MAX) && (data[width - 1] & 0x80)) {
+        width++;
+    }
+    return width;
+}
+
+static uint8_t chunk_node_at_least(uint8_t width, uint8_t needed) {
+    return (width > needed) ? width : needed;
+}
+
+// The header form a node is written with, 0 for fixed length bytes, and the
+// widths of its length and item count fields. A node with no source gets what
+// chunk_write_header() would write.
+static uint8_t chunk_node_header_form(chunk_node_t* node, uint8_t* nr_bytes, uint8_t* nr_count_bytes) {
+    *nr_count_bytes = 0;
+    if (node->address == NULL) {
+        *nr_bytes = (node->type == CHUNK_TYPE_SET) ? 8 : chunk_nr_length_bytes(node->data_length);
+        return 0;
+    }
+    uint8_t form = (node->address[0] >> 0x04) & 0x0f;
+    if ((form != CHUNK_LENGTH_VARINT) && (form != CHUNK_LENGTH_COUNTED)) {
+        *nr_bytes = chunk_node_at_least(form, chunk_nr_length_bytes(node->data_length));
+        return 0;
+    }
+    uint8_t width = chunk_node_varint_width(node->address + 1);
+    *nr_bytes = chunk_node_at_least(width, chunk_varint_length_bytes(node->data_length));
+    // a set retyped as a leaf has no count to keep
+    if ((form == CHUNK_LENGTH_COUNTED) && (node->type == CHUNK_TYPE_SET)) {
+        uint8_t count_width = chunk_node_varint_width(node->address + 1 + width);
+        *nr_count_bytes = chunk_node_at_least(count_width, chunk_varint_length_bytes(node->nr_children));
+        return CHUNK_LENGTH_COUNTED;
+    }
+    return CHUNK_LENGTH_VARINT;
+}
+
+uint8_t* chunk_node_write_header(chunk_node_t* node, uint8_t* data) {
+    uint8_t nr_bytes = 0;
+    uint8_t nr_count_bytes = 0;
+    uint8_t form = chunk_node_header_form(node, &nr_bytes, &nr_count_bytes);
+    if (form == 0) {
+        *data = ((nr_bytes & 0x0f) << 4) | (node->type & 0x0f);
+        return chunk_write_length_bytes(data + 1, nr_bytes, node->data_length);
+    }
+    *data = (form << 4) | (node->type & 0x0f);
+    data = chunk_write_varint_padded(data + 1, node->data_length, nr_bytes);
+    return chunk_write_varint_padded(data, node->nr_children, nr_count_bytes);
+}
+
+// node->data_length has changed. Mark the node and its ancestors dirty and
+// carry the change in encoded size up the parent chain, given how much the
+// node's own data_length changed. Snapshots cached on the way up no longer
+// match and are dropped.
+static void chunk_node_changed(chunk_node_t* node, int64_t delta) {
+    for (chunk_node_t* walk = node; walk != NULL; walk = walk->parent) {
+        chunk_snap_release(walk->snap);
+        walk->snap = NULL;
+    }
+    while (node != NULL) {
+        uint8_t was_dirty = BIT_TEST(node->flags, NODE_FLAG_DIRTY);
+        BIT_SET(node->flags, NODE_FLAG_DIRTY);
+        uint8_t nr_length_bytes = 0;
+        uint8_t nr_count_bytes = 0;
+        chunk_node_header_form(node, &nr_length_bytes, &nr_count_bytes);
+        nr_length_bytes += nr_count_bytes;
+        delta += (int64_t)nr_length_bytes - node->nr_length_bytes;
+        node->nr_length_bytes = nr_length_bytes;
+        if (was_dirty && (delta == 0)) {
+            return;
+        }
+        node = node->parent;
+        if (node != NULL) {
+            node->data_length += delta;
         }
-        return size;
     }
-    return chunk_nr_length_bytes(node->data_length) + 1 + node->data_length;
 }
 
 chunk_node_t* chunk_node_make() {
     chunk_node_t* node = malloc(sizeof(chunk_node_t));
-    memset(node, 0, sizeof(chunk_node_t));
+    if (node != NULL) {
+        memset(node, 0, sizeof(chunk_node_t));
+    }
     return node;
 }
 
-void chunk_node_init(chunk_node_t* node, chunk_t chunk, uint8_t* start) {
+static void* chunk_node_alloc(chunk_arena_t* arena, uint64_t size) {
+    if (arena != NULL) {
+        return chunk_arena_alloc(arena, size);
+    }
+    return malloc(size);
+}
+
+// Number of items in a run of bytes of this leaf's type.
+static uint64_t chunk_node_count(chunk_node_t* node, uint8_t* data, uint64_t nr_bytes) {
+    switch (node->type) {
+        case CHUNK_TYPE_UTF8: {
+            // u8_charnum() reads one byte past the end, which data may not have
+            uint64_t nr_chars = 0;
+            for (uint64_t i = 0; i < nr_bytes; i++) {
+                nr_chars += ((data[i] & 0xc0) != 0x80);
+            }
+            return nr_chars;
+        }
+        case CHUNK_TYPE_UNDEF:
+        case CHUNK_TYPE_REF:
+            return 0;
+        default:
+            return nr_bytes / chunk_bytes_per_type(node->type);
+    }
+}
+
+// Fill node in from chunk. Returns 0 if out of memory copying a leaf's data,
+// in which case the leaf has no data and is not realised.
+uint8_t chunk_node_init(chunk_node_t* node, chunk_t chunk, chunk_arena_t* arena, uint8_t borrow) {
     node->type = chunk.type;
     node->address = chunk.address;
     node->data_length = chunk.data_length;
+    node->nr_length_bytes = chunk.nr_length_bytes;
     switch (chunk.type) {
         case CHUNK_TYPE_SET:
             node->nr_children = chunk_set_nr_items(chunk);
             break;
         case CHUNK_TYPE_UTF8:
-            node->nr_children = u8_strlen((char*)chunk.data);
+            node->nr_children = chunk_node_count(node, chunk.data, chunk.data_length);
+            break;
+        case CHUNK_TYPE_UNDEF:
+        case CHUNK_TYPE_REF:
+            node->nr_children = 0;
             break;
         default:
             node->nr_children = chunk.data_length / chunk_bytes_per_type(node->type);
             break;
     }
+    if (arena != NULL) {
+        BIT_SET(node->flags, NODE_FLAG_ARENA);
+    }
     if (chunk.type != CHUNK_TYPE_SET) {
-        node->data = malloc(sizeof(uint8_t) * chunk.data_length);
-        memcpy(node->data, chunk.data, chunk.data_length);
+        if (borrow) {
+            node->data = chunk.data;
+            BIT_SET(node->flags, NODE_FLAG_BORROWED);
+        }
+        else if (chunk.data_length <= CHUNK_NODE_INLINE) {
+            node->data = node->bytes;
+            memcpy(node->data, chunk.data, chunk.data_length);
+            BIT_SET(node->flags, NODE_FLAG_INLINE);
+        }
+        else {
+            node->data = chunk_node_alloc(arena, sizeof(uint8_t) * chunk.data_length);
+            if (node->data == NULL) {
+                return 0;
+            }
+            memcpy(node->data, chunk.data, chunk.data_length);
+        }
+        BIT_SET(node->flags, NODE_FLAG_REALISED);
     }
+    return 1;
+}
+
+uint8_t* chunk_node_data_own(chunk_node_t* node) {
+    if (node->type == CHUNK_TYPE_SET) {
+        return NULL;
+    }
+    if (node->gap != NULL) {
+        return chunk_node_data(node);
+    }
+    if (BIT_TEST(node->flags, NODE_FLAG_BORROWED)) {
+        uint8_t* data = node->bytes;
+        if (node->data_length > CHUNK_NODE_INLINE) {
+            data = malloc(sizeof(uint8_t) * node->data_length);
+            if (data == NULL) {
+                return NULL;
+            }
+        }
+        else {
+            BIT_SET(node->flags, NODE_FLAG_INLINE);
+        }
+        memcpy(data, node->data, node->data_length);
+        node->data = data;
+        BIT_UNSET(node->flags, NODE_FLAG_BORROWED);
+    }
+    return node->data;
+}
+
+uint8_t chunk_node_realise(chunk_node_t* node) {
+    if (node->type != CHUNK_TYPE_SET) {
+        return 0;
+    }
+    if (BIT_TEST(node->flags, NODE_FLAG_REALISED)) {
+        return 0;
+    }
+    size_t size = node->nr_children * sizeof(chunk_node_t);
+    chunk_node_t* block = (chunk_node_t*)malloc(size);
+    if ((block == NULL) && (size > 0)) {
+        return 0;
+    }
+    memset(block, 0, size);
+    if (!chunk_btree_build(&node->children, (uint8_t*)block, sizeof(chunk_node_t), node->nr_children, NULL)) {
+        free(block);
+        return 0;
+    }
+    node->block = block;
+    chunk_t chunk = chunk_decode(node->address);
+    uint8_t* data = chunk.data;
+    for (uint64_t i = 0; i < node->nr_children; i++) {
+        chunk_t child = chunk_decode(data);
+        chunk_node_init(&node->block[i], child, NULL, 1);
+        node->block[i].parent = node;
+        data = data + child.total_length;
+    }
+    BIT_UNSET(node->flags, NODE_FLAG_ARENA);
+    BIT_SET(node->flags, NODE_FLAG_REALISED);
+    return 1;
+}
+
+// wraps after 2^32 touches, which only puts trim order out for a while
+static uint32_t chunk_node_clock = 0;
+
+chunk_node_t* chunk_node_child(chunk_node_t* node, uint64_t idx) {
+    if (node->type != CHUNK_TYPE_SET) {
+        return NULL;
+    }
+    if (idx >= node->nr_children) {
+        return NULL;
+    }
+    chunk_node_realise(node);
+    chunk_node_t* child = chunk_btree_get(&node->children, idx);
+    if (child == NULL) {
+        return NULL;
+    }
+    chunk_node_clock++;
+    node->touched = chunk_node_clock;
+    child->touched = chunk_node_clock;
+    return child;
 }
 
 chunk_node_t* chunk_node_select(chunk_node_t* node, uint64_t* addr, uint64_t nr_addr) {
     if (node->type != CHUNK_TYPE_SET) {
         return NULL;
     }
-    if (addr[0] >= node->nr_children) {
+    chunk_node_t* child = chunk_node_child(node, addr[0]);
+    if (child == NULL) {
         return NULL;
     }
-    chunk_node_t* child = &node->children[addr[0]];
     nr_addr--;
     if (nr_addr == 0) {
         return child;
@@ -59,25 +383,105 @@ chunk_node_t* chunk_node_select(chunk_node_t* node, uint64_t* addr, uint64_t nr_
     return chunk_node_select(child, &addr[1], nr_addr);
 }
 
-uint8_t* chunk_node_data_insert(chunk_node_t* node, uint64_t location, uint8_t* data, uint64_t nr_bytes) {
+uint8_t* chunk_node_data(chunk_node_t* node) {
+    // a set's children share these fields
     if (node->type == CHUNK_TYPE_SET) {
         return NULL;
     }
-    if (location > node->data_length) {
+    if (node->gap != NULL) {
+        node->data = chunk_gap_flatten(node->gap);
+    }
+    return node->data;
+}
+
+// Whether a leaf's flat data was malloc'd for it alone.
+static uint8_t chunk_node_data_owned(chunk_node_t* node) {
+    if (node->data == NULL) {
+        return 0;
+    }
+    return !BIT_TEST(node->flags, NODE_FLAG_ARENA) && !BIT_TEST(node->flags, NODE_FLAG_BORROWED) && !BIT_TEST(node->flags, NODE_FLAG_INLINE);
+}
+
+uint8_t chunk_node_data_copy(chunk_node_t* node, uint64_t location, uint64_t nr_bytes, uint8_t* dest) {
+    if (node->type == CHUNK_TYPE_SET) {
+        return 0;
+    }
+    if ((location > node->data_length) || (nr_bytes > (node->data_length - location))) {
+        return 0;
+    }
+    if (node->gap != NULL) {
+        chunk_gap_copy_range(node->gap, location, nr_bytes, dest);
+    }
+    else if (nr_bytes > 0) {
+        memcpy(dest, &node->data[location], nr_bytes);
+    }
+    return 1;
+}
+
+static chunk_gap_t* chunk_node_gap(chunk_node_t* node) {
+    if (node->gap != NULL) {
+        return node->gap;
+    }
+    chunk_gap_t* gap = malloc(sizeof(chunk_gap_t));
+    if ((gap == NULL) || !chunk_gap_init(gap, node->data, node->data_length)) {
+        free(gap);
         return NULL;
     }
-    uint8_t* data_new = malloc(sizeof(uint8_t) * (node->data_length + nr_bytes));
+    if (chunk_node_data_owned(node)) {
+        free(node->data);
+    }
+    BIT_UNSET(node->flags, NODE_FLAG_ARENA);
+    BIT_UNSET(node->flags, NODE_FLAG_BORROWED);
+    BIT_UNSET(node->flags, NODE_FLAG_INLINE);
+    node->gap = gap;
+    return gap;
+}
 
-    if (location == node->data_length) {
-        memcpy(&data_new[0], node->data, sizeof(uint8_t) * node->data_length);
+uint8_t chunk_node_data_insert(chunk_node_t* node, uint64_t location, uint8_t* data, uint64_t nr_bytes) {
+    if (node->type == CHUNK_TYPE_SET) {
+        return 0;
+    }
+    if (location > node->data_length) {
+        return 0;
+    }
+    chunk_gap_t* gap = chunk_node_gap(node);
+    if ((gap == NULL) || !chunk_gap_insert(gap, location, data, nr_bytes)) {
+        return 0;
+    }
+    node->data = NULL;
+    node->data_length += nr_bytes;
+    if (node->type == CHUNK_TYPE_UTF8) {
+        node->nr_children += chunk_node_count(node, data, nr_bytes);
     }
     else {
-        if (location > 0) {
-            memcpy(&data_new[0], &node->data[0], sizeof(uint8_t) * location);
-        }
-        memcpy(&data_new[location + 1], &node->data[location], sizeof(uint8_t) * (node->data_length - location));
+        node->nr_children = chunk_node_count(node, NULL, node->data_length);
     }
-    return node->data;
+    chunk_node_changed(node, (int64_t)nr_bytes);
+    return 1;
+}
+
+uint8_t chunk_node_data_delete(chunk_node_t* node, uint64_t location, uint64_t nr_bytes) {
+    if (node->type == CHUNK_TYPE_SET) {
+        return 0;
+    }
+    if ((location > node->data_length) || (nr_bytes > (node->data_length - location))) {
+        return 0;
+    }
+    uint8_t* deleted = NULL;
+    chunk_gap_t* gap = chunk_node_gap(node);
+    if ((gap == NULL) || !chunk_gap_delete(gap, location, nr_bytes, &deleted)) {
+        return 0;
+    }
+    node->data = NULL;
+    node->data_length -= nr_bytes;
+    if (node->type == CHUNK_TYPE_UTF8) {
+        node->nr_children -= chunk_node_count(node, deleted, nr_bytes);
+    }
+    else {
+        node->nr_children = chunk_node_count(node, NULL, node->data_length);
+    }
+    chunk_node_changed(node, -(int64_t)nr_bytes);
+    return 1;
 }
 
 chunk_node_t* chunk_node_set_insert(chunk_node_t* node, uint64_t location) {
@@ -87,38 +491,113 @@ chunk_node_t* chunk_node_set_insert(chunk_node_t* node, uint64_t location) {
     if (location > node->nr_children) {
         return NULL;
     }
-    chunk_node_t* children_new = malloc(sizeof(chunk_node_t) * (node->nr_children + 1));
-
-    if (location == node->nr_children) {
-        memcpy(&children_new[0], node->children, sizeof(chunk_node_t) * node->nr_children);
+    chunk_node_realise(node);
+    if (!BIT_TEST(node->flags, NODE_FLAG_REALISED)) {
+        return NULL;
     }
-    else {
-        if (location > 0) {
-            memcpy(&children_new[0], &node->children[0], sizeof(chunk_node_t) * location);
-        }
-        memcpy(&children_new[location + 1], &node->children[location], sizeof(chunk_node_t) * (node->nr_children - location));
+    chunk_node_t* child = chunk_node_make();
+    if (child == NULL) {
+        return NULL;
+    }
+    BIT_SET(child->flags, NODE_FLAG_REALISED);
+    BIT_SET(child->flags, NODE_FLAG_DIRTY);
+    BIT_SET(child->flags, NODE_FLAG_ALLOCATED);
+    child->parent = node;
+    child->nr_length_bytes = chunk_nr_length_bytes(0);
+    if (!chunk_btree_insert(&node->children, location, child)) {
+        free(child);
+        return NULL;
     }
-    memset(&children_new[location], 0, sizeof(chunk_node_t));
-    free(node->children);
-    node->children = children_new;
     node->nr_children++;
-    node->data_length = chunk_nr_length_bytes(0) + 1;
-    return &children_new[location];
+    node->data_length += chunk_node_size(child);
+    chunk_node_changed(node, (int64_t)chunk_node_size(child));
+    return child;
 }
 
-void chunk_node_destroy_tree(chunk_node_t* node) {
+uint8_t chunk_node_set_type(chunk_node_t* node, chunk_type_t type) {
+    if ((node->data_length != 0) || (node->nr_children != 0)) {
+        return 0;
+    }
+    // an emptied leaf can still hold a gap buffer and an emptied set its pages
+    chunk_node_destroy_tree(node);
+    // a leaf's payload fields share space with a set's children
+    node->data = NULL;
+    node->gap = NULL;
+    node->block = NULL;
+    node->type = type;
+    chunk_node_changed(node, 0);
+    return 1;
+}
+
+// Free what node holds, but not node itself or its children.
+static void chunk_node_release(chunk_node_t* node) {
+    chunk_snap_release(node->snap);
+    node->snap = NULL;
     if (node->type == CHUNK_TYPE_SET) {
-        for (uint64_t i = 0; i < node->nr_children; i++) {
-            chunk_node_t* child = &node->children[i];
-            chunk_node_destroy_tree(child);
+        if (!BIT_TEST(node->flags, NODE_FLAG_REALISED)) {
+            return;
+        }
+        chunk_btree_destroy(&node->children);
+        if ((node->block != NULL) && !BIT_TEST(node->flags, NODE_FLAG_ARENA)) {
+            free(node->block);
         }
-        free(node->children);
-        node->children = NULL;
+        node->block = NULL;
         return;
     }
-    if (node->data != NULL) {
+    if (node->gap != NULL) {
+        chunk_gap_destroy(node->gap);
+        free(node->gap);
+        node->gap = NULL;
+        node->data = NULL;
+        return;
+    }
+    if (chunk_node_data_owned(node)) {
         free(node->data);
     }
+    BIT_UNSET(node->flags, NODE_FLAG_INLINE);
+}
+
+void chunk_node_destroy_tree(chunk_node_t* node) {
+    if ((node->type != CHUNK_TYPE_SET) || !BIT_TEST(node->flags, NODE_FLAG_REALISED)) {
+        chunk_node_release(node);
+        return;
+    }
+    // children go before the set whose block and pages hold them
+    chunk_node_iter_t iter;
+    chunk_node_iter_init(&iter, node, CHUNK_ITER_POST_ORDER);
+    chunk_node_t* walk = NULL;
+    while ((walk = chunk_node_iter_next_post(&iter)) != NULL) {
+        chunk_node_release(walk);
+        if ((walk != node) && BIT_TEST(walk->flags, NODE_FLAG_ALLOCATED)) {
+            free(walk);
+        }
+    }
+    chunk_node_iter_destroy(&iter);
+}
+
+uint8_t chunk_node_set_delete(chunk_node_t* node, uint64_t location) {
+    if (node->type != CHUNK_TYPE_SET) {
+        return 0;
+    }
+    if (location >= node->nr_children) {
+        return 0;
+    }
+    chunk_node_realise(node);
+    if (!BIT_TEST(node->flags, NODE_FLAG_REALISED)) {
+        return 0;
+    }
+    chunk_node_t* child = chunk_btree_remove(&node->children, location);
+    uint64_t size = chunk_node_size(child);
+    node->data_length -= size;
+    node->nr_children--;
+    chunk_node_changed(node, -(int64_t)size);
+    chunk_node_destroy_tree(child);
+    // children decoded together share the parent's block, which is released
+    // with the parent
+    if (BIT_TEST(child->flags, NODE_FLAG_ALLOCATED)) {
+        free(child);
+    }
+    return 1;
 }
 
 void chunk_node_destroy(chunk_node_t* node) {
@@ -126,31 +605,598 @@ void chunk_node_destroy(chunk_node_t* node) {
     free(node);
 }
 
-chunk_t chunk_node_construct(uint8_t* start, chunk_node_t* node) {
+// A set chunk_node_construct() is filling in and where the bytes of its next
+// child start.
+typedef struct chunk_node_fill {
+    chunk_node_t* set;
+    uint8_t* next;
+} chunk_node_fill_t;
+
+// Give a set its block of empty child slots and the pages that index them.
+static uint8_t chunk_node_fill_begin(chunk_node_t* set, chunk_arena_t* arena) {
+    size_t size = set->nr_children * sizeof(chunk_node_t);
+    chunk_node_t* block = (chunk_node_t*)chunk_node_alloc(arena, size);
+    if ((block == NULL) && (size > 0)) {
+        return 0;
+    }
+    memset(block, 0, size);
+    if (!chunk_btree_build(&set->children, (uint8_t*)block, sizeof(chunk_node_t), set->nr_children, arena)) {
+        if (arena == NULL) {
+            free(block);
+        }
+        return 0;
+    }
+    set->block = block;
+    BIT_SET(set->flags, NODE_FLAG_REALISED);
+    return 1;
+}
+
+// Decode the subtree at start into node. Returns 0 if out of memory copying
+// leaf data, leaving a partial tree for chunk_node_destroy_tree().
+static uint8_t chunk_node_construct(uint8_t* start, chunk_node_t* node, chunk_arena_t* arena) {
     chunk_t chunk = chunk_decode(start);
-    chunk_node_init(node, chunk, start);
+    if (!chunk_node_init(node, chunk, arena, 0)) {
+        return 0;
+    }
+    if (chunk.type != CHUNK_TYPE_SET) {
+        return 1;
+    }
+
+    // a set gets a block of empty slots and each child is decoded when the
+    // walk reaches it, so a node is finished while its bytes are still hot
+    chunk_node_fill_t fill_inline[CHUNK_ITER_INLINE];
+    chunk_node_fill_t* fill = fill_inline;
+    uint32_t capacity_fill = CHUNK_ITER_INLINE;
+    chunk_node_iter_t iter;
+    chunk_node_iter_init(&iter, node, CHUNK_ITER_PRE_ORDER);
+    chunk_node_t* walk = chunk_node_iter_next_pre(&iter);
+    chunk_t decoded = chunk;
+    uint8_t ok = 1;
+    while (walk != NULL) {
+        if (walk->type == CHUNK_TYPE_SET) {
+            if (iter.depth == capacity_fill) {
+                chunk_node_fill_t* grown = NULL;
+                if (fill == fill_inline) {
+                    grown = malloc(sizeof(chunk_node_fill_t) * capacity_fill * 2);
+                    if (grown != NULL) {
+                        memcpy(grown, fill_inline, sizeof(fill_inline));
+                    }
+                }
+                else {
+                    grown = realloc(fill, sizeof(chunk_node_fill_t) * capacity_fill * 2);
+                }
+                if (grown != NULL) {
+                    fill = grown;
+                    capacity_fill *= 2;
+                }
+            }
+            // out of memory the set stays unrealised and is decoded on use
+            if ((iter.depth < capacity_fill) && chunk_node_fill_begin(walk, arena)) {
+                fill[iter.depth].set = walk;
+                fill[iter.depth].next = decoded.data;
+            }
+        }
+        walk = chunk_node_iter_next_pre(&iter);
+        if (walk != NULL) {
+            chunk_node_fill_t* parent = &fill[iter.depth - 1];
+            decoded = chunk_decode(parent->next);
+            parent->next += decoded.total_length;
+            walk->parent = parent->set;
+            if (!chunk_node_init(walk, decoded, arena, 0)) {
+                ok = 0;
+                break;
+            }
+        }
+    }
+    chunk_node_iter_destroy(&iter);
+    if (fill != fill_inline) {
+        free(fill);
+    }
+    return ok;
+}
+
+// Forget where a freshly constructed subtree came from and size it the way it
+// will be written out.
+static uint64_t chunk_node_detach(chunk_node_t* node) {
+    chunk_node_iter_t iter;
+    chunk_node_iter_init(&iter, node, CHUNK_ITER_POST_ORDER);
+    chunk_node_t* walk = NULL;
+    while ((walk = chunk_node_iter_next_post(&iter)) != NULL) {
+        walk->address = NULL;
+        BIT_SET(walk->flags, NODE_FLAG_DIRTY);
+        if (walk->type != CHUNK_TYPE_SET) {
+            walk->nr_length_bytes = chunk_nr_length_bytes(walk->data_length);
+            continue;
+        }
+        // the children were sized before their set
+        walk->data_length = 0;
+        for (uint64_t i = 0; i < walk->nr_children; i++) {
+            walk->data_length += chunk_node_size(&walk->block[i]);
+        }
+        walk->nr_length_bytes = 8;
+    }
+    chunk_node_iter_destroy(&iter);
+    return chunk_node_size(node);
+}
+
+chunk_node_t* chunk_node_set_insert_chunk(chunk_node_t* node, uint64_t location, uint8_t* start) {
+    chunk_node_t* child = chunk_node_set_insert(node, location);
+    if (child == NULL) {
+        return NULL;
+    }
+    uint64_t empty = chunk_node_size(child);
+    uint8_t nr_length_bytes = child->nr_length_bytes;
+    if (!chunk_node_construct(start, child, NULL)) {
+        // back to the empty child chunk_node_set_insert() made, then drop it
+        chunk_node_destroy_tree(child);
+        child->type = CHUNK_TYPE_UNDEF;
+        child->data = NULL;
+        child->gap = NULL;
+        child->block = NULL;
+        child->data_length = 0;
+        child->nr_children = 0;
+        child->nr_length_bytes = nr_length_bytes;
+        chunk_node_set_delete(node, location);
+        return NULL;
+    }
+    int64_t delta = (int64_t)chunk_node_detach(child) - (int64_t)empty;
+    node->data_length += delta;
+    chunk_node_changed(node, delta);
+    return child;
+}
+
+chunk_node_t* chunk_node_build(uint8_t* start) {
+    chunk_node_t* node = chunk_node_make();
+    if (node == NULL) {
+        return NULL;
+    }
+    if (!chunk_node_construct(start, node, NULL)) {
+        chunk_node_destroy(node);
+        return NULL;
+    }
+    return node;
+}
+
+chunk_node_t* chunk_node_build_arena(uint8_t* start, chunk_arena_t* arena) {
+    chunk_node_t* node = chunk_arena_alloc(arena, sizeof(chunk_node_t));
+    if (node == NULL) {
+        return NULL;
+    }
+    memset(node, 0, sizeof(chunk_node_t));
+    if (!chunk_node_construct(start, node, arena)) {
+        chunk_node_destroy_tree(node);
+        return NULL;
+    }
+    return node;
+}
+
+// A run of consecutive children to construct, starting at start.
+typedef struct chunk_node_task {
+    uint8_t* start;
+    chunk_node_t* nodes;
+    uint64_t nr_nodes;
+} chunk_node_task_t;
+
+typedef struct chunk_node_tasks {
+    chunk_node_task_t* tasks;
+    uint64_t nr_tasks;
+    uint64_t capacity;
+    uint64_t next;
+    uint64_t grain;
+    uint8_t failed;
+} chunk_node_tasks_t;
+
+typedef struct chunk_node_worker {
+    pthread_t thread;
+    chunk_node_tasks_t* tasks;
+    chunk_arena_t* arena;
+} chunk_node_worker_t;
+
+static void chunk_node_task_add(chunk_node_tasks_t* tasks, uint8_t* start, chunk_node_t* nodes, uint64_t nr_nodes) {
+    if (nr_nodes == 0) {
+        return;
+    }
+    if (tasks->nr_tasks == tasks->capacity) {
+        uint64_t capacity = tasks->capacity ? tasks->capacity * 2 : 64;
+        chunk_node_task_t* grown = realloc(tasks->tasks, capacity * sizeof(chunk_node_task_t));
+        if (grown == NULL) {
+            tasks->failed = 1;
+            return;
+        }
+        tasks->tasks = grown;
+        tasks->capacity = capacity;
+    }
+    chunk_node_task_t* task = &tasks->tasks[tasks->nr_tasks++];
+    task->start = start;
+    task->nodes = nodes;
+    task->nr_nodes = nr_nodes;
+}
 
-    if (chunk.type == CHUNK_TYPE_SET) {
-        node->nr_children = chunk_set_nr_items(chunk);
+// Decode a set and the headers of its children. Children larger than the
+// grain are split the same way, the rest are grouped into runs of about a
+// grain's worth of bytes. Sets still to split wait on a stack of one node
+// tasks, so a deeply nested document does not recurse.
+static void chunk_node_split(uint8_t* start, chunk_node_t* node, chunk_arena_t* arena, chunk_node_tasks_t* tasks) {
+    chunk_node_tasks_t pending;
+    memset(&pending, 0, sizeof(chunk_node_tasks_t));
+    chunk_node_task_add(&pending, start, node, 1);
+    while ((pending.nr_tasks > 0) && !pending.failed && !tasks->failed) {
+        chunk_node_task_t set = pending.tasks[--pending.nr_tasks];
+        node = set.nodes;
+        chunk_t chunk = chunk_decode(set.start);
+        // a set copies nothing, so this cannot run out of memory
+        chunk_node_init(node, chunk, arena, 0);
         size_t size = node->nr_children * sizeof(chunk_node_t);
-        node->children = (chunk_node_t*)malloc(size);
-        memset(node->children, 0, size);
-        uint64_t remaining = chunk.data_length;
+        node->block = (chunk_node_t*)chunk_node_alloc(arena, size);
+        if ((node->block == NULL) && (size > 0)) {
+            tasks->failed = 1;
+            break;
+        }
+        memset(node->block, 0, size);
+        if (!chunk_btree_build(&node->children, (uint8_t*)node->block, sizeof(chunk_node_t), node->nr_children, arena)) {
+            tasks->failed = 1;
+            break;
+        }
+        BIT_SET(node->flags, NODE_FLAG_REALISED);
+
         uint8_t* data = chunk.data;
-        uint64_t i = 0;
-        while (remaining) {
-            chunk_t child = chunk_node_construct(data, &node->children[i]);
-            i++;
+        uint8_t* run = data;
+        uint64_t run_idx = 0;
+        for (uint64_t i = 0; i < node->nr_children; i++) {
+            chunk_t child = chunk_decode(data);
+            node->block[i].parent = node;
+            if ((child.type == CHUNK_TYPE_SET) && (child.total_length > tasks->grain)) {
+                chunk_node_task_add(tasks, run, &node->block[run_idx], i - run_idx);
+                chunk_node_task_add(&pending, data, &node->block[i], 1);
+                run = data + child.total_length;
+                run_idx = i + 1;
+            }
+            else if ((uint64_t)((data + child.total_length) - run) >= tasks->grain) {
+                chunk_node_task_add(tasks, run, &node->block[run_idx], (i + 1) - run_idx);
+                run = data + child.total_length;
+                run_idx = i + 1;
+            }
             data = data + child.total_length;
-            remaining = remaining - child.total_length;
         }
+        chunk_node_task_add(tasks, run, &node->block[run_idx], node->nr_children - run_idx);
     }
+    tasks->failed |= pending.failed;
+    free(pending.tasks);
+}
 
-    return chunk;
+// Threads take the next run off the shared list until it is empty, so a
+// thread that drew small runs ends up doing more of them. A thread that runs
+// out of memory marks the build failed and every thread stops.
+static void* chunk_node_work(void* arg) {
+    chunk_node_worker_t* worker = arg;
+    chunk_node_tasks_t* tasks = worker->tasks;
+    while (!__atomic_load_n(&tasks->failed, __ATOMIC_RELAXED)) {
+        uint64_t idx = __atomic_fetch_add(&tasks->next, 1, __ATOMIC_RELAXED);
+        if (idx >= tasks->nr_tasks) {
+            break;
+        }
+        chunk_node_task_t* task = &tasks->tasks[idx];
+        uint8_t* data = task->start;
+        for (uint64_t i = 0; i < task->nr_nodes; i++) {
+            if (!chunk_node_construct(data, &task->nodes[i], worker->arena)) {
+                __atomic_store_n(&tasks->failed, 1, __ATOMIC_RELAXED);
+                return NULL;
+            }
+            data += chunk_decode(data).total_length;
+        }
+    }
+    return NULL;
 }
 
-chunk_node_t* chunk_node_build(uint8_t* start) {
+chunk_node_t* chunk_node_build_parallel(uint8_t* start, chunk_arena_t* arena, uint32_t nr_threads) {
+    if (nr_threads == 0) {
+        long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nr_threads = (nr_cpus > 0) ? nr_cpus : 1;
+    }
+    chunk_t chunk = chunk_decode(start);
+    if ((nr_threads == 1) || (chunk.type != CHUNK_TYPE_SET)) {
+        return chunk_node_build_arena(start, arena);
+    }
+
+    chunk_node_tasks_t tasks;
+    memset(&tasks, 0, sizeof(chunk_node_tasks_t));
+    // enough runs for the threads to even out uneven ones
+    tasks.grain = chunk.total_length / ((uint64_t)nr_threads * 64);
+    if (tasks.grain < 4096) {
+        tasks.grain = 4096;
+    }
+    chunk_node_t* node = chunk_arena_alloc(arena, sizeof(chunk_node_t));
+    if (node == NULL) {
+        return NULL;
+    }
+    memset(node, 0, sizeof(chunk_node_t));
+    chunk_node_split(start, node, arena, &tasks);
+    if (tasks.failed) {
+        free(tasks.tasks);
+        chunk_node_destroy_tree(node);
+        return chunk_node_build_arena(start, arena);
+    }
+
+    // the calling thread works too, from the caller's arena
+    chunk_node_worker_t* workers = malloc(nr_threads * sizeof(chunk_node_worker_t));
+    uint32_t nr_started = 0;
+    for (uint32_t i = 1; (workers != NULL) && (i < nr_threads); i++) {
+        chunk_node_worker_t* worker = &workers[nr_started];
+        worker->tasks = &tasks;
+        worker->arena = chunk_arena_create(arena->block_size);
+        if (worker->arena == NULL) {
+            break;
+        }
+        if (pthread_create(&worker->thread, NULL, chunk_node_work, worker) != 0) {
+            chunk_arena_destroy(worker->arena);
+            break;
+        }
+        nr_started++;
+    }
+    chunk_node_worker_t self;
+    self.tasks = &tasks;
+    self.arena = arena;
+    chunk_node_work(&self);
+
+    for (uint32_t i = 0; i < nr_started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        chunk_arena_merge(arena, workers[i].arena);
+    }
+    free(workers);
+    free(tasks.tasks);
+    if (tasks.failed) {
+        chunk_node_destroy_tree(node);
+        return NULL;
+    }
+    return node;
+}
+
+chunk_node_t* chunk_node_build_lazy(uint8_t* start) {
     chunk_node_t* node = chunk_node_make();
-    chunk_node_construct(start, node);
+    if (node == NULL) {
+        return NULL;
+    }
+    chunk_node_init(node, chunk_decode(start), NULL, 1);
     return node;
 }
+
+void chunk_node_destroy_arena(chunk_node_t* node, chunk_arena_t* arena) {
+    chunk_node_destroy_tree(node);
+    chunk_arena_destroy(arena);
+}
+
+static uint8_t chunk_node_pinned(chunk_node_t* node) {
+    uint8_t pinned = 0;
+    chunk_node_iter_t iter;
+    chunk_node_iter_init(&iter, node, CHUNK_ITER_PRE_ORDER);
+    chunk_node_t* walk = NULL;
+    while ((walk = chunk_node_iter_next_pre(&iter)) != NULL) {
+        if (BIT_TEST(walk->flags, NODE_FLAG_DIRTY) || BIT_TEST(walk->flags, NODE_FLAG_FOCUS)) {
+            pinned = 1;
+            break;
+        }
+    }
+    // a walk cut short by memory cannot vouch for the rest
+    pinned |= iter.failed;
+    chunk_node_iter_destroy(&iter);
+    return pinned;
+}
+
+static void chunk_node_unrealise(chunk_node_t* node) {
+    chunk_node_destroy_tree(node);
+    BIT_UNSET(node->flags, NODE_FLAG_ARENA);
+    BIT_UNSET(node->flags, NODE_FLAG_REALISED);
+}
+
+uint8_t chunk_node_load_data_unrealise(chunk_node_t* node) {
+    if ((node->type != CHUNK_TYPE_SET) || !BIT_TEST(node->flags, NODE_FLAG_REALISED)) {
+        return 0;
+    }
+    if ((node->address == NULL) || chunk_node_pinned(node)) {
+        return 0;
+    }
+    chunk_node_unrealise(node);
+    return 1;
+}
+
+void chunk_node_clean(chunk_node_t* node) {
+    chunk_node_iter_t iter;
+    chunk_node_iter_init(&iter, node, CHUNK_ITER_PRE_ORDER);
+    chunk_node_t* walk = NULL;
+    while ((walk = chunk_node_iter_next_pre(&iter)) != NULL) {
+        if (!BIT_TEST(walk->flags, NODE_FLAG_DIRTY) || (walk->address == NULL)) {
+            chunk_node_iter_skip(&iter);
+            continue;
+        }
+        BIT_UNSET(walk->flags, NODE_FLAG_DIRTY);
+        chunk_t chunk = chunk_decode(walk->address);
+        walk->nr_length_bytes = chunk.nr_length_bytes;
+        if (walk->type != CHUNK_TYPE_SET) {
+            chunk_node_release(walk);
+            BIT_UNSET(walk->flags, NODE_FLAG_ARENA);
+            BIT_SET(walk->flags, NODE_FLAG_BORROWED);
+            walk->data = chunk.data;
+        }
+    }
+    chunk_node_iter_destroy(&iter);
+}
+
+uint64_t chunk_node_memory(chunk_node_t* node) {
+    uint64_t memory = 0;
+    chunk_node_iter_t iter;
+    chunk_node_iter_init(&iter, node, CHUNK_ITER_PRE_ORDER);
+    chunk_node_t* walk = NULL;
+    while ((walk = chunk_node_iter_next_pre(&iter)) != NULL) {
+        uint8_t arena = BIT_TEST(walk->flags, NODE_FLAG_ARENA);
+        if ((walk != node) && BIT_TEST(walk->flags, NODE_FLAG_ALLOCATED)) {
+            memory += sizeof(chunk_node_t);
+        }
+        if (walk->type != CHUNK_TYPE_SET) {
+            if (walk->gap != NULL) {
+                memory += walk->gap->capacity;
+            }
+            else if ((walk->data != NULL) && !arena && !BIT_TEST(walk->flags, NODE_FLAG_BORROWED) && !BIT_TEST(walk->flags, NODE_FLAG_INLINE)) {
+                memory += walk->data_length;
+            }
+            continue;
+        }
+        if (!BIT_TEST(walk->flags, NODE_FLAG_REALISED)) {
+            continue;
+        }
+        memory += chunk_btree_memory(&walk->children);
+        if ((walk->block != NULL) && !arena) {
+            memory += walk->nr_children * sizeof(chunk_node_t);
+        }
+    }
+    chunk_node_iter_destroy(&iter);
+    return memory;
+}
+
+typedef struct chunk_node_lru {
+    chunk_node_t* node;
+    uint64_t touched;
+    uint64_t position;
+    uint64_t end;
+} chunk_node_lru_t;
+
+typedef struct chunk_node_lru_list {
+    chunk_node_lru_t* entries;
+    uint64_t nr_entries;
+    uint64_t capacity;
+} chunk_node_lru_list_t;
+
+typedef struct chunk_node_lru_open {
+    uint64_t entry;
+    uint32_t depth;
+    uint8_t pinned;
+} chunk_node_lru_open_t;
+
+// Pre-order list of the realised sets below root that can be unrealised. Each
+// entry records where its subtree ends so that unrealising it can retire the
+// entries of its descendants. Sets whose subtree is pinned or that have no
+// source to reload from are kept in the list but marked as never to go.
+// Returns 0 if out of memory, leaving a list that must not be used.
+static uint8_t chunk_node_lru_collect(chunk_node_t* root, chunk_node_lru_list_t* list) {
+    uint32_t nr_open = 0;
+    uint32_t capacity_open = 64;
+    chunk_node_lru_open_t* open = malloc(sizeof(chunk_node_lru_open_t) * capacity_open);
+    if (open == NULL) {
+        return 0;
+    }
+    uint8_t ok = 1;
+    chunk_node_iter_t iter;
+    chunk_node_iter_init(&iter, root, CHUNK_ITER_PRE_ORDER);
+    // root itself is not a candidate
+    chunk_node_t* node = chunk_node_iter_next_pre(&iter);
+    while (node != NULL) {
+        node = chunk_node_iter_next_pre(&iter);
+        // sets the walk has left are complete
+        while (nr_open && ((node == NULL) || (open[nr_open - 1].depth >= iter.depth))) {
+            chunk_node_lru_open_t* done = &open[--nr_open];
+            // a walk cut short by memory may have missed a pinned node
+            done->pinned |= iter.failed;
+            chunk_node_lru_t* entry = &list->entries[done->entry];
+            entry->end = list->nr_entries;
+            if (done->pinned || (entry->node->address == NULL)) {
+                entry->touched = UINT64_MAX;
+            }
+            if (nr_open) {
+                open[nr_open - 1].pinned |= done->pinned;
+            }
+        }
+        if (node == NULL) {
+            break;
+        }
+        uint8_t pinned = BIT_TEST(node->flags, NODE_FLAG_DIRTY) || BIT_TEST(node->flags, NODE_FLAG_FOCUS);
+        if ((node->type != CHUNK_TYPE_SET) || !BIT_TEST(node->flags, NODE_FLAG_REALISED)) {
+            if (nr_open) {
+                open[nr_open - 1].pinned |= pinned;
+            }
+            continue;
+        }
+        if (list->nr_entries == list->capacity) {
+            uint64_t capacity = list->capacity ? list->capacity * 2 : 64;
+            chunk_node_lru_t* entries = realloc(list->entries, capacity * sizeof(chunk_node_lru_t));
+            if (entries == NULL) {
+                ok = 0;
+                break;
+            }
+            list->entries = entries;
+            list->capacity = capacity;
+        }
+        if (nr_open == capacity_open) {
+            chunk_node_lru_open_t* grown = realloc(open, sizeof(chunk_node_lru_open_t) * capacity_open * 2);
+            if (grown == NULL) {
+                ok = 0;
+                break;
+            }
+            open = grown;
+            capacity_open *= 2;
+        }
+        uint64_t idx = list->nr_entries++;
+        list->entries[idx].node = node;
+        list->entries[idx].touched = node->touched;
+        list->entries[idx].position = idx;
+        open[nr_open].entry = idx;
+        open[nr_open].depth = iter.depth;
+        open[nr_open].pinned = pinned;
+        nr_open++;
+    }
+    chunk_node_iter_destroy(&iter);
+    free(open);
+    return ok;
+}
+
+static int chunk_node_lru_compare(const void* a, const void* b) {
+    const chunk_node_lru_t* x = a;
+    const chunk_node_lru_t* y = b;
+    if (x->touched != y->touched) {
+        return (x->touched < y->touched) ? -1 : 1;
+    }
+    return (x->position < y->position) ? -1 : (x->position > y->position);
+}
+
+uint64_t chunk_node_trim(chunk_node_t* root, uint64_t budget) {
+    uint64_t memory = chunk_node_memory(root);
+    if ((memory <= budget) || (root->type != CHUNK_TYPE_SET) || !BIT_TEST(root->flags, NODE_FLAG_REALISED)) {
+        return memory;
+    }
+
+    chunk_node_lru_list_t list;
+    memset(&list, 0, sizeof(chunk_node_lru_list_t));
+    if (!chunk_node_lru_collect(root, &list) || (list.nr_entries == 0)) {
+        free(list.entries);
+        return memory;
+    }
+
+    // entries are in pre-order, so a copy sorted by age still finds its
+    // subtree range through position
+    uint8_t* retired = calloc(list.nr_entries, sizeof(uint8_t));
+    chunk_node_lru_t* order = malloc(list.nr_entries * sizeof(chunk_node_lru_t));
+    if ((retired == NULL) || (order == NULL)) {
+        free(retired);
+        free(order);
+        free(list.entries);
+        return memory;
+    }
+    memcpy(order, list.entries, list.nr_entries * sizeof(chunk_node_lru_t));
+    qsort(order, list.nr_entries, sizeof(chunk_node_lru_t), chunk_node_lru_compare);
+
+    for (uint64_t i = 0; (i < list.nr_entries) && (memory > budget); i++) {
+        chunk_node_lru_t* entry = &order[i];
+        if (entry->touched == UINT64_MAX) {
+            break;
+        }
+        if (retired[entry->position]) {
+            continue;
+        }
+        memory -= chunk_node_memory(entry->node);
+        chunk_node_unrealise(entry->node);
+        memset(&retired[entry->position], 1, entry->end - entry->position);
+    }
+
+    free(order);
+    free(retired);
+    free(list.entries);
+    return memory;
+}
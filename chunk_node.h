@@ -3,34 +3,194 @@
 
 #include <stdint.h>
 #include "chunk.h"
+#include "chunk_arena.h"
+#include "chunk_gap.h"
+#include "chunk_btree.h"
 
 #define NODE_FLAG_FOCUS 0x00
 #define NODE_FLAG_REALISED 0x01
+#define NODE_FLAG_ARENA 0x02
+#define NODE_FLAG_DIRTY 0x03
+#define NODE_FLAG_BORROWED 0x04
+#define NODE_FLAG_ALLOCATED 0x05
+#define NODE_FLAG_INLINE 0x06
+
+// Leaves with at most this many payload bytes keep them in the node itself.
+#define CHUNK_NODE_INLINE 8
 
 typedef struct chunk_node chunk_node_t;
 
+// A node is 72 bytes: the small fields share the first word and a leaf's
+// payload fields overlay a set's children, since a node is only ever one of
+// the two. node->data of an inline leaf points at node->bytes, so a node
+// must not be moved once built.
 typedef struct chunk_node {
-    chunk_type_t type;
+    uint8_t type;
     uint8_t flags;
+    uint8_t nr_length_bytes;
+    uint32_t touched;
     uint64_t data_length;
-    uint8_t* address;
-    uint8_t* data;
     uint64_t nr_children;
-    chunk_node_t* children;
+    uint8_t* address;
+    chunk_node_t* parent;
+    struct chunk_snap* snap;
+    union {
+        struct {
+            uint8_t* data;
+            chunk_gap_t* gap;
+            uint8_t bytes[CHUNK_NODE_INLINE];
+        };
+        struct {
+            chunk_btree_t children;
+            chunk_node_t* block;
+        };
+    };
 } chunk_node_t;
 
-uint64_t chunk_node_size(chunk_node_t* node);
+// Encoded size of the subtree, from the length of its header and payload,
+// both kept up to date by every edit. A clean node is written back as the
+// bytes it was read from. A dirty node read from a buffer keeps the header
+// form it had there (fixed, compact or counted) and the width of each field,
+// padding included, until a value no longer fits that width. Other nodes get
+// an 8 byte length header for a set and the shortest one for a leaf.
+static inline uint64_t chunk_node_size(chunk_node_t* node) {
+    return 1 + node->nr_length_bytes + node->data_length;
+}
+
+// Write the header chunk_node_size() counts for node. Returns the start of
+// the payload; the header is 1 + node->nr_length_bytes long.
+uint8_t* chunk_node_write_header(chunk_node_t* node, uint8_t* data);
+
+// Decode the direct children of a set that was built lazily. Returns 1 if
+// children were decoded, 0 if the node is not a set, already realised or
+// out of memory, in which case it stays unrealised.
+uint8_t chunk_node_realise(chunk_node_t* node);
+
+// Make a leaf's data private before writing to it. Borrowed data is copied
+// out of the buffer it points into; owned data is returned as is. NULL for a
+// set, or if out of memory, in which case the leaf stays borrowed.
+uint8_t* chunk_node_data_own(chunk_node_t* node);
+
+// Child idx of a set, realising the set first if needed. NULL if out of range.
+chunk_node_t* chunk_node_child(chunk_node_t* node, uint64_t idx);
 
 chunk_node_t* chunk_node_select(chunk_node_t* node, uint64_t* addr, uint64_t nr_addr);
 
-uint8_t* chunk_node_data_insert(chunk_node_t* node, uint64_t location, uint8_t* data, uint64_t nr_bytes);
+// Leaf data as one contiguous block. A leaf that has been edited keeps its
+// bytes in a gap buffer and node->data is NULL until this flattens it.
+// NULL for sets.
+uint8_t* chunk_node_data(chunk_node_t* node);
 
+// Copy nr_bytes of a leaf's payload starting at location into dest, leaving
+// a gap buffer where it is. Returns 0 for sets and out of range requests.
+uint8_t chunk_node_data_copy(chunk_node_t* node, uint64_t location, uint64_t nr_bytes, uint8_t* dest);
+
+// Edit a leaf in place. The first edit moves the payload into a gap buffer,
+// after which edits at the same position are amortized O(1). Returns 1 on
+// success, 0 for sets, out of range locations or when out of memory.
+uint8_t chunk_node_data_insert(chunk_node_t* node, uint64_t location, uint8_t* data, uint64_t nr_bytes);
+
+uint8_t chunk_node_data_delete(chunk_node_t* node, uint64_t location, uint64_t nr_bytes);
+
+// Children live in a counted B+tree of node pointers, so inserting, removing
+// and indexing are O(log n) and a child keeps its address while its siblings
+// change. The returned node is empty, realised and dirty.
 chunk_node_t* chunk_node_set_insert(chunk_node_t* node, uint64_t location);
 
-void chunk_node_load_data_unrealise(chunk_node_t* node);
+// Insert a copy of the encoded subtree at start as child location of a set.
+// The copy owns all of its data and is dirty throughout, so start can be
+// freed afterwards. Returns the new child, or NULL if out of memory, in which
+// case the set is left without it.
+chunk_node_t* chunk_node_set_insert_chunk(chunk_node_t* node, uint64_t location, uint8_t* start);
+
+// Remove and destroy child location of a set. Returns 1 on success.
+uint8_t chunk_node_set_delete(chunk_node_t* node, uint64_t location);
+
+// Give an empty node from chunk_node_set_insert() its type. Returns 0 if the
+// node already holds data or children.
+uint8_t chunk_node_set_type(chunk_node_t* node, chunk_type_t type);
+
+// Drop the children of a clean set and fall back to its address. Returns 0
+// without doing anything if the subtree is dirty, focused or was never read
+// from a buffer.
+uint8_t chunk_node_load_data_unrealise(chunk_node_t* node);
+
+// The buffer the tree was built from now holds the tree's current bytes, e.g.
+// after chunk_save_patch(). Clears the dirty flags and lets edited leaves
+// borrow their data from the buffer again.
+void chunk_node_clean(chunk_node_t* node);
+
+// Heap bytes held by the children and leaf data under node.
+uint64_t chunk_node_memory(chunk_node_t* node);
+
+// Unrealise the least recently touched clean sets below root until the tree
+// holds at most budget bytes. Dirty and focused subtrees are pinned, so the
+// result can stay above budget, and out of memory nothing is trimmed.
+// Returns the bytes held afterwards.
+uint64_t chunk_node_trim(chunk_node_t* root, uint64_t budget);
 
 void chunk_node_destroy(chunk_node_t* node);
 
+typedef struct chunk_node_iter_open {
+    chunk_node_t* node;
+    chunk_btree_iter_t children;
+} chunk_node_iter_open_t;
+
+typedef struct chunk_node_iter {
+    chunk_iter_order_t order;
+    chunk_node_t* start;
+    chunk_node_t* last;
+    uint8_t failed;
+    uint32_t depth;
+    uint32_t nr_open;
+    uint32_t capacity_open;
+    chunk_node_iter_open_t* open;
+    chunk_node_iter_open_t open_inline[CHUNK_ITER_INLINE];
+} chunk_node_iter_t;
+
+// Walk node and every node below it without recursing, in pre-order or
+// post-order. Only realised sets are entered, so the walk never decodes; in
+// pre-order a set can be realised when it is returned and its children follow.
+// After a node is returned iter->depth holds its depth below node. The tree
+// must not change except for the node returned last: in post-order it may be
+// freed, in pre-order its children may be built. Like chunk_iter_t the
+// iterator holds its first levels itself and must not be copied.
+void chunk_node_iter_init(chunk_node_iter_t* iter, chunk_node_t* node, chunk_iter_order_t order);
+
+// The next node, or NULL at the end or if memory ran out (iter->failed).
+chunk_node_t* chunk_node_iter_next(chunk_node_iter_t* iter);
+
+// In pre-order, do not walk the children of the node returned last.
+void chunk_node_iter_skip(chunk_node_iter_t* iter);
+
+void chunk_node_iter_destroy(chunk_node_iter_t* iter);
+
+// Every node is decoded and leaf data is copied, but each node still records
+// where it came from in start: unrealising, trimming, saving clean spans,
+// patching and snapshots all read it back from there. start must outlive the
+// tree. NULL if out of memory.
 chunk_node_t* chunk_node_build(uint8_t* start);
 
+// Nodes, children pages and leaf data all come from the arena. Release the
+// tree with chunk_node_destroy_arena() instead of chunk_node_destroy(). As
+// with chunk_node_build(), start must outlive the tree. NULL if out of memory,
+// and what was taken from the arena stays there until it is destroyed.
+chunk_node_t* chunk_node_build_arena(uint8_t* start, chunk_arena_t* arena);
+
+// Same tree as chunk_node_build_arena(), built by nr_threads threads (0 for
+// one per online CPU). Sets larger than a share of the document are decoded
+// up front to find where their children start, and runs of children are then
+// handed to the threads. Each thread allocates from an arena of its own, and
+// those arenas are merged into arena at the end. NULL if any thread ran out
+// of memory.
+chunk_node_t* chunk_node_build_parallel(uint8_t* start, chunk_arena_t* arena, uint32_t nr_threads);
+
+// Only the root is decoded. Sets realise their children the first time they
+// are reached through chunk_node_child(), chunk_node_select() or an insert.
+// Leaf data is borrowed from start rather than copied, so start must stay
+// mapped for the lifetime of the tree. NULL if out of memory.
+chunk_node_t* chunk_node_build_lazy(uint8_t* start);
+
+void chunk_node_destroy_arena(chunk_node_t* node, chunk_arena_t* arena);
+
 #endif
@@ -0,0 +1,288 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include "chunk_save.h"
+#include "chunk_snap.h"
+#include "chunk_btree.h"
+#include "bitwise.h"
+
+#define CHUNK_SAVE_NR_IOVECS 1024
+#define CHUNK_SAVE_HEADER_BYTES (CHUNK_SAVE_NR_IOVECS * CHUNK_COUNTED_HEADER_MAX)
+
+typedef struct chunk_save {
+    int fd;
+    uint8_t failed;
+    struct iovec iov[CHUNK_SAVE_NR_IOVECS];
+    uint32_t nr_iov;
+    uint8_t headers[CHUNK_SAVE_HEADER_BYTES];
+    uint32_t headers_used;
+    chunk_save_stats_t stats;
+} chunk_save_t;
+
+static void chunk_save_flush(chunk_save_t* save) {
+    struct iovec* iov = save->iov;
+    uint32_t nr_iov = save->nr_iov;
+    while ((nr_iov > 0) && !save->failed) {
+        ssize_t written = writev(save->fd, iov, nr_iov);
+        if (written < 0) {
+            save->failed = 1;
+            break;
+        }
+        save->stats.nr_writes++;
+        // a short write leaves the rest of the vector to go again
+        while ((nr_iov > 0) && ((size_t)written >= iov->iov_len)) {
+            written -= iov->iov_len;
+            iov++;
+            nr_iov--;
+        }
+        if (nr_iov > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    save->nr_iov = 0;
+    save->headers_used = 0;
+}
+
+static void chunk_save_span(chunk_save_t* save, uint8_t* data, uint64_t length) {
+    if (length == 0) {
+        return;
+    }
+    save->stats.nr_bytes += length;
+    if (save->nr_iov > 0) {
+        struct iovec* last = &save->iov[save->nr_iov - 1];
+        if (((uint8_t*)last->iov_base + last->iov_len) == data) {
+            last->iov_len += length;
+            return;
+        }
+    }
+    if (save->nr_iov == CHUNK_SAVE_NR_IOVECS) {
+        chunk_save_flush(save);
+    }
+    save->iov[save->nr_iov].iov_base = data;
+    save->iov[save->nr_iov].iov_len = length;
+    save->nr_iov++;
+    save->stats.nr_iovecs++;
+}
+
+static void chunk_save_header(chunk_save_t* save, chunk_node_t* node) {
+    // headers are referenced by pending iovecs, so the space is only reused
+    // once they have been written
+    if ((save->headers_used + CHUNK_COUNTED_HEADER_MAX) > CHUNK_SAVE_HEADER_BYTES) {
+        chunk_save_flush(save);
+    }
+    uint8_t* start = &save->headers[save->headers_used];
+    uint8_t* end = chunk_node_write_header(node, start);
+    save->headers_used += end - start;
+    chunk_save_span(save, start, end - start);
+}
+
+static void chunk_save_node(chunk_save_t* save, chunk_node_t* node) {
+    chunk_node_iter_t iter;
+    chunk_node_iter_init(&iter, node, CHUNK_ITER_PRE_ORDER);
+    chunk_node_t* walk = NULL;
+    while ((walk = chunk_node_iter_next(&iter)) != NULL) {
+        if (!BIT_TEST(walk->flags, NODE_FLAG_DIRTY) && (walk->address != NULL)) {
+            save->stats.nr_reused += chunk_node_size(walk);
+            chunk_save_span(save, walk->address, chunk_node_size(walk));
+            chunk_node_iter_skip(&iter);
+            continue;
+        }
+        chunk_save_header(save, walk);
+        if (walk->type != CHUNK_TYPE_SET) {
+            chunk_save_span(save, chunk_node_data(walk), walk->data_length);
+        }
+    }
+    save->failed |= iter.failed;
+    chunk_node_iter_destroy(&iter);
+}
+
+static void chunk_save_snap(chunk_save_t* save, chunk_snap_t* snap) {
+    chunk_snap_iter_t iter;
+    chunk_snap_iter_init(&iter, snap);
+    chunk_snap_t* part = NULL;
+    while ((part = chunk_snap_iter_next(&iter)) != NULL) {
+        if (part->kind == CHUNK_SNAP_BYTES) {
+            save->stats.nr_reused += part->size;
+            chunk_save_span(save, part->data, part->size);
+            continue;
+        }
+        chunk_save_span(save, part->header, part->size - part->data_length);
+        if (part->kind == CHUNK_SNAP_LEAF) {
+            chunk_save_span(save, part->data, part->data_length);
+        }
+    }
+    save->failed |= iter.failed;
+    chunk_snap_iter_destroy(&iter);
+}
+
+// Either root or snap is given.
+static uint8_t chunk_save_write(chunk_node_t* root, chunk_snap_t* snap, int fd, chunk_save_stats_t* stats) {
+    chunk_save_t* save = malloc(sizeof(chunk_save_t));
+    if (save == NULL) {
+        return 0;
+    }
+    memset(save, 0, sizeof(chunk_save_t));
+    save->fd = fd;
+    if (root != NULL) {
+        chunk_save_node(save, root);
+    }
+    else {
+        chunk_save_snap(save, snap);
+    }
+    chunk_save_flush(save);
+    uint8_t ok = !save->failed;
+    if (stats != NULL) {
+        *stats = save->stats;
+    }
+    free(save);
+    return ok;
+}
+
+uint8_t chunk_save_fd(chunk_node_t* root, int fd, chunk_save_stats_t* stats) {
+    return chunk_save_write(root, NULL, fd, stats);
+}
+
+uint8_t chunk_save_snap_fd(chunk_snap_t* snap, int fd, chunk_save_stats_t* stats) {
+    return chunk_save_write(NULL, snap, fd, stats);
+}
+
+static uint8_t chunk_save_replace(chunk_node_t* root, chunk_snap_t* snap, const char* path, chunk_save_stats_t* stats) {
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        return 0;
+    }
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return 0;
+    }
+    uint8_t ok = chunk_save_write(root, snap, fd, stats);
+    ok = ok && (fsync(fd) == 0);
+    ok = (close(fd) == 0) && ok;
+    ok = ok && (rename(tmp, path) == 0);
+    if (!ok) {
+        unlink(tmp);
+    }
+    return ok;
+}
+
+uint8_t chunk_save_file(chunk_node_t* root, const char* path, chunk_save_stats_t* stats) {
+    return chunk_save_replace(root, NULL, path, stats);
+}
+
+uint8_t chunk_save_snap_file(chunk_snap_t* snap, const char* path, chunk_save_stats_t* stats) {
+    return chunk_save_replace(NULL, snap, path, stats);
+}
+
+typedef struct chunk_save_patch {
+    uint64_t offset;
+    uint8_t* data;
+    uint64_t length;
+} chunk_save_patch_t;
+
+typedef struct chunk_save_patch_list {
+    chunk_save_patch_t* patches;
+    uint64_t nr_patches;
+    uint64_t capacity;
+} chunk_save_patch_list_t;
+
+static uint8_t chunk_save_patch_add(chunk_save_patch_list_t* list, uint64_t offset, uint8_t* data, uint64_t length) {
+    if (list->nr_patches == list->capacity) {
+        uint64_t capacity = list->capacity ? list->capacity * 2 : 16;
+        chunk_save_patch_t* patches = realloc(list->patches, capacity * sizeof(chunk_save_patch_t));
+        if (patches == NULL) {
+            return 0;
+        }
+        list->patches = patches;
+        list->capacity = capacity;
+    }
+    chunk_save_patch_t* patch = &list->patches[list->nr_patches++];
+    patch->offset = offset;
+    patch->data = data;
+    patch->length = length;
+    return 1;
+}
+
+// Check one dirty node and record the bytes of a leaf that changed.
+static uint8_t chunk_save_patch_node(chunk_node_t* node, uint8_t* base, chunk_save_patch_list_t* list) {
+    if (node->address == NULL) {
+        return 0;
+    }
+    // the header a full save would write has to be the one already there
+    uint8_t header[CHUNK_COUNTED_HEADER_MAX];
+    uint64_t header_length = chunk_node_write_header(node, header) - header;
+    chunk_t chunk = chunk_decode(node->address);
+    if ((chunk.total_length != chunk_node_size(node)) || (memcmp(header, node->address, header_length) != 0)) {
+        return 0;
+    }
+    if (node->type == CHUNK_TYPE_SET) {
+        return BIT_TEST(node->flags, NODE_FLAG_REALISED);
+    }
+
+    uint8_t* data = chunk_node_data(node);
+    uint64_t first = 0;
+    while ((first < chunk.data_length) && (data[first] == chunk.data[first])) {
+        first++;
+    }
+    if (first == chunk.data_length) {
+        return 1;
+    }
+    uint64_t last = chunk.data_length - 1;
+    while (data[last] == chunk.data[last]) {
+        last--;
+    }
+    return chunk_save_patch_add(list, (chunk.data - base) + first, &data[first], (last - first) + 1);
+}
+
+// Returns 0 as soon as an edit is found that moved or resized anything. New
+// children have no address, so a set whose length and children all check out
+// can only have had its leaves rewritten in place.
+static uint8_t chunk_save_patch_collect(chunk_node_t* node, uint8_t* base, chunk_save_patch_list_t* list) {
+    uint8_t ok = 1;
+    chunk_node_iter_t iter;
+    chunk_node_iter_init(&iter, node, CHUNK_ITER_PRE_ORDER);
+    chunk_node_t* walk = NULL;
+    while (ok && ((walk = chunk_node_iter_next(&iter)) != NULL)) {
+        if (!BIT_TEST(walk->flags, NODE_FLAG_DIRTY)) {
+            chunk_node_iter_skip(&iter);
+            continue;
+        }
+        // the tree's own snapshots go, so only the callers' remain counted
+        chunk_snap_release(walk->snap);
+        walk->snap = NULL;
+        ok = chunk_save_patch_node(walk, base, list);
+    }
+    ok &= !iter.failed;
+    chunk_node_iter_destroy(&iter);
+    return ok;
+}
+
+uint8_t chunk_save_patch(chunk_node_t* root, int fd, uint8_t* base, chunk_save_stats_t* stats) {
+    chunk_save_patch_list_t list;
+    memset(&list, 0, sizeof(chunk_save_patch_list_t));
+    if (stats != NULL) {
+        memset(stats, 0, sizeof(chunk_save_stats_t));
+    }
+    // a snapshot reading base would see the patch
+    if (!chunk_save_patch_collect(root, base, &list) || (chunk_snap_nr_borrowed(root) != 0)) {
+        free(list.patches);
+        return 0;
+    }
+
+    uint8_t ok = 1;
+    for (uint64_t i = 0; (i < list.nr_patches) && ok; i++) {
+        chunk_save_patch_t* patch = &list.patches[i];
+        ok = (pwrite(fd, patch->data, patch->length, patch->offset) == (ssize_t)patch->length);
+        if (stats != NULL) {
+            stats->nr_bytes += patch->length;
+            stats->nr_writes++;
+            stats->nr_patches++;
+        }
+    }
+    free(list.patches);
+    return ok;
+}
@@ -0,0 +1,97 @@
+#ifndef H_CHUNK_SAVE
+#define H_CHUNK_SAVE
+
+#include <stdint.h>
+#include "chunk_node.h"
+#include "chunk_snap.h"
+
+typedef struct chunk_save_stats {
+    uint64_t nr_bytes;
+    uint64_t nr_reused;
+    uint64_t nr_iovecs;
+    uint64_t nr_writes;
+    uint64_t nr_patches;
+} chunk_save_stats_t;
+
+/**
+ * @brief Serialize a tree to a file descriptor with writev
+ *
+ * Clean subtrees, realised or not, are written straight from the buffer they
+ * were read from, and neighbouring clean spans are merged into one iovec.
+ * Only dirty sets and leaves are re-encoded, each with the header form and
+ * field widths it was read with (see chunk_node_write_header()), so compact,
+ * counted and padded headers survive an edit. Padding keeps a payload
+ * aligned as long as nothing before it changed size. The output is
+ * chunk_node_size(root) bytes long.
+ *
+ * @param root Root of the tree
+ * @param fd File descriptor open for writing at the current offset
+ * @param stats If not NULL, receives counts for the save
+ * @return 1 on success, 0 if a write failed
+ */
+uint8_t chunk_save_fd(chunk_node_t* root, int fd, chunk_save_stats_t* stats);
+
+/**
+ * @brief Serialize a tree to a file, replacing it atomically
+ *
+ * The tree is written to path with a ".tmp" suffix, synced and renamed over
+ * path. A mapping of the old file, which the tree may still reference, stays
+ * valid because the old inode lives on until it is unmapped.
+ *
+ * @param root Root of the tree
+ * @param path File to write
+ * @param stats If not NULL, receives counts for the save
+ * @return 1 on success, 0 on any failure, in which case path is untouched
+ */
+uint8_t chunk_save_file(chunk_node_t* root, const char* path, chunk_save_stats_t* stats);
+
+/**
+ * @brief Serialize a snapshot to a file descriptor with writev
+ *
+ * As chunk_save_fd(), with BYTES parts written straight from the source
+ * buffer. The live tree can go on being edited meanwhile, e.g. while another
+ * thread saves.
+ *
+ * @param snap A snapshot
+ * @param fd File descriptor open for writing at the current offset
+ * @param stats If not NULL, receives counts for the save
+ * @return 1 on success, 0 if a write failed
+ */
+uint8_t chunk_save_snap_fd(chunk_snap_t* snap, int fd, chunk_save_stats_t* stats);
+
+/**
+ * @brief Serialize a snapshot to a file, replacing it atomically
+ *
+ * As chunk_save_file().
+ *
+ * @param snap A snapshot
+ * @param path File to write
+ * @param stats If not NULL, receives counts for the save
+ * @return 1 on success, 0 on any failure, in which case path is untouched
+ */
+uint8_t chunk_save_snap_file(chunk_snap_t* snap, const char* path, chunk_save_stats_t* stats);
+
+/**
+ * @brief Write only the changed bytes of a tree back into its own file
+ *
+ * Works when no edit changed an encoded length: every dirty set still has its
+ * original children in their original places and every dirty node encodes to
+ * the same header and size it has in base. Each changed leaf is written with
+ * one pwrite covering its first to last differing byte. Nothing is written if
+ * the tree does not qualify, so the caller can fall back to
+ * chunk_save_file(). Snapshots read clean spans from base, so this also
+ * refuses while any snapshot holding such a span is alive (see
+ * chunk_snap_nr_borrowed()), whether taken from this tree or another read
+ * from base; the tree drops the snapshots it cached itself first. Snapshots
+ * of trees read from other buffers do not count. Once this succeeds the buffer holds the
+ * tree's bytes and chunk_node_clean() may be called.
+ *
+ * @param root Root of a tree built from base
+ * @param fd The file base was read from, open for writing
+ * @param base Start of the buffer the tree was built from
+ * @param stats If not NULL, receives counts for the save
+ * @return 1 if the file now matches the tree, 0 if it needs a full rewrite
+ */
+uint8_t chunk_save_patch(chunk_node_t* root, int fd, uint8_t* base, chunk_save_stats_t* stats);
+
+#endif
@@ -0,0 +1,476 @@
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "chunk_snap.h"
+#include "chunk_btree.h"
+#include "bitwise.h"
+
+static chunk_snap_t* chunk_snap_make(chunk_snap_kind_t kind, chunk_type_t type, uint64_t nr_parts) {
+    chunk_snap_t* snap = malloc(sizeof(chunk_snap_t) + (nr_parts * sizeof(chunk_snap_t*)));
+    if (snap == NULL) {
+        return NULL;
+    }
+    memset(snap, 0, sizeof(chunk_snap_t));
+    snap->refs = 1;
+    snap->kind = kind;
+    snap->type = type;
+    snap->nr_parts = nr_parts;
+    return snap;
+}
+
+// A buffer trees were read from, known by where their root starts, and the
+// number of BYTES parts alive that read from it. A source is only listed
+// while it has parts, so the list is as long as the number of buffers with
+// snapshots out.
+typedef struct chunk_snap_source {
+    uint8_t* base;
+    uint64_t nr_borrowed;
+    struct chunk_snap_source* next;
+} chunk_snap_source_t;
+
+static chunk_snap_source_t* chunk_snap_sources = NULL;
+static pthread_mutex_t chunk_snap_sources_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Where the root above node was read from, NULL if nowhere.
+static uint8_t* chunk_snap_base(chunk_node_t* node) {
+    while (node->parent != NULL) {
+        node = node->parent;
+    }
+    return node->address;
+}
+
+static chunk_snap_source_t** chunk_snap_source_find(uint8_t* base) {
+    chunk_snap_source_t** link = &chunk_snap_sources;
+    while ((*link != NULL) && ((*link)->base != base)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+static chunk_snap_source_t* chunk_snap_source_borrow(uint8_t* base) {
+    pthread_mutex_lock(&chunk_snap_sources_lock);
+    chunk_snap_source_t** link = chunk_snap_source_find(base);
+    if (*link == NULL) {
+        *link = calloc(1, sizeof(chunk_snap_source_t));
+        if (*link != NULL) {
+            (*link)->base = base;
+        }
+    }
+    chunk_snap_source_t* source = *link;
+    if (source != NULL) {
+        source->nr_borrowed++;
+    }
+    pthread_mutex_unlock(&chunk_snap_sources_lock);
+    return source;
+}
+
+static void chunk_snap_source_return(chunk_snap_source_t* source) {
+    pthread_mutex_lock(&chunk_snap_sources_lock);
+    if (--source->nr_borrowed == 0) {
+        chunk_snap_source_t** link = chunk_snap_source_find(source->base);
+        *link = source->next;
+        free(source);
+    }
+    pthread_mutex_unlock(&chunk_snap_sources_lock);
+}
+
+static chunk_snap_t* chunk_snap_bytes(uint8_t* base, uint8_t* address, uint64_t size) {
+    chunk_snap_t* snap = chunk_snap_make(CHUNK_SNAP_BYTES, CHUNK_TYPE_UNDEF, 0);
+    if (snap == NULL) {
+        return NULL;
+    }
+    snap->source = chunk_snap_source_borrow(base);
+    if (snap->source == NULL) {
+        free(snap);
+        return NULL;
+    }
+    snap->data = address;
+    snap->size = size;
+    snap->nr_items = 1;
+    return snap;
+}
+
+typedef struct chunk_snap_parts {
+    chunk_snap_t** parts;
+    uint64_t nr_parts;
+    uint64_t capacity;
+} chunk_snap_parts_t;
+
+static uint8_t chunk_snap_parts_add(chunk_snap_parts_t* parts, chunk_snap_t* part) {
+    if (part == NULL) {
+        return 0;
+    }
+    if (parts->nr_parts == parts->capacity) {
+        uint64_t capacity = parts->capacity ? parts->capacity * 2 : 8;
+        chunk_snap_t** grown = realloc(parts->parts, capacity * sizeof(chunk_snap_t*));
+        if (grown == NULL) {
+            chunk_snap_release(part);
+            return 0;
+        }
+        parts->parts = grown;
+        parts->capacity = capacity;
+    }
+    parts->parts[parts->nr_parts++] = part;
+    return 1;
+}
+
+static void chunk_snap_parts_destroy(chunk_snap_parts_t* parts) {
+    for (uint64_t i = 0; i < parts->nr_parts; i++) {
+        chunk_snap_release(parts->parts[i]);
+    }
+    free(parts->parts);
+}
+
+// Finish an edited set from the parts of its children, which it takes over.
+static chunk_snap_t* chunk_snap_set(chunk_node_t* node, chunk_snap_parts_t* parts) {
+    chunk_snap_t* snap = chunk_snap_make(CHUNK_SNAP_SET, CHUNK_TYPE_SET, parts->nr_parts);
+    if (snap == NULL) {
+        chunk_snap_parts_destroy(parts);
+        return NULL;
+    }
+    snap->size = chunk_node_size(node);
+    snap->nr_items = node->nr_children;
+    snap->data_length = node->data_length;
+    chunk_node_write_header(node, snap->header);
+    if (parts->nr_parts > 0) {
+        memcpy(snap->parts, parts->parts, parts->nr_parts * sizeof(chunk_snap_t*));
+    }
+    free(parts->parts);
+    node->snap = snap;
+    return snap;
+}
+
+static chunk_snap_t* chunk_snap_leaf(chunk_node_t* node) {
+    chunk_snap_t* snap = chunk_snap_make(CHUNK_SNAP_LEAF, node->type, 0);
+    if (snap == NULL) {
+        return NULL;
+    }
+    snap->size = chunk_node_size(node);
+    snap->nr_items = node->nr_children;
+    snap->data_length = node->data_length;
+    chunk_node_write_header(node, snap->header);
+    if (node->data_length > 0) {
+        snap->data = malloc(node->data_length);
+        if (snap->data == NULL) {
+            free(snap);
+            return NULL;
+        }
+        memcpy(snap->data, chunk_node_data(node), node->data_length);
+    }
+    return snap;
+}
+
+// Add a child of an edited set that needs no walking below it: untouched, a
+// leaf, or a set whose snapshot is still cached.
+static uint8_t chunk_snap_parts_child(chunk_snap_parts_t* parts, chunk_node_t* child, uint8_t* base) {
+    if (!BIT_TEST(child->flags, NODE_FLAG_DIRTY) && (child->address != NULL)) {
+        // untouched neighbours sit next to each other in the source, so
+        // they share one run rather than getting a part each
+        chunk_snap_t* last = parts->nr_parts ? parts->parts[parts->nr_parts - 1] : NULL;
+        if ((last != NULL) && (last->kind == CHUNK_SNAP_BYTES) && (last->refs == 1) && ((last->data + last->size) == child->address)) {
+            last->size += chunk_node_size(child);
+            last->nr_items++;
+            return 1;
+        }
+        return chunk_snap_parts_add(parts, chunk_snap_bytes(base, child->address, chunk_node_size(child)));
+    }
+    if (child->snap == NULL) {
+        child->snap = chunk_snap_leaf(child);
+        if (child->snap == NULL) {
+            return 0;
+        }
+    }
+    return chunk_snap_parts_add(parts, chunk_snap_retain(child->snap));
+}
+
+// An edited set whose snapshot is being put together.
+typedef struct chunk_snap_open {
+    chunk_node_t* set;
+    chunk_btree_iter_t children;
+    chunk_snap_parts_t parts;
+} chunk_snap_open_t;
+
+typedef struct chunk_snap_stack {
+    chunk_snap_open_t* open;
+    uint32_t nr_open;
+    uint32_t capacity;
+} chunk_snap_stack_t;
+
+static uint8_t chunk_snap_push(chunk_snap_stack_t* stack, chunk_node_t* set) {
+    if (stack->nr_open == stack->capacity) {
+        uint32_t capacity = stack->capacity ? stack->capacity * 2 : CHUNK_ITER_INLINE;
+        chunk_snap_open_t* open = realloc(stack->open, capacity * sizeof(chunk_snap_open_t));
+        if (open == NULL) {
+            return 0;
+        }
+        stack->open = open;
+        stack->capacity = capacity;
+    }
+    chunk_snap_open_t* top = &stack->open[stack->nr_open++];
+    memset(top, 0, sizeof(chunk_snap_open_t));
+    top->set = set;
+    // an unrealised set has nothing to walk
+    if (BIT_TEST(set->flags, NODE_FLAG_REALISED)) {
+        chunk_btree_iter_init(&top->children, &set->children);
+    }
+    return 1;
+}
+
+// Finish the innermost open set and hand it to the one it sits in.
+static uint8_t chunk_snap_pop(chunk_snap_stack_t* stack) {
+    chunk_snap_open_t* top = &stack->open[--stack->nr_open];
+    chunk_snap_t* snap = chunk_snap_set(top->set, &top->parts);
+    if (snap == NULL) {
+        return 0;
+    }
+    if (stack->nr_open == 0) {
+        return 1;
+    }
+    return chunk_snap_parts_add(&stack->open[stack->nr_open - 1].parts, chunk_snap_retain(snap));
+}
+
+chunk_snap_t* chunk_snap_take(chunk_node_t* node) {
+    // a clean node is not cached on, so that the tree itself holds no part
+    // that borrows from the source
+    uint8_t* base = chunk_snap_base(node);
+    if (!BIT_TEST(node->flags, NODE_FLAG_DIRTY) && (node->address != NULL)) {
+        return chunk_snap_bytes(base, node->address, chunk_node_size(node));
+    }
+    if ((node->snap == NULL) && (node->type != CHUNK_TYPE_SET)) {
+        node->snap = chunk_snap_leaf(node);
+    }
+    if ((node->snap != NULL) || (node->type != CHUNK_TYPE_SET)) {
+        return node->snap ? chunk_snap_retain(node->snap) : NULL;
+    }
+
+    // walk down the edited sets without a cached snapshot; each is finished
+    // once all its children have been added
+    chunk_snap_stack_t stack;
+    memset(&stack, 0, sizeof(chunk_snap_stack_t));
+    uint8_t ok = chunk_snap_push(&stack, node);
+    while (ok && (stack.nr_open > 0)) {
+        chunk_snap_open_t* top = &stack.open[stack.nr_open - 1];
+        chunk_node_t* child = chunk_btree_iter_next(&top->children);
+        if (child == NULL) {
+            ok = chunk_snap_pop(&stack);
+        }
+        else if ((child->type == CHUNK_TYPE_SET) && BIT_TEST(child->flags, NODE_FLAG_DIRTY) && (child->snap == NULL)) {
+            ok = chunk_snap_push(&stack, child);
+        }
+        else {
+            ok = chunk_snap_parts_child(&top->parts, child, base);
+        }
+    }
+    while (stack.nr_open > 0) {
+        chunk_snap_parts_destroy(&stack.open[--stack.nr_open].parts);
+    }
+    free(stack.open);
+    if (!ok) {
+        return NULL;
+    }
+    return chunk_snap_retain(node->snap);
+}
+
+chunk_snap_t* chunk_snap_retain(chunk_snap_t* snap) {
+    __atomic_fetch_add(&snap->refs, 1, __ATOMIC_RELAXED);
+    return snap;
+}
+
+// Free what a part holds once its last reference is gone, and chain it onto
+// the other dead parts through its data pointer, so that releasing a deep
+// snapshot needs neither recursion nor memory.
+static chunk_snap_t* chunk_snap_dead(chunk_snap_t* snap, chunk_snap_t* dead) {
+    if (snap->kind == CHUNK_SNAP_LEAF) {
+        free(snap->data);
+    }
+    if (snap->kind == CHUNK_SNAP_BYTES) {
+        chunk_snap_source_return(snap->source);
+    }
+    snap->data = (uint8_t*)dead;
+    return snap;
+}
+
+void chunk_snap_release(chunk_snap_t* snap) {
+    if (snap == NULL) {
+        return;
+    }
+    if (__atomic_sub_fetch(&snap->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    chunk_snap_t* dead = chunk_snap_dead(snap, NULL);
+    while (dead != NULL) {
+        snap = dead;
+        dead = (chunk_snap_t*)snap->data;
+        for (uint64_t i = 0; i < snap->nr_parts; i++) {
+            if (__atomic_sub_fetch(&snap->parts[i]->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+                dead = chunk_snap_dead(snap->parts[i], dead);
+            }
+        }
+        free(snap);
+    }
+}
+
+uint64_t chunk_snap_nr_borrowed(chunk_node_t* node) {
+    uint8_t* base = chunk_snap_base(node);
+    pthread_mutex_lock(&chunk_snap_sources_lock);
+    chunk_snap_source_t* source = *chunk_snap_source_find(base);
+    uint64_t nr_borrowed = (source != NULL) ? source->nr_borrowed : 0;
+    pthread_mutex_unlock(&chunk_snap_sources_lock);
+    return nr_borrowed;
+}
+
+uint64_t chunk_snap_size(chunk_snap_t* snap) {
+    return snap->size;
+}
+
+chunk_snap_node_t chunk_snap_root(chunk_snap_t* snap) {
+    chunk_snap_node_t node;
+    node.part = snap;
+    node.address = (snap->kind == CHUNK_SNAP_BYTES) ? snap->data : NULL;
+    return node;
+}
+
+chunk_t chunk_snap_chunk(chunk_snap_node_t node) {
+    if (node.address != NULL) {
+        return chunk_decode(node.address);
+    }
+    // the header holds the type and lengths; the payload, if any, is apart
+    chunk_t chunk = chunk_decode(node.part->header);
+    chunk.address = NULL;
+    chunk.data = (node.part->kind == CHUNK_SNAP_LEAF) ? node.part->data : NULL;
+    return chunk;
+}
+
+uint64_t chunk_snap_nr_children(chunk_snap_node_t node) {
+    if (node.address != NULL) {
+        chunk_t chunk = chunk_decode(node.address);
+        return (chunk.type == CHUNK_TYPE_SET) ? chunk_set_nr_items(chunk) : 0;
+    }
+    return (node.part->kind == CHUNK_SNAP_SET) ? node.part->nr_items : 0;
+}
+
+uint8_t chunk_snap_child(chunk_snap_node_t node, uint64_t nth, chunk_snap_node_t* child) {
+    if (node.address != NULL) {
+        chunk_t chunk;
+        if (!chunk_set_get_nth(node.address, &chunk, nth)) {
+            return 0;
+        }
+        child->part = node.part;
+        child->address = chunk.address;
+        return 1;
+    }
+    if (node.part->kind != CHUNK_SNAP_SET) {
+        return 0;
+    }
+    for (uint64_t i = 0; i < node.part->nr_parts; i++) {
+        chunk_snap_t* part = node.part->parts[i];
+        // a BYTES part is a run of children, any other part is one child
+        uint64_t nr_items = (part->kind == CHUNK_SNAP_BYTES) ? part->nr_items : 1;
+        if (nth >= nr_items) {
+            nth -= nr_items;
+            continue;
+        }
+        child->part = part;
+        child->address = NULL;
+        if (part->kind == CHUNK_SNAP_BYTES) {
+            uint8_t* address = part->data;
+            while (nth--) {
+                address += chunk_decode(address).total_length;
+            }
+            child->address = address;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+uint8_t chunk_snap_select(chunk_snap_t* snap, uint64_t* path, uint64_t depth, chunk_snap_node_t* node) {
+    *node = chunk_snap_root(snap);
+    for (uint64_t i = 0; i < depth; i++) {
+        if (!chunk_snap_child(*node, path[i], node)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void chunk_snap_iter_init(chunk_snap_iter_t* iter, chunk_snap_t* snap) {
+    iter->start = snap;
+    iter->failed = 0;
+    iter->nr_open = 0;
+    iter->capacity_open = CHUNK_ITER_INLINE;
+    iter->open = iter->open_inline;
+}
+
+static uint8_t chunk_snap_iter_push(chunk_snap_iter_t* iter, chunk_snap_t* snap) {
+    if (iter->nr_open == iter->capacity_open) {
+        uint32_t capacity = iter->capacity_open * 2;
+        chunk_snap_iter_open_t* open = NULL;
+        if (iter->open == iter->open_inline) {
+            open = malloc(sizeof(chunk_snap_iter_open_t) * capacity);
+            if (open != NULL) {
+                memcpy(open, iter->open_inline, sizeof(iter->open_inline));
+            }
+        }
+        else {
+            open = realloc(iter->open, sizeof(chunk_snap_iter_open_t) * capacity);
+        }
+        if (open == NULL) {
+            iter->failed = 1;
+            return 0;
+        }
+        iter->open = open;
+        iter->capacity_open = capacity;
+    }
+    chunk_snap_iter_open_t* top = &iter->open[iter->nr_open++];
+    top->snap = snap;
+    top->idx = 0;
+    return 1;
+}
+
+chunk_snap_t* chunk_snap_iter_next(chunk_snap_iter_t* iter) {
+    chunk_snap_t* next = iter->start;
+    iter->start = NULL;
+    while ((next == NULL) && iter->nr_open) {
+        chunk_snap_iter_open_t* top = &iter->open[iter->nr_open - 1];
+        if (top->idx < top->snap->nr_parts) {
+            next = top->snap->parts[top->idx++];
+        }
+        else {
+            iter->nr_open--;
+        }
+    }
+    // parts never change, so a set's parts can be queued before it is returned
+    if ((next != NULL) && next->nr_parts && !chunk_snap_iter_push(iter, next)) {
+        return NULL;
+    }
+    return next;
+}
+
+void chunk_snap_iter_destroy(chunk_snap_iter_t* iter) {
+    if (iter->open != iter->open_inline) {
+        free(iter->open);
+    }
+}
+
+uint8_t* chunk_snap_encode(chunk_snap_t* snap, uint8_t* buffer) {
+    chunk_snap_iter_t iter;
+    chunk_snap_iter_init(&iter, snap);
+    chunk_snap_t* part = NULL;
+    while ((part = chunk_snap_iter_next(&iter)) != NULL) {
+        if (part->kind == CHUNK_SNAP_BYTES) {
+            memcpy(buffer, part->data, part->size);
+            buffer += part->size;
+            continue;
+        }
+        memcpy(buffer, part->header, part->size - part->data_length);
+        buffer += part->size - part->data_length;
+        if ((part->kind == CHUNK_SNAP_LEAF) && (part->data_length > 0)) {
+            memcpy(buffer, part->data, part->data_length);
+            buffer += part->data_length;
+        }
+    }
+    uint8_t failed = iter.failed;
+    chunk_snap_iter_destroy(&iter);
+    return failed ? NULL : buffer;
+}
@@ -0,0 +1,219 @@
+#ifndef H_CHUNK_SNAP
+#define H_CHUNK_SNAP
+
+#include <stdint.h>
+#include "chunk.h"
+#include "chunk_node.h"
+
+typedef enum chunk_snap_kind {
+    CHUNK_SNAP_BYTES,
+    CHUNK_SNAP_LEAF,
+    CHUNK_SNAP_SET,
+} chunk_snap_kind_t;
+
+typedef struct chunk_snap chunk_snap_t;
+
+typedef struct chunk_snap {
+    uint32_t refs;
+    chunk_snap_kind_t kind;
+    chunk_type_t type;
+    uint64_t size;
+    uint64_t nr_items;
+    uint64_t data_length;
+    uint8_t* data;
+    struct chunk_snap_source* source;
+    uint8_t header[CHUNK_COUNTED_HEADER_MAX];
+    uint64_t nr_parts;
+    chunk_snap_t* parts[];
+} chunk_snap_t;
+
+/**
+ * @brief Take an immutable, reference counted snapshot of a tree
+ *
+ * A snapshot is made of three kinds of part:
+ * - BYTES: one or more whole encoded chunks that are still as they were in
+ *   the buffer the tree was read from, referenced in place. nr_items is the
+ *   number of chunks.
+ * - LEAF: an edited leaf's header and a copy of its payload.
+ * - SET: an edited set's header, followed by its parts in order. Headers
+ *   are written as chunk_node_write_header() gives them.
+ *
+ * Only edited nodes get a part of their own, and each edited node keeps the
+ * last snapshot taken of it until it is edited again. Editing a node drops the
+ * snapshots cached on it and its ancestors, so the next snapshot copies only
+ * the path down to the change and shares everything else with the previous
+ * one. The cost is the number of children of the edited sets on that path,
+ * as runs of untouched children are merged into single BYTES parts.
+ *
+ * The snapshot can be read without encoding it through chunk_snap_root()
+ * and chunk_snap_child(), from any thread, while the tree goes on being
+ * edited. The live tree is not changed, so node pointers held by callers stay
+ * valid.
+ * The buffer the tree was read from must outlive the snapshot, and must not
+ * be written to while it is alive: BYTES parts read it at encode time. This
+ * is why chunk_save_patch() refuses while chunk_snap_nr_borrowed() is not 0
+ * for its tree.
+ *
+ * @param node Root of the tree, or of any subtree
+ * @return A snapshot holding one reference, or NULL if out of memory
+ */
+chunk_snap_t* chunk_snap_take(chunk_node_t* node);
+
+/**
+ * @brief Add a reference to a snapshot
+ *
+ * References may be added and released from any thread.
+ *
+ * @param snap A snapshot
+ * @return snap
+ */
+chunk_snap_t* chunk_snap_retain(chunk_snap_t* snap);
+
+/**
+ * @brief Drop a reference, freeing the snapshot with the last one
+ *
+ * @param snap A snapshot or NULL
+ */
+void chunk_snap_release(chunk_snap_t* snap);
+
+/**
+ * @brief Number of BYTES parts alive that read from a tree's buffer
+ *
+ * Parts are counted per buffer, known by the address of the root a tree was
+ * built from, so trees read from other buffers do not add to the count. The
+ * tree keeps none of its own once its edits are saved, so a count above 0
+ * means a caller still holds a snapshot that would change if the buffer were
+ * written to.
+ *
+ * @param node Any node of the tree
+ * @return Number of live BYTES parts reading from the tree's buffer
+ */
+uint64_t chunk_snap_nr_borrowed(chunk_node_t* node);
+
+/**
+ * @brief Encoded size of a snapshot
+ *
+ * @param snap A snapshot
+ * @return Number of bytes chunk_snap_encode() writes
+ */
+uint64_t chunk_snap_size(chunk_snap_t* snap);
+
+/*
+ * A node in a snapshot: a LEAF or SET part, or one encoded chunk at address
+ * inside a BYTES part. Like the snapshot it never changes, and it stays valid
+ * while the snapshot holding it is alive.
+ */
+typedef struct chunk_snap_node {
+    chunk_snap_t* part;
+    uint8_t* address;
+} chunk_snap_node_t;
+
+/**
+ * @brief The node a snapshot was taken of
+ *
+ * @param snap A snapshot
+ * @return The root node of the snapshot
+ */
+chunk_snap_node_t chunk_snap_root(chunk_snap_t* snap);
+
+/**
+ * @brief Describe a node in a snapshot
+ *
+ * A node inside a BYTES part decodes in place. For a LEAF part data points at
+ * the copied payload; a SET part has no contiguous data, so data and address
+ * are NULL and its children are read with chunk_snap_child().
+ *
+ * @param node A snapshot node
+ * @return A chunk structure describing the node
+ */
+chunk_t chunk_snap_chunk(chunk_snap_node_t node);
+
+/**
+ * @brief Number of children of a set in a snapshot
+ *
+ * @param node A snapshot node
+ * @return Number of children, 0 for a leaf
+ */
+uint64_t chunk_snap_nr_children(chunk_snap_node_t node);
+
+/**
+ * @brief Get the N'th child of a set in a snapshot
+ *
+ * A SET part is searched part by part, and a run of untouched children in
+ * a BYTES part header by header, so the cost is the number of parts before
+ * the child plus its position in its run.
+ *
+ * @param node A snapshot node
+ * @param nth Zero-indexed child number
+ * @param child Receives the child
+ * @return 1 if found, 0 if node is not a set or nth is out of range
+ */
+uint8_t chunk_snap_child(chunk_snap_node_t node, uint64_t nth, chunk_snap_node_t* child);
+
+/**
+ * @brief Follow a path of child indexes down from the root of a snapshot
+ *
+ * @param snap A snapshot
+ * @param path Child indexes from the root
+ * @param depth Number of indexes, 0 for the root itself
+ * @param node Receives the node
+ * @return 1 if found, 0 if the path leaves the snapshot
+ */
+uint8_t chunk_snap_select(chunk_snap_t* snap, uint64_t* path, uint64_t depth, chunk_snap_node_t* node);
+
+typedef struct chunk_snap_iter_open {
+    chunk_snap_t* snap;
+    uint64_t idx;
+} chunk_snap_iter_open_t;
+
+typedef struct chunk_snap_iter {
+    chunk_snap_t* start;
+    uint8_t failed;
+    uint32_t nr_open;
+    uint32_t capacity_open;
+    chunk_snap_iter_open_t* open;
+    chunk_snap_iter_open_t open_inline[CHUNK_ITER_INLINE];
+} chunk_snap_iter_t;
+
+/**
+ * @brief Start a walk over the parts of a snapshot in encoding order
+ *
+ * Each part is returned before the parts of a SET below it, so writing every
+ * BYTES part, every LEAF header and payload and every SET header as they
+ * come gives the encoded snapshot. Levels past CHUNK_ITER_INLINE are kept on
+ * the heap, and the iterator itself must not be copied.
+ *
+ * @param iter The iterator to initialise
+ * @param snap A snapshot
+ */
+void chunk_snap_iter_init(chunk_snap_iter_t* iter, chunk_snap_t* snap);
+
+/**
+ * @brief Next part of a walk
+ *
+ * @param iter An iterator
+ * @return The next part, or NULL at the end or if out of memory
+ *         (iter->failed)
+ */
+chunk_snap_t* chunk_snap_iter_next(chunk_snap_iter_t* iter);
+
+/**
+ * @brief Free what a walk holds
+ *
+ * @param iter An iterator
+ */
+void chunk_snap_iter_destroy(chunk_snap_iter_t* iter);
+
+/**
+ * @brief Encode a snapshot into a buffer
+ *
+ * The result can be read back with chunk_node_build_lazy() or any of the
+ * other readers.
+ *
+ * @param snap A snapshot
+ * @param buffer At least chunk_snap_size() bytes
+ * @return The byte after the last one written, or NULL if out of memory
+ */
+uint8_t* chunk_snap_encode(chunk_snap_t* snap, uint8_t* buffer);
+
+#endif
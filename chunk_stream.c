@@ -0,0 +1,214 @@
+#include <string.h>
+#include <stdlib.h>
+#include "chunk_stream.h"
+#include "chunk.h"
+
+uint8_t chunk_stream_init(chunk_stream_t* stream, chunk_stream_callback_t callback, void* user) {
+    memset(stream, 0, sizeof(chunk_stream_t));
+    stream->callback = callback;
+    stream->user = user;
+    stream->capacity = 16;
+    stream->ends = malloc(sizeof(uint64_t) * stream->capacity);
+    if (stream->ends == NULL) {
+        return 0;
+    }
+    return 1;
+}
+
+static chunk_error_t chunk_stream_fail(chunk_stream_t* stream, chunk_error_t error) {
+    stream->state = CHUNK_STREAM_ERROR;
+    stream->error = error;
+    return error;
+}
+
+static void chunk_stream_emit(chunk_stream_t* stream, chunk_event_type_t type, uint64_t offset, uint8_t* data, uint64_t length) {
+    chunk_event_t event;
+    event.type = type;
+    event.chunk = stream->current;
+    event.depth = stream->depth;
+    event.offset = offset;
+    event.data = data;
+    event.length = length;
+    stream->callback(&event, stream->user);
+}
+
+static void chunk_stream_close_sets(chunk_stream_t* stream) {
+    while (stream->depth && (stream->ends[stream->depth - 1] == stream->position)) {
+        stream->depth--;
+        memset(&stream->current, 0, sizeof(chunk_t));
+        stream->current.type = CHUNK_TYPE_SET;
+        chunk_stream_emit(stream, CHUNK_EVENT_LEAVE_SET, 0, NULL, 0);
+    }
+    if (stream->depth == 0) {
+        stream->nr_roots++;
+    }
+    stream->state = CHUNK_STREAM_HEADER;
+    stream->header_length = 0;
+}
+
+static uint8_t chunk_stream_header_complete(chunk_stream_t* stream) {
+    uint8_t nr_length_bytes = ((stream->header[0] >> 0x04) & 0x0f);
+    if ((nr_length_bytes == CHUNK_LENGTH_VARINT) || (nr_length_bytes == CHUNK_LENGTH_COUNTED)) {
+        uint8_t nr_varints = 0;
+        for (uint8_t i = 1; i < stream->header_length; i++) {
+            if (!(stream->header[i] & 0x80)) {
+                nr_varints++;
+            }
+        }
+        if (nr_length_bytes == CHUNK_LENGTH_COUNTED) {
+            return nr_varints == 2;
+        }
+        return nr_varints == 1;
+    }
+    return stream->header_length == (1 + nr_length_bytes);
+}
+
+static chunk_error_t chunk_stream_header_check(chunk_stream_t* stream) {
+    uint8_t type = (stream->header[0] & 0x0f);
+    uint8_t nr_length_bytes = ((stream->header[0] >> 0x04) & 0x0f);
+    if (type > CHUNK_TYPE_SET) {
+        return CHUNK_ERROR_TYPE;
+    }
+    if ((nr_length_bytes > 8) && (nr_length_bytes != CHUNK_LENGTH_VARINT) && (nr_length_bytes != CHUNK_LENGTH_COUNTED)) {
+        return CHUNK_ERROR_LENGTH_BYTES;
+    }
+    if ((nr_length_bytes == CHUNK_LENGTH_COUNTED) && (type != CHUNK_TYPE_SET)) {
+        return CHUNK_ERROR_LENGTH_BYTES;
+    }
+    return CHUNK_OK;
+}
+
+// Whether the header byte just gathered is the 10th of its varint and needs
+// more than 64 bits.
+static uint8_t chunk_stream_varint_wide(chunk_stream_t* stream) {
+    uint8_t nr_length_bytes = ((stream->header[0] >> 0x04) & 0x0f);
+    if ((nr_length_bytes != CHUNK_LENGTH_VARINT) && (nr_length_bytes != CHUNK_LENGTH_COUNTED)) {
+        return 0;
+    }
+    uint8_t nr_bytes = 0;
+    for (uint8_t i = 1; i < stream->header_length; i++) {
+        nr_bytes++;
+        if ((nr_bytes == CHUNK_VARINT_MAX) && (stream->header[i] > 1)) {
+            return 1;
+        }
+        if (!(stream->header[i] & 0x80)) {
+            nr_bytes = 0;
+        }
+    }
+    return 0;
+}
+
+static chunk_error_t chunk_stream_begin(chunk_stream_t* stream) {
+    chunk_t chunk = chunk_decode_head(stream->header);
+    chunk_calculate_length(stream->header, &chunk);
+    chunk.address = NULL;
+    chunk.data = NULL;
+    if (stream->depth) {
+        uint64_t end = stream->ends[stream->depth - 1];
+        if (chunk.data_length > (end - stream->position)) {
+            return CHUNK_ERROR_OVERFLOW;
+        }
+    }
+    stream->current = chunk;
+    stream->payload_done = 0;
+
+    if (chunk.type == CHUNK_TYPE_SET) {
+        chunk_stream_emit(stream, CHUNK_EVENT_ENTER_SET, 0, NULL, 0);
+        if (stream->depth == stream->capacity) {
+            uint64_t* ends = realloc(stream->ends, sizeof(uint64_t) * stream->capacity * 2);
+            if (ends == NULL) {
+                return CHUNK_ERROR_MEMORY;
+            }
+            stream->ends = ends;
+            stream->capacity *= 2;
+        }
+        stream->ends[stream->depth] = stream->position + chunk.data_length;
+        stream->depth++;
+        if (chunk.data_length == 0) {
+            chunk_stream_close_sets(stream);
+            return CHUNK_OK;
+        }
+        stream->state = CHUNK_STREAM_HEADER;
+        stream->header_length = 0;
+        return CHUNK_OK;
+    }
+
+    if (chunk.data_length == 0) {
+        chunk_stream_emit(stream, CHUNK_EVENT_LEAF, 0, NULL, 0);
+        chunk_stream_close_sets(stream);
+        return CHUNK_OK;
+    }
+    stream->state = CHUNK_STREAM_PAYLOAD;
+    return CHUNK_OK;
+}
+
+chunk_error_t chunk_stream_push(chunk_stream_t* stream, uint8_t* data, uint64_t length) {
+    if (stream->state == CHUNK_STREAM_ERROR) {
+        return stream->error;
+    }
+    while (length) {
+        if (stream->state == CHUNK_STREAM_HEADER) {
+            stream->header[stream->header_length] = *data;
+            stream->header_length++;
+            stream->position++;
+            data++;
+            length--;
+            // a header running past the end of its set is caught here, not
+            // after the set was meant to close
+            if (stream->depth && (stream->position > stream->ends[stream->depth - 1])) {
+                return chunk_stream_fail(stream, CHUNK_ERROR_OVERFLOW);
+            }
+            chunk_error_t error = CHUNK_OK;
+            if (stream->header_length == 1) {
+                error = chunk_stream_header_check(stream);
+                if (error != CHUNK_OK) {
+                    return chunk_stream_fail(stream, error);
+                }
+            }
+            if (chunk_stream_varint_wide(stream)) {
+                return chunk_stream_fail(stream, CHUNK_ERROR_LENGTH_BYTES);
+            }
+            if (!chunk_stream_header_complete(stream)) {
+                uint8_t nr_length_bytes = ((stream->header[0] >> 0x04) & 0x0f);
+                uint8_t header_max = sizeof(stream->header);
+                if (nr_length_bytes == CHUNK_LENGTH_VARINT) {
+                    header_max = 1 + CHUNK_VARINT_MAX;
+                }
+                if (stream->header_length == header_max) {
+                    return chunk_stream_fail(stream, CHUNK_ERROR_LENGTH_BYTES);
+                }
+                continue;
+            }
+            error = chunk_stream_begin(stream);
+            if (error != CHUNK_OK) {
+                return chunk_stream_fail(stream, error);
+            }
+            continue;
+        }
+
+        uint64_t remaining = stream->current.data_length - stream->payload_done;
+        uint64_t take = (length < remaining) ? length : remaining;
+        chunk_stream_emit(stream, CHUNK_EVENT_LEAF, stream->payload_done, data, take);
+        stream->payload_done += take;
+        stream->position += take;
+        data += take;
+        length -= take;
+        if (stream->payload_done == stream->current.data_length) {
+            chunk_stream_close_sets(stream);
+        }
+    }
+    return CHUNK_OK;
+}
+
+uint8_t chunk_stream_done(chunk_stream_t* stream) {
+    return (stream->state == CHUNK_STREAM_HEADER) && (stream->depth == 0) && (stream->header_length == 0) && stream->nr_roots;
+}
+
+void chunk_stream_destroy(chunk_stream_t* stream) {
+    if (stream->ends != NULL) {
+        free(stream->ends);
+    }
+    stream->ends = NULL;
+    stream->depth = 0;
+    stream->capacity = 0;
+}
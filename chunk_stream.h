@@ -0,0 +1,91 @@
+#ifndef H_CHUNK_STREAM
+#define H_CHUNK_STREAM
+
+#include <stdint.h>
+#include "chunk.h"
+
+typedef enum chunk_event_type {
+    CHUNK_EVENT_ENTER_SET = 0x01,
+    CHUNK_EVENT_LEAVE_SET = 0x02,
+    CHUNK_EVENT_LEAF = 0x03
+} chunk_event_type_t;
+
+typedef struct chunk_event {
+    chunk_event_type_t type;
+    chunk_t chunk;
+    uint32_t depth;
+    uint64_t offset;
+    uint8_t* data;
+    uint64_t length;
+} chunk_event_t;
+
+typedef void (*chunk_stream_callback_t)(chunk_event_t* event, void* user);
+
+typedef enum chunk_stream_state {
+    CHUNK_STREAM_HEADER = 0x00,
+    CHUNK_STREAM_PAYLOAD = 0x01,
+    CHUNK_STREAM_ERROR = 0x02
+} chunk_stream_state_t;
+
+typedef struct chunk_stream {
+    chunk_stream_state_t state;
+    chunk_error_t error;
+    uint8_t header[CHUNK_COUNTED_HEADER_MAX];
+    uint8_t header_length;
+    chunk_t current;
+    uint64_t payload_done;
+    uint64_t position;
+    uint64_t nr_roots;
+    uint32_t depth;
+    uint32_t capacity;
+    uint64_t* ends;
+    chunk_stream_callback_t callback;
+    void* user;
+} chunk_stream_t;
+
+/**
+ * @brief Prepare a push-parser
+ *
+ * The parser keeps one end offset per open set and never buffers payload, so
+ * memory use depends on nesting depth only.
+ *
+ * @param stream The parser to initialise
+ * @param callback Called for every event
+ * @param user Passed through to the callback
+ * @return 1 on success, else 0
+ */
+uint8_t chunk_stream_init(chunk_stream_t* stream, chunk_stream_callback_t callback, void* user);
+
+/**
+ * @brief Feed the next fragment of a chunk stream
+ *
+ * Fragments may split headers and payloads anywhere. An enter-set event is
+ * emitted once a set header is complete and a leave-set event when its last
+ * byte has been seen. Leaf payloads are passed through as they arrive: each
+ * leaf event carries the header, the offset of the fragment within the
+ * payload and the fragment itself. The last fragment of a leaf ends at
+ * chunk.data_length. Any number of root chunks may follow each other.
+ *
+ * @param stream An initialised parser
+ * @param data The fragment
+ * @param length Number of bytes in the fragment
+ * @return CHUNK_OK or the error that stopped the parser
+ */
+chunk_error_t chunk_stream_push(chunk_stream_t* stream, uint8_t* data, uint64_t length);
+
+/**
+ * @brief Check the stream ended between root chunks
+ *
+ * @param stream An initialised parser
+ * @return 1 if at least one root chunk is complete and none is partial
+ */
+uint8_t chunk_stream_done(chunk_stream_t* stream);
+
+/**
+ * @brief Free the set stack held by a parser
+ *
+ * @param stream An initialised parser
+ */
+void chunk_stream_destroy(chunk_stream_t* stream);
+
+#endif
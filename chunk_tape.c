@@ -0,0 +1,225 @@
+#include <string.h>
+#include <stdlib.h>
+#include "chunk_tape.h"
+#include "chunk.h"
+
+#define CHUNK_TAPE_GUESS (1 << 20)
+
+typedef struct chunk_tape_open {
+    uint32_t entry;
+    uint32_t last;
+    uint64_t end;
+} chunk_tape_open_t;
+
+static void* chunk_tape_grow(void* array, uint32_t* capacity, size_t size) {
+    uint64_t capacity_new = (uint64_t)*capacity * 2;
+    if (capacity_new > CHUNK_TAPE_NONE) {
+        capacity_new = CHUNK_TAPE_NONE;
+    }
+    if (capacity_new <= *capacity) {
+        return NULL;
+    }
+    void* array_new = realloc(array, size * capacity_new);
+    if (array_new == NULL) {
+        return NULL;
+    }
+    *capacity = capacity_new;
+    return array_new;
+}
+
+// chunk_decode() with the usual fixed length headers read inline.
+static inline chunk_t chunk_tape_decode(uint8_t* start) {
+    uint8_t nr_length_bytes = (start[0] >> 0x04) & 0x0f;
+    if ((nr_length_bytes == 0) || (nr_length_bytes > 8)) {
+        return chunk_decode(start);
+    }
+    chunk_t chunk;
+    chunk.address = start;
+    chunk.type = start[0] & 0x0f;
+    chunk.nr_length_bytes = nr_length_bytes;
+    chunk.data_length = 0;
+    for (uint8_t i = 0; i < nr_length_bytes; i++) {
+        chunk.data_length |= ((uint64_t)start[1 + i] << (0x08 * i));
+    }
+    chunk.data = start + 1 + nr_length_bytes;
+    chunk.total_length = 1 + nr_length_bytes + chunk.data_length;
+    return chunk;
+}
+
+static uint8_t chunk_tape_long_add(chunk_tape_t* tape, uint32_t entry, uint64_t data_length) {
+    if (tape->nr_longs == tape->capacity_longs) {
+        if (tape->capacity_longs == 0) {
+            tape->capacity_longs = 8;
+        }
+        chunk_tape_long_t* longs = chunk_tape_grow(tape->longs, &tape->capacity_longs, sizeof(chunk_tape_long_t));
+        if (longs == NULL) {
+            return 0;
+        }
+        tape->longs = longs;
+    }
+    tape->longs[tape->nr_longs].entry = entry;
+    tape->longs[tape->nr_longs].data_length = data_length;
+    tape->nr_longs++;
+    return 1;
+}
+
+uint8_t chunk_tape_build(chunk_tape_t* tape, uint8_t* start) {
+    memset(tape, 0, sizeof(chunk_tape_t));
+    tape->start = start;
+
+    chunk_t root = chunk_decode(start);
+    // a guess from the length alone would be huge for a few long payloads,
+    // so past CHUNK_TAPE_GUESS entries the tape grows as it goes
+    uint64_t capacity = (root.total_length / 16) + 16;
+    if (capacity > CHUNK_TAPE_GUESS) {
+        capacity = CHUNK_TAPE_GUESS;
+    }
+    tape->capacity = capacity;
+    tape->entries = malloc(sizeof(chunk_tape_entry_t) * tape->capacity);
+
+    uint32_t nr_open = 0;
+    uint32_t capacity_open = 64;
+    chunk_tape_open_t* open = malloc(sizeof(chunk_tape_open_t) * capacity_open);
+    if ((tape->entries == NULL) || (open == NULL)) {
+        free(open);
+        chunk_tape_destroy(tape);
+        return 0;
+    }
+
+    uint64_t pos = 0;
+    while (pos < root.total_length) {
+        // a set is closed once the scan has passed its end
+        while (nr_open && (pos >= open[nr_open - 1].end)) {
+            nr_open--;
+        }
+        if (tape->nr_entries == tape->capacity) {
+            chunk_tape_entry_t* entries = chunk_tape_grow(tape->entries, &tape->capacity, sizeof(chunk_tape_entry_t));
+            if (entries == NULL) {
+                free(open);
+                chunk_tape_destroy(tape);
+                return 0;
+            }
+            tape->entries = entries;
+        }
+
+        chunk_t chunk = chunk_tape_decode(&start[pos]);
+        uint32_t id = tape->nr_entries;
+        chunk_tape_entry_t* entry = &tape->entries[id];
+        entry->offset = pos;
+        entry->data_length = chunk.data_length;
+        entry->parent = CHUNK_TAPE_NONE;
+        entry->next = CHUNK_TAPE_NONE;
+        entry->type = chunk.type;
+        entry->nr_length_bytes = chunk.nr_length_bytes;
+        tape->nr_entries++;
+        if (nr_open) {
+            chunk_tape_open_t* parent = &open[nr_open - 1];
+            entry->parent = parent->entry;
+            if (parent->last != CHUNK_TAPE_NONE) {
+                tape->entries[parent->last].next = id;
+            }
+            parent->last = id;
+        }
+        if (chunk.data_length >= CHUNK_TAPE_LONG) {
+            entry->data_length = CHUNK_TAPE_LONG;
+            if (!chunk_tape_long_add(tape, id, chunk.data_length)) {
+                free(open);
+                chunk_tape_destroy(tape);
+                return 0;
+            }
+        }
+
+        if (chunk.type == CHUNK_TYPE_SET) {
+            if (nr_open == capacity_open) {
+                chunk_tape_open_t* open_new = chunk_tape_grow(open, &capacity_open, sizeof(chunk_tape_open_t));
+                if (open_new == NULL) {
+                    free(open);
+                    chunk_tape_destroy(tape);
+                    return 0;
+                }
+                open = open_new;
+            }
+            open[nr_open].entry = id;
+            open[nr_open].last = CHUNK_TAPE_NONE;
+            open[nr_open].end = pos + chunk.total_length;
+            nr_open++;
+            pos += 1 + chunk.nr_length_bytes;
+            continue;
+        }
+        pos += chunk.total_length;
+    }
+    free(open);
+    return 1;
+}
+
+uint64_t chunk_tape_data_length(chunk_tape_t* tape, uint32_t entry) {
+    uint64_t data_length = tape->entries[entry].data_length;
+    if (data_length != CHUNK_TAPE_LONG) {
+        return data_length;
+    }
+    // longs were added in entry order
+    uint32_t low = 0;
+    uint32_t high = tape->nr_longs;
+    while (low < high) {
+        uint32_t middle = low + ((high - low) / 2);
+        if (tape->longs[middle].entry < entry) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return tape->longs[low].data_length;
+}
+
+chunk_t chunk_tape_chunk(chunk_tape_t* tape, uint32_t entry) {
+    chunk_tape_entry_t* e = &tape->entries[entry];
+    chunk_t chunk;
+    chunk.address = tape->start + e->offset;
+    chunk.type = e->type;
+    chunk.nr_length_bytes = e->nr_length_bytes;
+    chunk.data_length = chunk_tape_data_length(tape, entry);
+    chunk.total_length = 1 + e->nr_length_bytes + chunk.data_length;
+    chunk.data = chunk.address + 1 + e->nr_length_bytes;
+    return chunk;
+}
+
+uint32_t chunk_tape_first_child(chunk_tape_t* tape, uint32_t entry) {
+    // an empty set is followed by its next sibling or an ancestor's
+    if ((tape->entries[entry].type != CHUNK_TYPE_SET) || ((entry + 1) >= tape->nr_entries)) {
+        return CHUNK_TAPE_NONE;
+    }
+    return (tape->entries[entry + 1].parent == entry) ? entry + 1 : CHUNK_TAPE_NONE;
+}
+
+uint32_t chunk_tape_nth_child(chunk_tape_t* tape, uint32_t entry, uint64_t nth) {
+    uint32_t child = chunk_tape_first_child(tape, entry);
+    while ((child != CHUNK_TAPE_NONE) && nth) {
+        child = tape->entries[child].next;
+        nth--;
+    }
+    return child;
+}
+
+uint64_t chunk_tape_nr_children(chunk_tape_t* tape, uint32_t entry) {
+    uint64_t count = 0;
+    uint32_t child = chunk_tape_first_child(tape, entry);
+    while (child != CHUNK_TAPE_NONE) {
+        child = tape->entries[child].next;
+        count++;
+    }
+    return count;
+}
+
+void chunk_tape_destroy(chunk_tape_t* tape) {
+    if (tape->entries != NULL) {
+        free(tape->entries);
+    }
+    free(tape->longs);
+    tape->entries = NULL;
+    tape->nr_entries = 0;
+    tape->capacity = 0;
+    tape->longs = NULL;
+    tape->nr_longs = 0;
+    tape->capacity_longs = 0;
+}
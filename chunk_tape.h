@@ -0,0 +1,110 @@
+#ifndef H_CHUNK_TAPE
+#define H_CHUNK_TAPE
+
+#include <stdint.h>
+#include "chunk.h"
+
+#define CHUNK_TAPE_NONE 0xffffffff
+
+/**
+ * data_length of an entry whose length does not fit in 32 bits. The length is
+ * kept in the tape's longs instead; see chunk_tape_data_length().
+ */
+#define CHUNK_TAPE_LONG 0xffffffff
+
+typedef struct chunk_tape_entry {
+    uint64_t offset;
+    uint32_t data_length;
+    uint32_t parent;
+    uint32_t next;
+    uint8_t type;
+    uint8_t nr_length_bytes;
+} chunk_tape_entry_t;
+
+typedef struct chunk_tape_long {
+    uint32_t entry;
+    uint64_t data_length;
+} chunk_tape_long_t;
+
+typedef struct chunk_tape {
+    uint8_t* start;
+    uint32_t nr_entries;
+    uint32_t capacity;
+    chunk_tape_entry_t* entries;
+    uint32_t nr_longs;
+    uint32_t capacity_longs;
+    chunk_tape_long_t* longs;
+} chunk_tape_t;
+
+/**
+ * @brief Scan a whole buffer into a flat tape of chunk records
+ *
+ * Walks the encoded chunks once in document order and records where every
+ * chunk is, what type it is, its parent and its next sibling. Entries are in
+ * pre-order, so the first child of a non-empty set is always the entry after
+ * it. Navigation afterwards is array lookups with no header parsing. Entries
+ * take 24 bytes; lengths of 4GB or more go in a side table sorted by entry.
+ *
+ * @param tape The tape to fill
+ * @param start A pointer to uint8_t bytes making up an encoded chunk
+ * @return 1 on success, 0 if memory ran out or there are too many chunks
+ */
+uint8_t chunk_tape_build(chunk_tape_t* tape, uint8_t* start);
+
+/**
+ * @brief Rebuild the chunk for a tape entry without decoding the header
+ *
+ * @param tape A built tape
+ * @param entry Index of the entry
+ * @return A chunk structure describing the data
+ */
+chunk_t chunk_tape_chunk(chunk_tape_t* tape, uint32_t entry);
+
+/**
+ * @brief Get the data length of an entry
+ *
+ * @param tape A built tape
+ * @param entry Index of the entry
+ * @return The data length, looked up in the side table if it is long
+ */
+uint64_t chunk_tape_data_length(chunk_tape_t* tape, uint32_t entry);
+
+/**
+ * @brief Get the first child of a set entry
+ *
+ * @param tape A built tape
+ * @param entry Index of the entry
+ * @return Index of the first child or CHUNK_TAPE_NONE
+ */
+uint32_t chunk_tape_first_child(chunk_tape_t* tape, uint32_t entry);
+
+/**
+ * @brief Get the N'th child of a set entry
+ *
+ * Follows next links, so the cost is nth steps whatever lies below the
+ * earlier children.
+ *
+ * @param tape A built tape
+ * @param entry Index of the entry
+ * @param nth Zero-indexed child number
+ * @return Index of the child or CHUNK_TAPE_NONE
+ */
+uint32_t chunk_tape_nth_child(chunk_tape_t* tape, uint32_t entry, uint64_t nth);
+
+/**
+ * @brief Get number of children of a set entry
+ *
+ * @param tape A built tape
+ * @param entry Index of the entry
+ * @return Number of items in set
+ */
+uint64_t chunk_tape_nr_children(chunk_tape_t* tape, uint32_t entry);
+
+/**
+ * @brief Free the entries and side table held by a tape
+ *
+ * @param tape A built tape
+ */
+void chunk_tape_destroy(chunk_tape_t* tape);
+
+#endif
@@ -5,12 +5,17 @@
 #include <stdint.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <locale.h>
 
 #include "chunk.h"
 #include "chunk_node.h"
+#include "chunk_save.h"
+#include "chunk_journal.h"
+#include "chunk_endian.h"
+#include "chunk_cursor.h"
 #include "utf8.h"
 #include "bitwise.h"
 
@@ -21,6 +26,8 @@
 
 #define CURSOR_FLAG_IN_DATA 1
 
+#define CURSES_MEMORY_BUDGET (64 * 1024 * 1024)
+
 typedef enum curses_mode {
     CURSES_MODE_MOVE = 0x01,
     CURSES_MODE_TYPE = 0x02,
@@ -30,16 +37,20 @@ typedef enum curses_mode {
 
 typedef struct c_context {
     int fd;
+    const char* path;
+    uint8_t* map;
+    uint64_t map_size;
     chunk_node_t* root;
     curses_mode_t mode;
-    uint64_t cursor_path[256];
-    uint8_t cursor_path_idx;
+    chunk_cursor_t cursor;
     uint8_t flags;
     uint64_t item_idx;
     uint8_t tabstop;
     uint8_t cmd_buf[257];
     uint8_t cmd_buf_idx;
     uint8_t cmd_ctx;
+    uint64_t memory_budget;
+    chunk_journal_t journal;
 } c_context_t;
 
 static const char* name_per_type[] = {
@@ -71,7 +82,7 @@ void draw_box(uint8_t xoff, uint8_t yoff, uint8_t w, uint8_t h) {
 void draw_item_uint8(c_context_t* context, chunk_node_t* node, uint8_t xoff, uint8_t yoff) {
     attron(COLOR_PAIR(CHUNK_COLOR_DATA));
     char num[4];
-    uint8_t* data = (uint8_t*)node->data;
+    uint8_t* data = (uint8_t*)chunk_node_data(node);
     if (BIT_TEST(context->flags, CURSOR_FLAG_IN_DATA) && BIT_TEST(node->flags, NODE_FLAG_FOCUS)) {
         for (uint8_t i = 0; i < node->nr_children; i++) {
             uint8_t v = data[i];
@@ -104,7 +115,7 @@ void draw_item_float64(c_context_t* context, chunk_node_t* node, uint8_t xoff, u
     double v = 0;
     attron(COLOR_PAIR(CHUNK_COLOR_DATA));
     char num[2048];
-    double* data = (double*)node->data;
+    double* data = (double*)chunk_node_data(node);
     if (BIT_TEST(context->flags, CURSOR_FLAG_IN_DATA) && BIT_TEST(node->flags, NODE_FLAG_FOCUS)) {
         for (uint8_t i = 0; i < node->nr_children; i++) {
             v = data[i];
@@ -136,7 +147,7 @@ void draw_item_float64(c_context_t* context, chunk_node_t* node, uint8_t xoff, u
 void draw_item_utf8(c_context_t* context, chunk_node_t* node, uint8_t xoff, uint8_t yoff) {
     int cn = 0;
     uint32_t next[2];
-    char* s = (char*)node->data;
+    char* s = (char*)chunk_node_data(node);
     attron(COLOR_PAIR(CHUNK_COLOR_DATA));
     if (BIT_TEST(context->flags, CURSOR_FLAG_IN_DATA) && BIT_TEST(node->flags, NODE_FLAG_FOCUS)) {
         for (uint8_t i = 0; i < node->nr_children; i++) {
@@ -231,22 +242,32 @@ void draw_set(c_context_t* context, chunk_node_t* node, uint8_t xoff, uint8_t yo
 }
 
 uint8_t draw_chunk_node(c_context_t* context, chunk_node_t* node, uint8_t xoff, uint8_t yoff) {
-    if (node->type == CHUNK_TYPE_SET) {
-        draw_set(context, node, xoff, yoff);
-        uint8_t this_height = 1;
-        for (uint64_t i = 0; i < node->nr_children; i++) {
-            chunk_node_t* child = &node->children[i];
-            this_height += draw_chunk_node(context, child, xoff + context->tabstop, yoff + this_height);
+    // one line per node; nothing below the screen is drawn, so it need not
+    // be realised either
+    uint8_t height = 0;
+    chunk_node_iter_t iter;
+    chunk_node_iter_init(&iter, node, CHUNK_ITER_PRE_ORDER);
+    chunk_node_t* walk = NULL;
+    while (((yoff + height) < LINES) && ((walk = chunk_node_iter_next(&iter)) != NULL)) {
+        uint8_t x = xoff + (iter.depth * context->tabstop);
+        if (walk->type == CHUNK_TYPE_SET) {
+            draw_set(context, walk, x, yoff + height);
+            // realises the set, so its children follow, and marks it as used
+            chunk_node_child(walk, 0);
+        }
+        else {
+            draw_item(context, walk, x, yoff + height);
         }
-        return this_height;
+        height++;
     }
-
-    draw_item(context, node, xoff, yoff);
-    return 1;
+    chunk_node_iter_destroy(&iter);
+    return height;
 }
 
 void draw(c_context_t* context, uint8_t xoff, uint8_t yoff) {
-    draw_chunk_node(context, context->root, xoff, yoff);
+    if (context->root != NULL) {
+        draw_chunk_node(context, context->root, xoff, yoff);
+    }
     if (context->mode == CURSES_MODE_CMDINPUT) {
         attron(COLOR_PAIR(CHUNK_COLOR_WARN));
         mvprintw(0, 0, ":%s", context->cmd_buf);
@@ -255,7 +276,7 @@ void draw(c_context_t* context, uint8_t xoff, uint8_t yoff) {
 }
 
 void load_file(c_context_t* context, const char* file) {
-    uint8_t head[9];
+    struct stat st;
     int fd = open(file, O_RDONLY);
 
     if (fd == -1) {
@@ -263,88 +284,68 @@ void load_file(c_context_t* context, const char* file) {
         return;
     }
 
-    size_t count = read(fd, head, 9);
-    if (count < 2) {
+    if ((fstat(fd, &st) == -1) || (st.st_size < 2)) {
+        close(fd);
         printf("Error reading from file\n");
         return;
     }
 
-    if (count < 9) {
+    uint8_t* start = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (start == MAP_FAILED) {
         close(fd);
-        context->root = chunk_node_build(head);
-        draw(context, 1, 0);
+        mvprintw(0, 0, "mmap failed!");
         return;
     }
 
-    chunk_t chunk = chunk_decode(head);
-
-    lseek(fd, 0, SEEK_SET);
-    uint8_t* start = mmap(0, chunk.total_length, PROT_READ, MAP_SHARED, fd, 0);
-    if (start == MAP_FAILED) {
+    uint64_t error_offset = 0;
+    chunk_error_t error = chunk_validate(start, st.st_size, &error_offset);
+    if (error != CHUNK_OK) {
+        munmap(start, st.st_size);
         close(fd);
-        mvprintw(0, 0, "mmap failed!");
+        mvprintw(0, 0, "invalid file at byte %lu: %s", error_offset, chunk_error_name(error));
         return;
     }
 
-    context->root = chunk_node_build(start);
+    context->root = chunk_node_build_lazy(start);
+    if (context->cursor.path != NULL) {
+        // a reload keeps the cursor where it was
+        chunk_cursor_select(&context->cursor, context->root, context->cursor.path, context->cursor.depth);
+    }
+    else if (chunk_cursor_init(&context->cursor, context->root)) {
+        chunk_cursor_down(&context->cursor);
+    }
     context->fd = fd;
+    context->path = file;
+    context->map = start;
+    context->map_size = st.st_size;
     draw(context, 1, 1);
     return;
 }
 
 uint8_t key_up(c_context_t* context) {
-    if (context->cursor_path[context->cursor_path_idx] == 0) {
-        return 0;
-    }
-    chunk_node_t* curr = chunk_node_select(context->root, context->cursor_path, context->cursor_path_idx + 1);
-    if (curr == NULL) {
-        return 0;
-    }
-    context->cursor_path[context->cursor_path_idx]--;
-    chunk_node_t* next = chunk_node_select(context->root, context->cursor_path, context->cursor_path_idx + 1);
-    if (next == NULL) {
-        context->cursor_path[context->cursor_path_idx]++;
+    if (!chunk_cursor_prev(&context->cursor)) {
         return 0;
     }
     context->item_idx = 0;
     BIT_UNSET(context->flags, CURSOR_FLAG_IN_DATA);
-    BIT_UNSET(curr->flags, NODE_FLAG_FOCUS);
-    BIT_SET(next->flags, NODE_FLAG_FOCUS);
-    next->flags |= (1 << 0);
     return 1;
 }
 
 uint8_t key_down(c_context_t* context) {
-    chunk_node_t* curr = chunk_node_select(context->root, context->cursor_path, context->cursor_path_idx + 1);
-    if (curr == NULL) {
-        return 0;
-    }
-    context->cursor_path[context->cursor_path_idx]++;
-    chunk_node_t* next = chunk_node_select(context->root, context->cursor_path, context->cursor_path_idx + 1);
-    if (next == NULL) {
-        context->cursor_path[context->cursor_path_idx]--;
+    if (!chunk_cursor_next(&context->cursor)) {
         return 0;
     }
     context->item_idx = 0;
     BIT_UNSET(context->flags, CURSOR_FLAG_IN_DATA);
-    BIT_UNSET(curr->flags, NODE_FLAG_FOCUS);
-    BIT_SET(next->flags, NODE_FLAG_FOCUS);
     return 1;
 }
 
 uint8_t key_left_set(c_context_t* context, chunk_node_t* curr) {
-    if (context->cursor_path_idx == 0) {
+    // the root itself is never focused
+    if (context->cursor.depth <= 1) {
         return 0;
     }
-    context->cursor_path_idx--;
-    chunk_node_t* next = chunk_node_select(context->root, context->cursor_path, context->cursor_path_idx + 1);
-    if (next == NULL) {
-        context->cursor_path_idx++;
-        return 0;
-    }
-    BIT_UNSET(curr->flags, NODE_FLAG_FOCUS);
-    BIT_SET(next->flags, NODE_FLAG_FOCUS);
-    return 1;
+    return chunk_cursor_up(&context->cursor);
 }
 
 uint8_t key_left_item(c_context_t* context, chunk_node_t* curr) {
@@ -360,7 +361,7 @@ uint8_t key_left_item(c_context_t* context, chunk_node_t* curr) {
 }
 
 uint8_t key_left(c_context_t* context) {
-    chunk_node_t* curr = chunk_node_select(context->root, context->cursor_path, context->cursor_path_idx + 1);
+    chunk_node_t* curr = context->cursor.node;
     if (curr == NULL) {
         return 0;
     }
@@ -371,16 +372,7 @@ uint8_t key_left(c_context_t* context) {
 }
 
 uint8_t key_right_set(c_context_t* context, chunk_node_t* curr) {
-    context->cursor_path_idx++;
-    context->cursor_path[context->cursor_path_idx] = 0;
-    chunk_node_t* next = chunk_node_select(context->root, context->cursor_path, context->cursor_path_idx + 1);
-    if (next == NULL) {
-        context->cursor_path_idx--;
-        return 0;
-    }
-    BIT_UNSET(curr->flags, NODE_FLAG_FOCUS);
-    BIT_SET(next->flags, NODE_FLAG_FOCUS);
-    return 1;
+    return chunk_cursor_down(&context->cursor);
 }
 
 uint8_t key_right_item(c_context_t* context, chunk_node_t* curr) {
@@ -398,7 +390,7 @@ uint8_t key_right_item(c_context_t* context, chunk_node_t* curr) {
 }
 
 uint8_t key_right(c_context_t* context) {
-    chunk_node_t* curr = chunk_node_select(context->root, context->cursor_path, context->cursor_path_idx + 1);
+    chunk_node_t* curr = context->cursor.node;
     if (curr == NULL) {
         return 0;
     }
@@ -409,35 +401,97 @@ uint8_t key_right(c_context_t* context) {
 }
 
 uint8_t item_insert_append(c_context_t* context, uint64_t at, chunk_type_t type) {
-    chunk_node_t* curr = chunk_node_select(context->root, context->cursor_path, context->cursor_path_idx + 1);
-    if (curr == NULL) {
+    // the parent is the cursor path without its last index, or the root
+    // itself while it is empty and focused
+    uint64_t depth = context->cursor.depth;
+    chunk_node_t* new = chunk_journal_set_insert(&context->journal, context->root, context->cursor.path, depth ? depth - 1 : 0, at, type);
+    if (new == NULL) {
         return 0;
     }
+    if (depth == 0) {
+        return chunk_cursor_down(&context->cursor);
+    }
+    return chunk_cursor_seek(&context->cursor, at);
+}
 
-    chunk_node_t* parent = NULL;
-    if (context->cursor_path_idx == 0) {
-        parent = context->root;
+// Put the cursor on what journal entry idx changed: the node for payload and
+// type edits, and the child at the location, or the one before it, for
+// inserts and deletes.
+void focus_entry(c_context_t* context, uint64_t idx) {
+    chunk_journal_entry_t entry;
+    if (!chunk_journal_entry(&context->journal, idx, &entry)) {
+        return;
     }
-    else {
-        parent = chunk_node_select(context->root, &context->cursor_path[context->cursor_path_idx - 1], context->cursor_path_idx);
+    uint64_t* path = malloc((entry.depth + 1) * sizeof(uint64_t));
+    if (path == NULL) {
+        return;
     }
-    if (parent == NULL) {
-        mvprintw(0, 0, "parent element NULL, curr->type: %d", curr->type);
-        return 0;
+    chunk_t words;
+    memset(&words, 0, sizeof(chunk_t));
+    words.type = CHUNK_TYPE_UINT64;
+    words.data = entry.path;
+    words.data_length = entry.depth * sizeof(uint64_t);
+    chunk_copy_to_host((uint8_t*)path, words);
+    uint64_t depth = entry.depth;
+    if ((entry.op == CHUNK_JOURNAL_INSERT) || (entry.op == CHUNK_JOURNAL_DELETE)) {
+        path[depth] = entry.location;
+        if (entry.location > 0) {
+            chunk_cursor_select(&context->cursor, context->root, path, depth);
+            if (entry.location >= context->cursor.node->nr_children) {
+                path[depth]--;
+            }
+        }
+        depth++;
     }
-    if (parent->type != CHUNK_TYPE_SET) {
-        return 0;
+    // an emptied set keeps the focus itself
+    if (!chunk_cursor_select(&context->cursor, context->root, path, depth) && (context->cursor.depth == 0)) {
+        chunk_cursor_down(&context->cursor);
     }
+    free(path);
+}
 
+uint8_t key_undo_redo(c_context_t* context, uint8_t redo) {
+    chunk_node_t* curr = context->cursor.node;
     BIT_UNSET(curr->flags, NODE_FLAG_FOCUS);
-    chunk_node_t* new = chunk_node_set_insert(parent, at);
-    if (new == NULL) {
+    uint64_t idx = context->journal.nr_applied;
+    uint8_t done = redo ? chunk_journal_redo(&context->journal, context->root) : chunk_journal_undo(&context->journal, context->root);
+    if (!done) {
         BIT_SET(curr->flags, NODE_FLAG_FOCUS);
         return 0;
     }
-    new->type = type;
-    context->cursor_path[context->cursor_path_idx] = at;
-    BIT_SET(new->flags, NODE_FLAG_FOCUS);
+    // the node under the cursor may be gone
+    context->item_idx = 0;
+    BIT_UNSET(context->flags, CURSOR_FLAG_IN_DATA);
+    focus_entry(context, redo ? idx : idx - 1);
+    return 1;
+}
+
+uint8_t save_file(c_context_t* context) {
+    if ((context->root == NULL) || (context->path == NULL)) {
+        return 0;
+    }
+    // edits that kept every length can go straight into the file, and the
+    // shared mapping then already shows them
+    int fd = open(context->path, O_WRONLY);
+    if (fd != -1) {
+        uint8_t patched = chunk_save_patch(context->root, fd, context->map, NULL);
+        close(fd);
+        if (patched) {
+            chunk_node_clean(context->root);
+            return 1;
+        }
+    }
+    if (!chunk_save_file(context->root, context->path, NULL)) {
+        mvprintw(0, 0, "save failed     ");
+        return 0;
+    }
+    // the saved file is clean, so load it again rather than keep a tree that
+    // still points into the old mapping
+    chunk_node_destroy(context->root);
+    context->root = NULL;
+    munmap(context->map, context->map_size);
+    close(context->fd);
+    load_file(context, context->path);
     return 1;
 }
 
@@ -465,6 +519,12 @@ uint8_t handle_mode_move(c_context_t* context, int c) {
         case ':':
             context->mode = CURSES_MODE_CMDINPUT;
             break;
+        case 'u':
+            render = key_undo_redo(context, 0);
+            break;
+        case 0x12:
+            render = key_undo_redo(context, 1);
+            break;
         default:
             break;
     }
@@ -496,8 +556,11 @@ uint8_t reset_buffer(c_context_t* context, uint8_t render, curses_mode_t mode) {
 
 uint8_t interpret_command(c_context_t* context) {
     uint8_t append = 0;
-    uint64_t at = context->cursor_path[context->cursor_path_idx];
+    uint64_t at = chunk_cursor_index(&context->cursor);
     char *token = strtok((char*)context->cmd_buf, " ");
+    if ((token != NULL) && (strcmp(token, "w") == 0)) {
+        return reset_buffer(context, save_file(context), CURSES_MODE_MOVE);
+    }
     switch (token[0]) {
         case 'i':
             append = 0;
@@ -603,6 +666,9 @@ void loop(c_context_t* context) {
             refresh();
             render = 0;
         }
+        if (context->root != NULL) {
+            chunk_node_trim(context->root, context->memory_budget);
+        }
     }
 }
 
@@ -611,6 +677,12 @@ void init_context(c_context_t* context) {
     context->fd = -1;
     context->tabstop = 2;
     context->mode = CURSES_MODE_MOVE;
+    context->memory_budget = CURSES_MEMORY_BUDGET;
+    chunk_journal_init(&context->journal);
+    char* budget = getenv("TFAL_MEMORY_BUDGET");
+    if (budget != NULL) {
+        context->memory_budget = strtoull(budget, NULL, 10);
+    }
 }
 
 void initcolors() {
@@ -1,6 +1,8 @@
 #include "../chunk.h"
 #include "test_harness.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 uint8_t TEST_STRUCTURE[] = {
     0x8d, // 8 length bytes, data type 12
@@ -103,6 +105,131 @@ void test_decode_longer(test_harness_t* test) {
     is_equal_uint8(test, chunk.type, CHUNK_TYPE_UINT8, "test_decode_longer(): chunk is type CHUNK_TYPE_UINT8");
 }
 
+void test_encode_compact(test_harness_t* test) {
+    uint8_t data[8];
+
+    uint8_t* end = chunk_write_header_compact(&data[0], CHUNK_TYPE_INT16, 5000);
+    is_equal_uint8(test, data[0], 0xf4, "test_encode_compact(): header correct");
+    is_equal_uint8(test, data[1], 0x88, "test_encode_compact(): first length byte correct");
+    is_equal_uint8(test, data[2], 0x27, "test_encode_compact(): second length byte correct");
+    is_equal_uint64(test, end - data, 3, "test_encode_compact(): header is 3 bytes");
+
+    chunk_t chunk = chunk_decode(data);
+    is_equal_uint64(test, chunk.data_length, 5000, "test_encode_compact(): decoded length");
+    is_equal_uint8(test, chunk.nr_length_bytes, 2, "test_encode_compact(): decoded nr_length_bytes");
+    is_equal_uint64(test, chunk.total_length, 5003, "test_encode_compact(): decoded total_length");
+    is_equal_uint8(test, chunk.type, CHUNK_TYPE_INT16, "test_encode_compact(): decoded type");
+
+    is_equal_uint8(test, chunk_varint_length_bytes(127), 1, "test_encode_compact(): varint bytes [1]");
+    is_equal_uint8(test, chunk_varint_length_bytes(128), 2, "test_encode_compact(): varint bytes [2]");
+    is_equal_uint8(test, chunk_varint_length_bytes(0xffffffffffffffff), 10, "test_encode_compact(): varint bytes [10]");
+
+    uint8_t largest[12];
+    chunk_write_header_compact(largest, CHUNK_TYPE_UINT8, 0xffffffffffffffff);
+    chunk = chunk_decode(largest);
+    is_equal_uint64(test, chunk.data_length, 0xffffffffffffffff, "test_encode_compact(): 10 byte varint decoded");
+    is_equal_uint8(test, chunk.nr_length_bytes, 10, "test_encode_compact(): 10 byte varint length");
+
+    // more than 10 bytes stops at the 10th, which does not fit 64 bits here
+    uint8_t overlong[13] = {0xf1, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01};
+    chunk = chunk_decode(overlong);
+    is_equal_uint8(test, chunk.nr_length_bytes, 10, "test_encode_compact(): overlong varint stops");
+    is_equal_uint64(test, chunk.data_length, 0xffffffffffffffff, "test_encode_compact(): overlong varint saturates");
+}
+
+void test_encode_compact_set(test_harness_t* test) {
+    uint8_t data[32];
+
+    uint8_t* outer = chunk_set_begin(data);
+    outer = chunk_write_header(outer, CHUNK_TYPE_UINT8, 1);
+    *outer++ = 9;
+    uint8_t* inner_start = outer;
+    uint8_t* inner = chunk_set_begin(inner_start);
+    inner = chunk_write_header(inner, CHUNK_TYPE_INT8, 1);
+    *inner++ = 7;
+    outer = chunk_set_end(inner_start, inner);
+    uint8_t* end = chunk_set_end(data, outer);
+
+    uint8_t expected[] = {0xfd, 0x08, 0x11, 0x01, 0x09, 0xfd, 0x03, 0x12, 0x01, 0x07};
+    is_equal_uint64(test, end - data, 10, "test_encode_compact_set(): set is 10 bytes");
+    for (uint8_t i = 0; i < 10; i++) {
+        is_equal_uint8(test, data[i], expected[i], "test_encode_compact_set(): iter");
+    }
+
+    chunk_t chunk = chunk_decode(data);
+    is_equal_uint64(test, chunk_set_nr_items(chunk), 2, "test_encode_compact_set(): nr_items");
+    is_equal_uint64(test, chunk_set_item_byte_offset(chunk, 1), 5, "test_encode_compact_set(): offset of second item");
+
+    uint32_t path[2] = {1, 0};
+    is_equal_uint64(test, chunk_byte_offset(data, path, 2), 7, "test_encode_compact_set(): offset of nested item");
+}
+
+void test_encode_counted(test_harness_t* test) {
+    uint8_t data[16];
+    uint8_t buffer[CHUNK_COUNTED_HEADER_MAX + 6];
+
+    uint8_t* walk = buffer + CHUNK_COUNTED_HEADER_MAX;
+    walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+    *walk++ = 9;
+    walk = chunk_write_header(walk, CHUNK_TYPE_INT8, 1);
+    *walk++ = 7;
+    uint8_t* end = chunk_set_end_counted(buffer, walk, 2);
+
+    uint8_t expected[] = {0xed, 0x06, 0x02, 0x11, 0x01, 0x09, 0x12, 0x01, 0x07};
+    is_equal_uint64(test, end - buffer, 9, "test_encode_counted(): set is 9 bytes");
+    for (uint8_t i = 0; i < 9; i++) {
+        is_equal_uint8(test, buffer[i], expected[i], "test_encode_counted(): iter");
+    }
+
+    chunk_t chunk = chunk_decode(buffer);
+    is_equal_uint8(test, chunk_is_counted(chunk), 1, "test_encode_counted(): counted");
+    is_equal_uint8(test, chunk.nr_length_bytes, 2, "test_encode_counted(): nr_length_bytes covers length and count");
+    is_equal_uint64(test, chunk.data_length, 6, "test_encode_counted(): data_length");
+    is_equal_uint64(test, chunk_set_nr_items(chunk), 2, "test_encode_counted(): nr_items from header");
+    is_equal_uint64(test, chunk_set_item_byte_offset(chunk, 1), 6, "test_encode_counted(): offset of second item");
+    is_equal_uint8(test, chunk_validate(buffer, 9, NULL), CHUNK_OK, "test_encode_counted(): valid");
+
+    memcpy(data, buffer, 9);
+    data[2] = 0x03;
+    uint64_t offset = 1;
+    is_equal_uint8(test, chunk_validate(data, 9, &offset), CHUNK_ERROR_COUNT, "test_encode_counted(): wrong count rejected");
+    is_equal_uint64(test, offset, 0, "test_encode_counted(): error at set");
+    is_equal_uint8(test, chunk_is_counted(chunk_decode(TEST_STRUCTURE)), 0, "test_encode_counted(): plain set not counted");
+
+    uint8_t leaf[] = {0xe1, 0x01, 0x01, 0x05};
+    is_equal_uint8(test, chunk_validate(leaf, 4, NULL), CHUNK_ERROR_LENGTH_BYTES, "test_encode_counted(): counted leaf rejected");
+}
+
+void test_encode_aligned(test_harness_t* test) {
+    uint64_t buffer[64];
+    uint8_t* data = (uint8_t*)buffer;
+    uint64_t nr_items = 0;
+
+    for (uint8_t offset = 0; offset < 8; offset++) {
+        uint8_t* payload = chunk_write_header_aligned(&data[offset], offset, CHUNK_TYPE_FLOAT64, 16);
+        is_equal_uint64(test, (payload - data) % 8, 0, "test_encode_aligned(): float64 payload aligned");
+        chunk_t chunk = chunk_decode(&data[offset]);
+        is_equal_uint64(test, chunk.data_length, 16, "test_encode_aligned(): decoded length");
+        is_equal_uint8(test, chunk_view_float64(chunk, &nr_items) != NULL, 1, "test_encode_aligned(): float64 view");
+        is_equal_uint64(test, nr_items, 2, "test_encode_aligned(): float64 view nr_items");
+    }
+
+    for (uint8_t offset = 0; offset < 8; offset++) {
+        uint8_t* payload = chunk_write_header_aligned(&data[offset], offset, CHUNK_TYPE_UINT32, 400000);
+        is_equal_uint64(test, (payload - data) % 4, 0, "test_encode_aligned(): large uint32 payload aligned");
+        chunk_t chunk = chunk_decode(&data[offset]);
+        is_equal_uint64(test, chunk.data_length, 400000, "test_encode_aligned(): decoded large length");
+    }
+
+    chunk_write_header(&data[1], CHUNK_TYPE_UINT32, 8);
+    chunk_t chunk = chunk_decode(&data[1]);
+    is_equal_uint8(test, chunk_view_uint32(chunk, &nr_items) == NULL, 1, "test_encode_aligned(): no view of misaligned payload");
+    chunk_write_header(&data[2], CHUNK_TYPE_UINT32, 8);
+    chunk = chunk_decode(&data[2]);
+    is_equal_uint8(test, chunk_view_uint32(chunk, &nr_items) != NULL, 1, "test_encode_aligned(): view of aligned payload");
+    is_equal_uint8(test, chunk_view_float32(chunk, &nr_items) == NULL, 1, "test_encode_aligned(): no view of other type");
+}
+
 void test_chunk_nr_length_bytes(test_harness_t* test) {
     is_equal_uint8(test, chunk_nr_length_bytes(0), 1, "test_chunk_nr_length_bytes(): computed length bytes [1]");
     is_equal_uint8(test, chunk_nr_length_bytes(255), 1, "test_chunk_nr_length_bytes(): computed length bytes [1]");
@@ -204,6 +331,29 @@ void test_chunk_get_offset(test_harness_t* test) {
     is_equal_uint64(test, offset, 0, "test_chunk_get_offset(): offset zero (overflow second sub set)");
 }
 
+void test_chunk_byte_offsets(test_harness_t* test) {
+    uint32_t addra[2] = {1, 1};
+    uint32_t addrb[1] = {3};
+    uint32_t addrc[2] = {2, 2};
+    uint32_t addrd[2] = {1, 3};
+    uint32_t addre[1] = {1};
+    uint32_t addrf[2] = {1, 4};
+    uint32_t* paths[7] = {addra, addrb, addrc, addrd, addre, addrf, addra};
+    uint32_t nr_idx[7] = {2, 1, 2, 2, 1, 2, 2};
+    uint64_t offsets[7];
+
+    is_equal_uint8(test, chunk_byte_offsets(TEST_STRUCTURE, paths, nr_idx, 7, offsets), 1, "test_chunk_byte_offsets(): ok");
+    for (uint32_t i = 0; i < 7; i++) {
+        uint64_t single = chunk_byte_offset(TEST_STRUCTURE, paths[i], nr_idx[i]);
+        is_equal_uint64(test, offsets[i], single, "test_chunk_byte_offsets(): offset matches chunk_byte_offset()");
+    }
+    is_equal_uint64(test, offsets[0], 24, "test_chunk_byte_offsets(): offset correct (expected)");
+    is_equal_uint64(test, offsets[3], 30, "test_chunk_byte_offsets(): offset correct (end of sub set)");
+    is_equal_uint64(test, offsets[2], 0, "test_chunk_byte_offsets(): offset zero (first level not a set)");
+    is_equal_uint64(test, offsets[5], 0, "test_chunk_byte_offsets(): offset zero (overflow second sub set)");
+    is_equal_uint64(test, offsets[6], 24, "test_chunk_byte_offsets(): duplicate path resolved");
+}
+
 void test_chunk_set_item_byte_offset(test_harness_t* test) {
     uint8_t data[] = {
         0x8d,
@@ -238,6 +388,117 @@ void test_chunk_set_item_byte_offset(test_harness_t* test) {
     is_equal_uint64(test, offset, 0, "test_chunk_set_item_byte_offset(): offset zero (overflow)");
 }
 
+void test_chunk_validate(test_harness_t* test) {
+    uint64_t offset = 0;
+    uint8_t data[36];
+
+    is_equal_uint8(test, chunk_validate(TEST_STRUCTURE, 36, NULL), CHUNK_OK, "test_chunk_validate(): well formed structure");
+    is_equal_uint8(test, chunk_validate(TEST_STRUCTURE, 35, &offset), CHUNK_ERROR_OVERFLOW, "test_chunk_validate(): root longer than buffer");
+    is_equal_uint64(test, offset, 0, "test_chunk_validate(): error at root");
+    is_equal_uint8(test, chunk_validate(TEST_STRUCTURE, 5, NULL), CHUNK_ERROR_TRUNCATED, "test_chunk_validate(): length bytes past buffer");
+    is_equal_uint8(test, chunk_validate(TEST_STRUCTURE, 0, NULL), CHUNK_ERROR_TRUNCATED, "test_chunk_validate(): empty buffer");
+
+    memcpy(data, TEST_STRUCTURE, 36);
+    data[13] = 0x20;
+    is_equal_uint8(test, chunk_validate(data, 36, &offset), CHUNK_ERROR_OVERFLOW, "test_chunk_validate(): nested set overflows parent");
+    is_equal_uint64(test, offset, 12, "test_chunk_validate(): error at nested set");
+
+    memcpy(data, TEST_STRUCTURE, 36);
+    data[24] = 0x1e;
+    is_equal_uint8(test, chunk_validate(data, 36, &offset), CHUNK_ERROR_TYPE, "test_chunk_validate(): unknown type nibble");
+    is_equal_uint64(test, offset, 24, "test_chunk_validate(): error at bad type");
+
+    memcpy(data, TEST_STRUCTURE, 36);
+    data[24] = 0x91;
+    is_equal_uint8(test, chunk_validate(data, 36, NULL), CHUNK_ERROR_LENGTH_BYTES, "test_chunk_validate(): too many length bytes");
+
+    uint8_t varint[] = {0xfd, 0x80, 0x80};
+    is_equal_uint8(test, chunk_validate(varint, 3, NULL), CHUNK_ERROR_TRUNCATED, "test_chunk_validate(): unterminated varint");
+
+    uint8_t overlong[13] = {0xf1, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01};
+    is_equal_uint8(test, chunk_validate(overlong, 13, NULL), CHUNK_ERROR_LENGTH_BYTES, "test_chunk_validate(): varint past 10 bytes");
+    uint8_t wide[11] = {0xf1, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x02};
+    is_equal_uint8(test, chunk_validate(wide, 11, NULL), CHUNK_ERROR_LENGTH_BYTES, "test_chunk_validate(): 10th varint byte past 64 bits");
+
+    uint8_t compact[] = {0xfd, 0x05, 0x11, 0x01, 0x09, 0xfd, 0x00};
+    is_equal_uint8(test, chunk_validate(compact, 7, NULL), CHUNK_OK, "test_chunk_validate(): compact set with empty set");
+}
+
+void test_chunk_walk(test_harness_t* test) {
+    uint8_t types[16];
+    uint8_t depths[16];
+    uint64_t nr = 0;
+    chunk_t chunk;
+    chunk_iter_t iter;
+
+    chunk_iter_init(&iter, TEST_STRUCTURE, CHUNK_ITER_PRE_ORDER);
+    while (chunk_iter_next(&iter, &chunk) && (nr < 16)) {
+        types[nr] = chunk.type;
+        depths[nr++] = iter.depth;
+    }
+    chunk_iter_destroy(&iter);
+    uint8_t pre_types[8] = {0x0d, 0x05, 0x0d, 0x05, 0x01, 0x02, 0x03, 0x02};
+    uint8_t pre_depths[8] = {0, 1, 1, 2, 2, 2, 1, 1};
+    is_equal_uint64(test, nr, 8, "test_chunk_walk(): pre-order count");
+    is_equal_uint8(test, memcmp(types, pre_types, 8) == 0, 1, "test_chunk_walk(): pre-order types");
+    is_equal_uint8(test, memcmp(depths, pre_depths, 8) == 0, 1, "test_chunk_walk(): pre-order depths");
+
+    nr = 0;
+    chunk_iter_init(&iter, TEST_STRUCTURE, CHUNK_ITER_POST_ORDER);
+    while (chunk_iter_next(&iter, &chunk) && (nr < 16)) {
+        types[nr] = chunk.type;
+        depths[nr++] = iter.depth;
+    }
+    chunk_iter_destroy(&iter);
+    uint8_t post_types[8] = {0x05, 0x05, 0x01, 0x02, 0x0d, 0x03, 0x02, 0x0d};
+    uint8_t post_depths[8] = {1, 2, 2, 2, 1, 1, 1, 0};
+    is_equal_uint64(test, nr, 8, "test_chunk_walk(): post-order count");
+    is_equal_uint8(test, memcmp(types, post_types, 8) == 0, 1, "test_chunk_walk(): post-order types");
+    is_equal_uint8(test, memcmp(depths, post_depths, 8) == 0, 1, "test_chunk_walk(): post-order depths");
+    is_equal_uint64(test, chunk.address - TEST_STRUCTURE, 0, "test_chunk_walk(): post-order ends at root");
+
+    nr = 0;
+    chunk_iter_init(&iter, TEST_STRUCTURE, CHUNK_ITER_PRE_ORDER);
+    while (chunk_iter_next(&iter, &chunk) && (nr < 16)) {
+        types[nr++] = chunk.type;
+        if (iter.depth == 1) {
+            chunk_iter_skip(&iter);
+        }
+    }
+    chunk_iter_destroy(&iter);
+    uint8_t skip_types[5] = {0x0d, 0x05, 0x0d, 0x03, 0x02};
+    is_equal_uint64(test, nr, 5, "test_chunk_walk(): skipped count");
+    is_equal_uint8(test, memcmp(types, skip_types, 5) == 0, 1, "test_chunk_walk(): skipped types");
+}
+
+void test_chunk_walk_deep(test_harness_t* test) {
+    // sets nested far deeper than the initial stack
+    uint64_t depth = 10000;
+    uint8_t* data = malloc((depth * 9) + 3);
+    uint8_t* walk = data;
+    for (uint64_t i = 0; i < depth; i++) {
+        walk = chunk_write_header(walk, CHUNK_TYPE_SET, ((depth - i - 1) * 9) + 3);
+    }
+    walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+    *walk = 0x2a;
+
+    chunk_t chunk;
+    chunk_iter_t iter;
+    chunk_iter_init(&iter, data, CHUNK_ITER_POST_ORDER);
+    chunk_iter_next(&iter, &chunk);
+    is_equal_uint8(test, chunk.type, CHUNK_TYPE_UINT8, "test_chunk_walk_deep(): leaf first");
+    is_equal_uint64(test, iter.depth, depth, "test_chunk_walk_deep(): leaf depth");
+    is_equal_uint8(test, chunk.data[0], 0x2a, "test_chunk_walk_deep(): leaf data");
+    uint64_t nr = 1;
+    while (chunk_iter_next(&iter, &chunk)) {
+        nr++;
+    }
+    is_equal_uint64(test, nr, depth + 1, "test_chunk_walk_deep(): count");
+    is_equal_uint8(test, iter.failed, 0, "test_chunk_walk_deep(): not failed");
+    chunk_iter_destroy(&iter);
+    free(data);
+}
+
 int main(int argc, char** argv) {
     test_harness_t test;
     test_harness_init(&test);
@@ -252,11 +513,21 @@ int main(int argc, char** argv) {
     test_encode_simple(&test);
     test_encode_long(&test);
     test_encode_longer(&test);
+    test_encode_compact(&test);
+    test_encode_compact_set(&test);
+    test_encode_counted(&test);
+    test_encode_aligned(&test);
 
     test_chunk_set_item_byte_offset(&test);
 
     test_chunk_get_offset_simple(&test);
     test_chunk_get_offset(&test);
+    test_chunk_byte_offsets(&test);
+
+    test_chunk_validate(&test);
+
+    test_chunk_walk(&test);
+    test_chunk_walk_deep(&test);
 
     test_harness_report(&test);
     return 0;
@@ -0,0 +1,73 @@
+#include "../chunk_arena.h"
+#include "test_harness.h"
+#include <stdio.h>
+#include <string.h>
+
+void test_chunk_arena_alloc(test_harness_t* test) {
+    chunk_arena_t* arena = chunk_arena_create(256);
+
+    uint8_t* a = chunk_arena_alloc(arena, 3);
+    uint8_t* b = chunk_arena_alloc(arena, 5);
+    is_equal_uint64(test, (uintptr_t)a % 16, 0, "test_chunk_arena_alloc(): first aligned");
+    is_equal_uint64(test, (uintptr_t)b % 16, 0, "test_chunk_arena_alloc(): second aligned");
+    is_equal_uint64(test, b - a, 16, "test_chunk_arena_alloc(): bumped");
+    is_equal_uint64(test, arena->nr_blocks, 1, "test_chunk_arena_alloc(): one block");
+
+    memset(a, 0xaa, 3);
+    memset(b, 0xbb, 5);
+    is_equal_uint8(test, a[2], 0xaa, "test_chunk_arena_alloc(): no overlap");
+
+    // larger than a quarter block gets its own block, the bump block stays
+    uint8_t* big = chunk_arena_alloc(arena, 200);
+    uint8_t* c = chunk_arena_alloc(arena, 1);
+    is_equal_uint64(test, arena->nr_blocks, 2, "test_chunk_arena_alloc(): dedicated block");
+    is_equal_uint64(test, c - b, 16, "test_chunk_arena_alloc(): bump block kept");
+    memset(big, 0xcc, 200);
+
+    // filling the bump block starts a new one
+    for (uint64_t i = 0; i < 16; i++) {
+        chunk_arena_alloc(arena, 16);
+    }
+    is_equal_uint64(test, arena->nr_blocks, 3, "test_chunk_arena_alloc(): new block");
+    is_equal_uint64(test, arena->nr_allocs, 20, "test_chunk_arena_alloc(): nr_allocs");
+
+    chunk_arena_destroy(arena);
+}
+
+void test_chunk_arena_merge(test_harness_t* test) {
+    chunk_arena_t* arena = chunk_arena_create(256);
+    chunk_arena_t* other = chunk_arena_create(256);
+
+    uint8_t* a = chunk_arena_alloc(arena, 16);
+    uint8_t* b = chunk_arena_alloc(other, 16);
+    chunk_arena_alloc(other, 200);
+    memset(b, 0xbb, 16);
+
+    chunk_arena_merge(arena, other);
+    is_equal_uint64(test, arena->nr_blocks, 3, "test_chunk_arena_merge(): blocks moved");
+    is_equal_uint64(test, arena->nr_allocs, 3, "test_chunk_arena_merge(): allocs counted");
+    is_equal_uint8(test, b[15], 0xbb, "test_chunk_arena_merge(): memory kept");
+
+    // allocation carries on in the block it was using
+    uint8_t* c = chunk_arena_alloc(arena, 16);
+    is_equal_uint64(test, c - a, 16, "test_chunk_arena_merge(): bump block kept");
+
+    chunk_arena_t* empty = chunk_arena_create(256);
+    chunk_arena_merge(empty, chunk_arena_create(256));
+    is_equal_uint8(test, empty->head == NULL, 1, "test_chunk_arena_merge(): empty into empty");
+    chunk_arena_destroy(empty);
+
+    chunk_arena_destroy(arena);
+}
+
+int main(int argc, char** argv) {
+    test_harness_t test;
+    test_harness_init(&test);
+    test.verbose = 1;
+
+    test_chunk_arena_alloc(&test);
+    test_chunk_arena_merge(&test);
+
+    test_harness_report(&test);
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "../chunk_btree.h"
+#include "test_harness.h"
+#include <stdio.h>
+#include <string.h>
+
+#define NR_ITEMS 5000
+
+uint64_t VALUES[NR_ITEMS];
+
+// positions drift through the tree so splits happen at every level
+static uint64_t next_position(uint64_t i, uint64_t nr_items) {
+    return ((i * 7919) + 13) % (nr_items + 1);
+}
+
+void test_chunk_btree_insert(test_harness_t* test) {
+    chunk_btree_t tree;
+    chunk_btree_init(&tree);
+    uint64_t* reference[NR_ITEMS];
+    uint64_t nr_reference = 0;
+
+    for (uint64_t i = 0; i < NR_ITEMS; i++) {
+        VALUES[i] = i;
+        uint64_t at = next_position(i, nr_reference);
+        chunk_btree_insert(&tree, at, &VALUES[i]);
+        memmove(&reference[at + 1], &reference[at], (nr_reference - at) * sizeof(uint64_t*));
+        reference[at] = &VALUES[i];
+        nr_reference++;
+    }
+    is_equal_uint64(test, tree.nr_items, NR_ITEMS, "test_chunk_btree_insert(): nr_items");
+    is_equal_uint8(test, tree.root->leaf, 0, "test_chunk_btree_insert(): root split");
+
+    uint64_t mismatch = 0;
+    for (uint64_t i = 0; i < NR_ITEMS; i++) {
+        mismatch += (chunk_btree_get(&tree, i) != reference[i]);
+    }
+    is_equal_uint64(test, mismatch, 0, "test_chunk_btree_insert(): get matches");
+
+    chunk_btree_iter_t iter;
+    chunk_btree_iter_init(&iter, &tree);
+    mismatch = 0;
+    uint64_t count = 0;
+    uint64_t* item = NULL;
+    while ((item = chunk_btree_iter_next(&iter)) != NULL) {
+        mismatch += (item != reference[count]);
+        count++;
+    }
+    is_equal_uint64(test, count, NR_ITEMS, "test_chunk_btree_insert(): iter count");
+    is_equal_uint64(test, mismatch, 0, "test_chunk_btree_insert(): iter matches");
+    is_equal_uint64(test, (uintptr_t)chunk_btree_get(&tree, NR_ITEMS), 0, "test_chunk_btree_insert(): out of range");
+    is_equal_uint8(test, chunk_btree_insert(&tree, NR_ITEMS + 1, &VALUES[0]), 0, "test_chunk_btree_insert(): insert out of range");
+
+    for (uint64_t i = 0; i < NR_ITEMS; i++) {
+        uint64_t at = next_position(i, nr_reference - 1);
+        uint64_t* removed = chunk_btree_remove(&tree, at);
+        mismatch += (removed != reference[at]);
+        memmove(&reference[at], &reference[at + 1], (nr_reference - at - 1) * sizeof(uint64_t*));
+        nr_reference--;
+        if (nr_reference == NR_ITEMS / 2) {
+            uint64_t inner = 0;
+            for (uint64_t j = 0; j < nr_reference; j++) {
+                inner += (chunk_btree_get(&tree, j) != reference[j]);
+            }
+            is_equal_uint64(test, inner, 0, "test_chunk_btree_insert(): get after remove");
+        }
+    }
+    is_equal_uint64(test, mismatch, 0, "test_chunk_btree_insert(): remove matches");
+    is_equal_uint64(test, tree.nr_items, 0, "test_chunk_btree_insert(): empty");
+    is_equal_uint64(test, (uintptr_t)tree.root, 0, "test_chunk_btree_insert(): pages freed");
+
+    chunk_btree_destroy(&tree);
+}
+
+void test_chunk_btree_build(test_harness_t* test) {
+    chunk_btree_t tree;
+    chunk_btree_build(&tree, (uint8_t*)VALUES, sizeof(uint64_t), NR_ITEMS, NULL);
+    is_equal_uint64(test, tree.nr_items, NR_ITEMS, "test_chunk_btree_build(): nr_items");
+    is_equal_uint64(test, *(uint64_t*)chunk_btree_get(&tree, 4321), VALUES[4321], "test_chunk_btree_build(): get");
+
+    chunk_btree_insert(&tree, 100, &VALUES[0]);
+    is_equal_uint64(test, (uintptr_t)chunk_btree_get(&tree, 100), (uintptr_t)&VALUES[0], "test_chunk_btree_build(): inserted");
+    is_equal_uint64(test, (uintptr_t)chunk_btree_get(&tree, 101), (uintptr_t)&VALUES[100], "test_chunk_btree_build(): shifted");
+    chunk_btree_destroy(&tree);
+
+    // a small tree is one page sized to fit, in the arena if asked
+    chunk_arena_t* arena = chunk_arena_create(0);
+    chunk_btree_build(&tree, (uint8_t*)VALUES, sizeof(uint64_t), 3, arena);
+    is_equal_uint8(test, tree.root->leaf, 1, "test_chunk_btree_build(): small is a leaf");
+    is_equal_uint64(test, tree.root->capacity, 3, "test_chunk_btree_build(): small capacity");
+    is_equal_uint64(test, chunk_btree_memory(&tree), 0, "test_chunk_btree_build(): arena memory");
+    chunk_btree_insert(&tree, 3, &VALUES[3]);
+    is_equal_uint64(test, tree.root->capacity, 6, "test_chunk_btree_build(): grown");
+    is_equal_uint64(test, *(uint64_t*)chunk_btree_get(&tree, 3), 3, "test_chunk_btree_build(): appended");
+    chunk_btree_destroy(&tree);
+    chunk_arena_destroy(arena);
+}
+
+int main(int argc, char** argv) {
+    test_harness_t test;
+    test_harness_init(&test);
+    test.verbose = 1;
+
+    test_chunk_btree_insert(&test);
+    test_chunk_btree_build(&test);
+
+    test_harness_report(&test);
+    return 0;
+}
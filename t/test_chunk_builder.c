@@ -0,0 +1,221 @@
+#include "../chunk_builder.h"
+#include "test_harness.h"
+#include <stdio.h>
+#include <string.h>
+
+uint8_t TEST_STRUCTURE[] = {
+    0x8d, // 8 length bytes, data type 12
+    0x1b, // 27 bytes long
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x15, //   1 length byte, data type 5
+    0x01, //   1 bytes long
+    0x09, //   data (9)
+    0x8d, //   1 length byte, data type 12
+    0x09, //   9 bytes long
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x15, //     1 length byte, data type 5
+    0x01, //     1 bytes long
+    0x09, //     data (9)
+    0x11, //     1 length byte, data type 1
+    0x01, //     1 bytes long
+    0x08, //     data (8)
+    0x12, //     1 length byte, data type 2
+    0x01, //     1 bytes long
+    0x07, //     data (7)
+    0x13, //   1 length byte, data type 3
+    0x01, //   1 bytes long
+    0x08, //   data (8)
+    0x12, //   1 length byte, data type 2
+    0x01, //   1 bytes long
+    0x07  //   data (7)
+};
+
+void build_replica(chunk_builder_t* builder) {
+    uint8_t v[] = {9, 8, 7};
+    chunk_builder_begin_set(builder);
+    chunk_builder_append(builder, CHUNK_TYPE_UINT32, &v[0], 1);
+    chunk_builder_begin_set(builder);
+    chunk_builder_append(builder, CHUNK_TYPE_UINT32, &v[0], 1);
+    chunk_builder_append(builder, CHUNK_TYPE_UINT8, &v[1], 1);
+    chunk_builder_append(builder, CHUNK_TYPE_INT8, &v[2], 1);
+    chunk_builder_end_set(builder);
+    chunk_builder_append(builder, CHUNK_TYPE_UINT16, &v[1], 1);
+    chunk_builder_append(builder, CHUNK_TYPE_INT8, &v[2], 1);
+    chunk_builder_end_set(builder);
+}
+
+void test_chunk_builder_growable(test_harness_t* test) {
+    chunk_builder_t builder;
+    uint64_t size = 0;
+
+    chunk_builder_init(&builder, NULL, 0, 0);
+    build_replica(&builder);
+    uint8_t* data = chunk_builder_finish(&builder, &size);
+
+    is_equal_uint64(test, size, 36, "test_chunk_builder_growable(): size");
+    for (uint8_t i = 0; i < 36; i++) {
+        is_equal_uint8(test, data[i], TEST_STRUCTURE[i], "test_chunk_builder_growable(): iter");
+    }
+    chunk_builder_destroy(&builder);
+}
+
+void test_chunk_builder_compact(test_harness_t* test) {
+    chunk_builder_t builder;
+    uint64_t size = 0;
+    uint8_t buffer[64];
+
+    chunk_builder_init(&builder, buffer, 64, CHUNK_BUILDER_COMPACT);
+    build_replica(&builder);
+    uint8_t* data = chunk_builder_finish(&builder, &size);
+
+    is_equal_uint64(test, size, 22, "test_chunk_builder_compact(): size");
+    is_equal_uint8(test, chunk_validate(data, size, NULL), CHUNK_OK, "test_chunk_builder_compact(): valid");
+    uint32_t path[2] = {1, 2};
+    uint64_t offset = chunk_byte_offset(data, path, 2);
+    is_equal_uint8(test, data[offset], 0x12, "test_chunk_builder_compact(): nested header");
+    is_equal_uint8(test, data[offset + 2], 7, "test_chunk_builder_compact(): nested data");
+    chunk_builder_destroy(&builder);
+}
+
+void test_chunk_builder_counted(test_harness_t* test) {
+    chunk_builder_t builder;
+    uint64_t size = 0;
+
+    chunk_builder_init(&builder, NULL, 0, CHUNK_BUILDER_COUNTED);
+    build_replica(&builder);
+    uint8_t* data = chunk_builder_finish(&builder, &size);
+
+    is_equal_uint8(test, chunk_validate(data, size, NULL), CHUNK_OK, "test_chunk_builder_counted(): valid");
+    chunk_t chunk = chunk_decode(data);
+    is_equal_uint8(test, chunk_is_counted(chunk), 1, "test_chunk_builder_counted(): root counted");
+    is_equal_uint64(test, chunk_set_nr_items(chunk), 4, "test_chunk_builder_counted(): root nr_items");
+    chunk_set_get_nth(data, &chunk, 1);
+    is_equal_uint64(test, chunk_set_nr_items(chunk), 3, "test_chunk_builder_counted(): nested nr_items");
+    chunk_builder_destroy(&builder);
+}
+
+// {{1}, {{}, 2}, 3}, then a second document of sets nested depth deep
+static void build_nested(chunk_builder_t* builder, uint32_t depth) {
+    uint8_t v[] = {1, 2, 3};
+    chunk_builder_begin_set(builder);
+    chunk_builder_begin_set(builder);
+    chunk_builder_append(builder, CHUNK_TYPE_UINT8, &v[0], 1);
+    chunk_builder_end_set(builder);
+    chunk_builder_begin_set(builder);
+    chunk_builder_begin_set(builder);
+    chunk_builder_end_set(builder);
+    chunk_builder_append(builder, CHUNK_TYPE_UINT8, &v[1], 1);
+    chunk_builder_end_set(builder);
+    chunk_builder_append(builder, CHUNK_TYPE_UINT8, &v[2], 1);
+    chunk_builder_end_set(builder);
+    for (uint32_t i = 0; i < depth; i++) {
+        chunk_builder_begin_set(builder);
+    }
+    for (uint32_t i = 0; i < depth; i++) {
+        chunk_builder_end_set(builder);
+    }
+}
+
+void test_chunk_builder_nested(test_harness_t* test) {
+    chunk_builder_t builder;
+    uint64_t size = 0;
+    uint8_t compact[] = {
+        0xfd, 0x0f,
+        0xfd, 0x03, 0x11, 0x01, 0x01,
+        0xfd, 0x05, 0xfd, 0x00, 0x11, 0x01, 0x02,
+        0x11, 0x01, 0x03
+    };
+    uint8_t counted[] = {
+        0xed, 0x12, 0x03,
+        0xed, 0x03, 0x01, 0x11, 0x01, 0x01,
+        0xed, 0x06, 0x02, 0xed, 0x00, 0x00, 0x11, 0x01, 0x02,
+        0x11, 0x01, 0x03
+    };
+
+    chunk_builder_init(&builder, NULL, 0, CHUNK_BUILDER_COMPACT);
+    build_nested(&builder, 200);
+    uint8_t* data = chunk_builder_finish(&builder, &size);
+    is_equal_uint8(test, memcmp(data, compact, sizeof(compact)) == 0, 1, "test_chunk_builder_nested(): compact bytes");
+    // an empty set inside 63 sets with 2 byte headers, then 136 with 3
+    is_equal_uint64(test, size, sizeof(compact) + 2 + (63 * 2) + (136 * 3), "test_chunk_builder_nested(): compact size");
+    is_equal_uint8(test, chunk_validate(&data[sizeof(compact)], size - sizeof(compact), NULL), CHUNK_OK, "test_chunk_builder_nested(): compact deep valid");
+    chunk_builder_destroy(&builder);
+
+    chunk_builder_init(&builder, NULL, 0, CHUNK_BUILDER_COUNTED);
+    build_nested(&builder, 0);
+    data = chunk_builder_finish(&builder, &size);
+    is_equal_uint64(test, size, sizeof(counted), "test_chunk_builder_nested(): counted size");
+    is_equal_uint8(test, memcmp(data, counted, sizeof(counted)) == 0, 1, "test_chunk_builder_nested(): counted bytes");
+    chunk_builder_destroy(&builder);
+}
+
+void test_chunk_builder_aligned(test_harness_t* test) {
+    chunk_builder_t builder;
+    uint64_t size = 0;
+    uint64_t nr_items = 0;
+    double values[3] = {1.5, 2.5, 3.5};
+    uint8_t byte = 1;
+
+    chunk_builder_init(&builder, NULL, 0, CHUNK_BUILDER_ALIGNED | CHUNK_BUILDER_COMPACT);
+    chunk_builder_begin_set(&builder);
+    chunk_builder_append(&builder, CHUNK_TYPE_UINT8, &byte, 1);
+    chunk_builder_append(&builder, CHUNK_TYPE_FLOAT64, (uint8_t*)values, sizeof(values));
+    chunk_builder_append(&builder, CHUNK_TYPE_UINT8, &byte, 1);
+    chunk_builder_append(&builder, CHUNK_TYPE_UINT32, NULL, 12);
+    chunk_builder_end_set(&builder);
+    uint8_t* data = chunk_builder_finish(&builder, &size);
+
+    is_equal_uint8(test, chunk_validate(data, size, NULL), CHUNK_OK, "test_chunk_builder_aligned(): valid");
+    chunk_t chunk;
+    chunk_set_get_nth(data, &chunk, 1);
+    double* view = chunk_view_float64(chunk, &nr_items);
+    is_equal_uint8(test, view != NULL, 1, "test_chunk_builder_aligned(): float64 view");
+    is_equal_uint64(test, nr_items, 3, "test_chunk_builder_aligned(): float64 nr_items");
+    is_equal_float(test, view[2], 3.5, "test_chunk_builder_aligned(): float64 value");
+    chunk_set_get_nth(data, &chunk, 3);
+    is_equal_uint8(test, chunk_view_uint32(chunk, &nr_items) != NULL, 1, "test_chunk_builder_aligned(): uint32 view");
+    is_equal_uint64(test, nr_items, 3, "test_chunk_builder_aligned(): uint32 nr_items");
+    chunk_builder_destroy(&builder);
+}
+
+void test_chunk_builder_errors(test_harness_t* test) {
+    chunk_builder_t builder;
+    uint64_t size = 0;
+    uint8_t buffer[16];
+
+    chunk_builder_init(&builder, buffer, 16, 0);
+    is_equal_uint8(test, chunk_builder_end_set(&builder), 0, "test_chunk_builder_errors(): end without begin");
+    is_equal_uint8(test, chunk_builder_begin_set(&builder), 1, "test_chunk_builder_errors(): begin fits");
+    is_equal_uint8(test, chunk_builder_finish(&builder, &size) == NULL, 1, "test_chunk_builder_errors(): finish with open set");
+    is_equal_uint8(test, chunk_builder_append(&builder, CHUNK_TYPE_UINT8, NULL, 5), 1, "test_chunk_builder_errors(): leaf fits");
+    is_equal_uint8(test, chunk_builder_append(&builder, CHUNK_TYPE_UINT8, NULL, 1), 0, "test_chunk_builder_errors(): leaf overflows buffer");
+    chunk_builder_destroy(&builder);
+}
+
+int main(int argc, char** argv) {
+    test_harness_t test;
+    test_harness_init(&test);
+    test.verbose = 1;
+
+    test_chunk_builder_growable(&test);
+    test_chunk_builder_compact(&test);
+    test_chunk_builder_counted(&test);
+    test_chunk_builder_nested(&test);
+    test_chunk_builder_aligned(&test);
+    test_chunk_builder_errors(&test);
+
+    test_harness_report(&test);
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include "../chunk_cursor.h"
+#include "../chunk_node.h"
+#include "../bitwise.h"
+#include "test_harness.h"
+#include <stdio.h>
+#include <string.h>
+
+uint8_t TEST_STRUCTURE[] = {
+    0x8d, 0x1b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x01, 0x09,
+    0x8d, 0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x01, 0x09,
+    0x11, 0x01, 0x08,
+    0x12, 0x01, 0x07,
+    0x11, 0x01, 0x08,
+    0x11, 0x01, 0x07
+};
+
+uint8_t TEST_EMPTY_SET[] = {
+    0x8d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+void test_chunk_cursor_moves(test_harness_t* test) {
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+    chunk_cursor_t cursor;
+    chunk_cursor_init(&cursor, root);
+    is_equal_uint8(test, cursor.node == root, 1, "test_chunk_cursor_moves(): starts at root");
+    is_equal_uint8(test, chunk_cursor_up(&cursor), 0, "test_chunk_cursor_moves(): no parent of root");
+    is_equal_uint8(test, chunk_cursor_next(&cursor), 0, "test_chunk_cursor_moves(): no sibling of root");
+
+    chunk_cursor_down(&cursor);
+    chunk_node_t* first = cursor.node;
+    is_equal_uint64(test, cursor.depth, 1, "test_chunk_cursor_moves(): down depth");
+    is_equal_uint8(test, BIT_TEST(root->flags, NODE_FLAG_FOCUS), 0, "test_chunk_cursor_moves(): root unfocused");
+    is_equal_uint8(test, BIT_TEST(first->flags, NODE_FLAG_FOCUS), 1, "test_chunk_cursor_moves(): child focused");
+    is_equal_uint8(test, chunk_cursor_down(&cursor), 0, "test_chunk_cursor_moves(): no child of leaf");
+    is_equal_uint8(test, chunk_cursor_prev(&cursor), 0, "test_chunk_cursor_moves(): no previous of first");
+
+    chunk_cursor_next(&cursor);
+    chunk_cursor_down(&cursor);
+    chunk_cursor_next(&cursor);
+    chunk_cursor_next(&cursor);
+    uint64_t addr[2] = {1, 2};
+    is_equal_uint8(test, cursor.node == chunk_node_select(root, addr, 2), 1, "test_chunk_cursor_moves(): node at 1:2");
+    is_equal_uint64(test, chunk_cursor_index(&cursor), 2, "test_chunk_cursor_moves(): index");
+    is_equal_uint8(test, chunk_cursor_next(&cursor), 0, "test_chunk_cursor_moves(): no next of last");
+    chunk_cursor_prev(&cursor);
+    is_equal_uint64(test, chunk_cursor_index(&cursor), 1, "test_chunk_cursor_moves(): prev index");
+
+    chunk_cursor_up(&cursor);
+    is_equal_uint64(test, cursor.depth, 1, "test_chunk_cursor_moves(): up depth");
+    is_equal_uint64(test, chunk_cursor_index(&cursor), 1, "test_chunk_cursor_moves(): up index");
+    is_equal_uint8(test, cursor.node->type, CHUNK_TYPE_SET, "test_chunk_cursor_moves(): up to set");
+    is_equal_uint8(test, chunk_cursor_seek(&cursor, 3), 1, "test_chunk_cursor_moves(): seek");
+    is_equal_uint8(test, chunk_cursor_seek(&cursor, 4), 0, "test_chunk_cursor_moves(): seek out of range");
+    is_equal_uint64(test, chunk_cursor_index(&cursor), 3, "test_chunk_cursor_moves(): seek index");
+
+    chunk_cursor_destroy(&cursor);
+    chunk_node_destroy(root);
+}
+
+void test_chunk_cursor_select(test_harness_t* test) {
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+    chunk_cursor_t cursor;
+    chunk_cursor_init(&cursor, root);
+
+    uint64_t addr[2] = {1, 1};
+    is_equal_uint8(test, chunk_cursor_select(&cursor, root, addr, 2), 1, "test_chunk_cursor_select(): found");
+    is_equal_uint8(test, cursor.node == chunk_node_select(root, addr, 2), 1, "test_chunk_cursor_select(): node");
+    is_equal_uint8(test, BIT_TEST(cursor.node->flags, NODE_FLAG_FOCUS), 1, "test_chunk_cursor_select(): focused");
+
+    // the tree is rebuilt, the old nodes are gone
+    chunk_node_destroy(root);
+    root = chunk_node_build_lazy(TEST_STRUCTURE);
+    chunk_cursor_select(&cursor, root, cursor.path, cursor.depth);
+    is_equal_uint8(test, cursor.node == chunk_node_select(root, addr, 2), 1, "test_chunk_cursor_select(): own path");
+
+    uint64_t missing[3] = {1, 7, 0};
+    is_equal_uint8(test, chunk_cursor_select(&cursor, root, missing, 3), 0, "test_chunk_cursor_select(): missing");
+    is_equal_uint64(test, cursor.depth, 1, "test_chunk_cursor_select(): stops at deepest");
+    is_equal_uint64(test, chunk_cursor_index(&cursor), 1, "test_chunk_cursor_select(): deepest index");
+
+    chunk_cursor_destroy(&cursor);
+    chunk_node_destroy(root);
+}
+
+void test_chunk_cursor_deep(test_harness_t* test) {
+    chunk_node_t* root = chunk_node_build_lazy(TEST_EMPTY_SET);
+    chunk_node_t* node = root;
+    for (uint64_t i = 0; i < 1000; i++) {
+        node = chunk_node_set_insert(node, 0);
+        chunk_node_set_type(node, CHUNK_TYPE_SET);
+    }
+
+    chunk_cursor_t cursor;
+    chunk_cursor_init(&cursor, root);
+    while (chunk_cursor_down(&cursor));
+    is_equal_uint64(test, cursor.depth, 1000, "test_chunk_cursor_deep(): depth past 256");
+    is_equal_uint8(test, cursor.node == node, 1, "test_chunk_cursor_deep(): deepest node");
+    while (chunk_cursor_up(&cursor));
+    is_equal_uint8(test, cursor.node == root, 1, "test_chunk_cursor_deep(): back at root");
+    is_equal_uint8(test, BIT_TEST(node->flags, NODE_FLAG_FOCUS), 0, "test_chunk_cursor_deep(): deepest unfocused");
+
+    chunk_cursor_destroy(&cursor);
+    chunk_node_destroy(root);
+}
+
+int main(int argc, char** argv) {
+    test_harness_t test;
+    test_harness_init(&test);
+    test.verbose = 1;
+
+    test_chunk_cursor_moves(&test);
+    test_chunk_cursor_select(&test);
+    test_chunk_cursor_deep(&test);
+
+    test_harness_report(&test);
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "../chunk_endian.h"
+#include "test_harness.h"
+#include <stdio.h>
+
+void test_chunk_byteswap(test_harness_t* test) {
+    uint8_t data[] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+    uint8_t dest[8];
+
+    chunk_byteswap(dest, data, CHUNK_TYPE_UINT16, 4);
+    is_equal_uint8(test, dest[0], 0x02, "test_chunk_byteswap(): uint16 [0]");
+    is_equal_uint8(test, dest[7], 0x07, "test_chunk_byteswap(): uint16 [7]");
+
+    chunk_byteswap(dest, data, CHUNK_TYPE_FLOAT32, 2);
+    is_equal_uint8(test, dest[0], 0x04, "test_chunk_byteswap(): float32 [0]");
+    is_equal_uint8(test, dest[4], 0x08, "test_chunk_byteswap(): float32 [4]");
+
+    chunk_byteswap(data, data, CHUNK_TYPE_INT64, 1);
+    is_equal_uint8(test, data[0], 0x08, "test_chunk_byteswap(): int64 in place [0]");
+    is_equal_uint8(test, data[7], 0x01, "test_chunk_byteswap(): int64 in place [7]");
+
+    chunk_byteswap(dest, data, CHUNK_TYPE_UINT8, 8);
+    is_equal_uint8(test, dest[0], 0x08, "test_chunk_byteswap(): uint8 copied unchanged");
+}
+
+void test_chunk_copy_host(test_harness_t* test) {
+    uint8_t data[] = {0x13, 0x04, 0x34, 0x12, 0x78, 0x56};
+    uint16_t host[2];
+
+    chunk_t chunk = chunk_decode(data);
+    chunk_copy_to_host((uint8_t*)host, chunk);
+    is_equal_uint32(test, host[0], 0x1234, "test_chunk_copy_host(): to host [0]");
+    is_equal_uint32(test, host[1], 0x5678, "test_chunk_copy_host(): to host [1]");
+
+    uint8_t file[4];
+    chunk_copy_from_host(file, (uint8_t*)host, CHUNK_TYPE_UINT16, 4);
+    is_equal_uint8(test, file[0], 0x34, "test_chunk_copy_host(): from host [0]");
+    is_equal_uint8(test, file[3], 0x56, "test_chunk_copy_host(): from host [3]");
+}
+
+void test_chunk_byteswap_all(test_harness_t* test) {
+    uint8_t data[] = {
+        0x8d, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x13, 0x02, 0x12, 0x34,
+        0x1d, 0x04,
+        0x13, 0x02, 0xab, 0xcd
+    };
+
+    chunk_byteswap_all(data);
+    is_equal_uint8(test, data[11], 0x34, "test_chunk_byteswap_all(): first leaf swapped");
+    is_equal_uint8(test, data[12], 0x12, "test_chunk_byteswap_all(): first leaf swapped");
+    is_equal_uint8(test, data[17], 0xcd, "test_chunk_byteswap_all(): nested leaf swapped");
+    is_equal_uint8(test, data[18], 0xab, "test_chunk_byteswap_all(): nested leaf swapped");
+    is_equal_uint8(test, data[1], 0x0a, "test_chunk_byteswap_all(): headers untouched");
+}
+
+int main(int argc, char** argv) {
+    test_harness_t test;
+    test_harness_init(&test);
+    test.verbose = 1;
+
+    test_chunk_byteswap(&test);
+    test_chunk_copy_host(&test);
+    test_chunk_byteswap_all(&test);
+
+    test_harness_report(&test);
+    return 0;
+}
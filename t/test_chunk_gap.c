@@ -0,0 +1,71 @@
+#include "../chunk_gap.h"
+#include "test_harness.h"
+#include <stdio.h>
+#include <string.h>
+
+void test_chunk_gap_insert(test_harness_t* test) {
+    chunk_gap_t gap;
+    chunk_gap_init(&gap, (uint8_t*)"held", 4);
+    is_equal_uint64(test, chunk_gap_length(&gap), 4, "test_chunk_gap_insert(): initial length");
+
+    chunk_gap_insert(&gap, 2, (uint8_t*)"llo wor", 7);
+    is_equal_uint64(test, chunk_gap_length(&gap), 11, "test_chunk_gap_insert(): length");
+    is_equal_uint8(test, chunk_gap_get(&gap, 2), 'l', "test_chunk_gap_insert(): before gap");
+    is_equal_uint8(test, chunk_gap_get(&gap, 9), 'l', "test_chunk_gap_insert(): after gap");
+
+    chunk_gap_insert(&gap, 0, (uint8_t*)"s", 1);
+    uint8_t copy[16];
+    memset(copy, 0, 16);
+    chunk_gap_copy(&gap, copy);
+    is_equal_uint8(test, memcmp(copy, "shello world", 12) == 0, 1, "test_chunk_gap_insert(): copy");
+
+    is_equal_uint8(test, chunk_gap_insert(&gap, 13, (uint8_t*)"x", 1), 0, "test_chunk_gap_insert(): out of range");
+
+    // typing at one spot grows the buffer without losing the tail
+    for (uint64_t i = 0; i < 200; i++) {
+        chunk_gap_insert(&gap, 6 + i, (uint8_t*)"x", 1);
+    }
+    is_equal_uint64(test, chunk_gap_length(&gap), 212, "test_chunk_gap_insert(): grown length");
+    uint8_t* flat = chunk_gap_flatten(&gap);
+    is_equal_uint8(test, flat[205], 'x', "test_chunk_gap_insert(): last typed");
+    is_equal_uint8(test, memcmp(&flat[206], " world", 6) == 0, 1, "test_chunk_gap_insert(): tail kept");
+
+    chunk_gap_destroy(&gap);
+}
+
+void test_chunk_gap_delete(test_harness_t* test) {
+    chunk_gap_t gap;
+    chunk_gap_init(&gap, (uint8_t*)"hello world", 11);
+
+    uint8_t* deleted = NULL;
+    is_equal_uint8(test, chunk_gap_delete(&gap, 4, 3, &deleted), 1, "test_chunk_gap_delete(): ok");
+    is_equal_uint8(test, memcmp(deleted, "o w", 3) == 0, 1, "test_chunk_gap_delete(): deleted bytes");
+    is_equal_uint64(test, chunk_gap_length(&gap), 8, "test_chunk_gap_delete(): length");
+    is_equal_uint8(test, memcmp(chunk_gap_flatten(&gap), "hellorld", 8) == 0, 1, "test_chunk_gap_delete(): contents");
+    is_equal_uint8(test, chunk_gap_delete(&gap, 6, 3, NULL), 0, "test_chunk_gap_delete(): out of range");
+
+    // the gap now sits at 4, ranges on either side and across it
+    chunk_gap_delete(&gap, 4, 1, NULL);
+    uint8_t copy[8];
+    chunk_gap_copy_range(&gap, 1, 2, copy);
+    is_equal_uint8(test, memcmp(copy, "el", 2) == 0, 1, "test_chunk_gap_delete(): range before gap");
+    chunk_gap_copy_range(&gap, 5, 2, copy);
+    is_equal_uint8(test, memcmp(copy, "ld", 2) == 0, 1, "test_chunk_gap_delete(): range after gap");
+    chunk_gap_copy_range(&gap, 2, 4, copy);
+    is_equal_uint8(test, memcmp(copy, "llrl", 4) == 0, 1, "test_chunk_gap_delete(): range across gap");
+    is_equal_uint64(test, gap.gap_start, 4, "test_chunk_gap_delete(): gap not moved");
+
+    chunk_gap_destroy(&gap);
+}
+
+int main(int argc, char** argv) {
+    test_harness_t test;
+    test_harness_init(&test);
+    test.verbose = 1;
+
+    test_chunk_gap_insert(&test);
+    test_chunk_gap_delete(&test);
+
+    test_harness_report(&test);
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "../chunk_index.h"
+#include "test_harness.h"
+#include <stdio.h>
+
+uint8_t TEST_STRUCTURE[] = {
+    0x8d, // 8 length bytes, data type 12
+    0x1b, // 27 bytes long
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x15, //   1 length byte, data type 5
+    0x01, //   1 bytes long
+    0x09, //   data (9)
+    0x8d, //   1 length byte, data type 12
+    0x09, //   9 bytes long
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x15, //     1 length byte, data type 5
+    0x01, //     1 bytes long
+    0x09, //     data (9)
+    0x11, //     1 length byte, data type 1
+    0x01, //     1 bytes long
+    0x08, //     data (8)
+    0x12, //     1 length byte, data type 2
+    0x01, //     1 bytes long
+    0x07, //     data (7)
+    0x13, //   1 length byte, data type 3
+    0x01, //   1 bytes long
+    0x08, //   data (8)
+    0x12, //   1 length byte, data type 2
+    0x01, //   1 bytes long
+    0x07  //   data (7)
+};
+
+void test_chunk_index_item_byte_offset(test_harness_t* test) {
+    chunk_t chunk = chunk_decode(TEST_STRUCTURE);
+    chunk_index_t index;
+
+    uint8_t ok = chunk_index_init(&index, chunk);
+    is_equal_uint8(test, ok, 1, "test_chunk_index_item_byte_offset(): init on a set");
+
+    for (uint32_t i = 0; i < 5; i++) {
+        is_equal_uint64(test, chunk_index_item_byte_offset(&index, i), chunk_set_item_byte_offset(chunk, i), "test_chunk_index_item_byte_offset(): offset matches scan");
+    }
+    is_equal_uint64(test, index.nr_items, 4, "test_chunk_index_item_byte_offset(): nr_items");
+    is_equal_uint64(test, chunk_index_item_byte_offset(&index, 5), 0, "test_chunk_index_item_byte_offset(): offset zero (overflow)");
+
+    chunk_index_destroy(&index);
+}
+
+void test_chunk_index_get_nth(test_harness_t* test) {
+    chunk_t chunk = chunk_decode(TEST_STRUCTURE);
+    chunk_index_t index;
+    chunk_t walk;
+
+    chunk_index_init(&index, chunk);
+
+    uint8_t found = chunk_index_get_nth(&index, &walk, 2);
+    is_equal_uint8(test, found, 1, "test_chunk_index_get_nth(): found the third element in set");
+    is_equal_uint8(test, walk.type, CHUNK_TYPE_UINT16, "test_chunk_index_get_nth(): third element in set is CHUNK_TYPE_UINT16");
+
+    found = chunk_index_get_nth(&index, &walk, 1);
+    is_equal_uint8(test, found, 1, "test_chunk_index_get_nth(): found the second element in set");
+    is_equal_uint8(test, walk.type, CHUNK_TYPE_SET, "test_chunk_index_get_nth(): second element in set is CHUNK_TYPE_SET");
+
+    found = chunk_index_get_nth(&index, &walk, 4);
+    is_equal_uint8(test, found, 0, "test_chunk_index_get_nth(): no fifth element in set");
+
+    chunk_index_destroy(&index);
+
+    chunk_t leaf = chunk_decode(&TEST_STRUCTURE[9]);
+    is_equal_uint8(test, chunk_index_init(&index, leaf), 0, "test_chunk_index_get_nth(): init on a leaf fails");
+    is_equal_uint8(test, chunk_index_get_nth(&index, &walk, 0), 0, "test_chunk_index_get_nth(): lookup on a leaf fails");
+}
+
+int main(int argc, char** argv) {
+    test_harness_t test;
+    test_harness_init(&test);
+    test.verbose = 1;
+
+    test_chunk_index_item_byte_offset(&test);
+    test_chunk_index_get_nth(&test);
+
+    test_harness_report(&test);
+    return 0;
+}
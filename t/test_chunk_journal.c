@@ -0,0 +1,206 @@
+#include "../chunk_journal.h"
+#include "../chunk_snap.h"
+#include "../chunk_node.h"
+#include "test_harness.h"
+#include <stdio.h>
+#include <string.h>
+
+uint8_t TEST_STRUCTURE[] = {
+    0x8d, 0x1b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x01, 0x09,
+    0x8d, 0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x01, 0x09,
+    0x11, 0x01, 0x08,
+    0x12, 0x01, 0x07,
+    0x11, 0x01, 0x08,
+    0x11, 0x01, 0x07
+};
+
+// [0] "hi", then [1] with [1:1] grown to 08 2a, then [3] and [4]
+uint8_t TEST_EDITED[] = {
+    0x8d, 0x1d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x1b, 0x02, 0x68, 0x69,
+    0x8d, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x01, 0x09,
+    0x11, 0x02, 0x08, 0x2a,
+    0x12, 0x01, 0x07,
+    0x11, 0x01, 0x08,
+    0x11, 0x01, 0x07
+};
+
+static uint64_t encode(chunk_node_t* root, uint8_t* buf) {
+    chunk_snap_t* snap = chunk_snap_take(root);
+    uint64_t length = chunk_snap_encode(snap, buf) - buf;
+    chunk_snap_release(snap);
+    return length;
+}
+
+// Replace [0] with a string and grow [1:1], in four entries.
+static void edit(chunk_journal_t* journal, chunk_node_t* root) {
+    uint64_t path[2] = {0, 1};
+    uint8_t value = 0x2a;
+    chunk_journal_set_delete(journal, root, path, 0, 0);
+    chunk_journal_set_insert(journal, root, path, 0, 0, CHUNK_TYPE_UNDEF);
+    chunk_journal_set_type(journal, root, path, 1, CHUNK_TYPE_UTF8);
+    chunk_journal_data_replace(journal, root, path, 1, 0, 0, (uint8_t*)"hi", 2);
+    path[0] = 1;
+    chunk_journal_data_replace(journal, root, path, 2, 1, 0, &value, 1);
+}
+
+void test_chunk_journal_undo_redo(test_harness_t* test) {
+    uint8_t buf[64];
+    chunk_journal_t journal;
+    chunk_journal_init(&journal);
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+
+    edit(&journal, root);
+    is_equal_uint64(test, journal.nr_entries, 5, "test_chunk_journal_undo_redo(): entries");
+    is_equal_uint64(test, encode(root, buf), sizeof(TEST_EDITED), "test_chunk_journal_undo_redo(): edited size");
+    is_equal_uint8(test, memcmp(buf, TEST_EDITED, sizeof(TEST_EDITED)) == 0, 1, "test_chunk_journal_undo_redo(): edited bytes");
+
+    chunk_journal_entry_t entry;
+    is_equal_uint8(test, chunk_journal_entry(&journal, 4, &entry), 1, "test_chunk_journal_undo_redo(): entry");
+    is_equal_uint8(test, entry.op, CHUNK_JOURNAL_PAYLOAD, "test_chunk_journal_undo_redo(): entry op");
+    is_equal_uint64(test, entry.depth, 2, "test_chunk_journal_undo_redo(): entry depth");
+    is_equal_uint64(test, entry.location, 1, "test_chunk_journal_undo_redo(): entry location");
+    is_equal_uint8(test, entry.path[8], 1, "test_chunk_journal_undo_redo(): path little-endian");
+    is_equal_uint8(test, entry.path[15], 0, "test_chunk_journal_undo_redo(): path high byte");
+
+    uint64_t nr_undone = 0;
+    while (chunk_journal_undo(&journal, root)) {
+        nr_undone++;
+    }
+    is_equal_uint64(test, nr_undone, 5, "test_chunk_journal_undo_redo(): undone");
+    is_equal_uint64(test, encode(root, buf), sizeof(TEST_STRUCTURE), "test_chunk_journal_undo_redo(): undone size");
+    is_equal_uint8(test, memcmp(buf, TEST_STRUCTURE, sizeof(TEST_STRUCTURE)) == 0, 1, "test_chunk_journal_undo_redo(): undone bytes");
+    is_equal_uint64(test, chunk_node_size(root), sizeof(TEST_STRUCTURE), "test_chunk_journal_undo_redo(): undone node size");
+
+    uint64_t nr_redone = 0;
+    while (chunk_journal_redo(&journal, root)) {
+        nr_redone++;
+    }
+    is_equal_uint64(test, nr_redone, 5, "test_chunk_journal_undo_redo(): redone");
+    encode(root, buf);
+    is_equal_uint8(test, memcmp(buf, TEST_EDITED, sizeof(TEST_EDITED)) == 0, 1, "test_chunk_journal_undo_redo(): redone bytes");
+
+    // a failed edit after undo keeps what could be redone
+    chunk_journal_undo(&journal, root);
+    chunk_journal_undo(&journal, root);
+    uint64_t path[1] = {3};
+    is_equal_uint8(test, chunk_journal_set_type(&journal, root, path, 0, CHUNK_TYPE_UINT8), 0, "test_chunk_journal_undo_redo(): failed edit after undo");
+    is_equal_uint64(test, journal.nr_entries, 5, "test_chunk_journal_undo_redo(): redo kept");
+    is_equal_uint8(test, chunk_journal_redo(&journal, root), 1, "test_chunk_journal_undo_redo(): redo after failed edit");
+    chunk_journal_undo(&journal, root);
+
+    // a new edit after undo drops what could have been redone
+    chunk_journal_data_replace(&journal, root, path, 1, 0, 1, NULL, 0);
+    is_equal_uint64(test, journal.nr_entries, 4, "test_chunk_journal_undo_redo(): redo dropped");
+    is_equal_uint8(test, chunk_journal_redo(&journal, root), 0, "test_chunk_journal_undo_redo(): nothing to redo");
+
+    // failed edits leave no entry
+    is_equal_uint8(test, chunk_journal_set_delete(&journal, root, path, 0, 9), 0, "test_chunk_journal_undo_redo(): bad delete");
+    is_equal_uint8(test, chunk_journal_set_type(&journal, root, path, 1, CHUNK_TYPE_SET), 1, "test_chunk_journal_undo_redo(): emptied leaf retyped");
+    is_equal_uint8(test, chunk_journal_set_type(&journal, root, path, 0, CHUNK_TYPE_UINT8), 0, "test_chunk_journal_undo_redo(): full set not retyped");
+    is_equal_uint64(test, journal.nr_entries, 5, "test_chunk_journal_undo_redo(): failures not kept");
+
+    chunk_node_destroy(root);
+    chunk_journal_destroy(&journal);
+}
+
+void test_chunk_journal_replay(test_harness_t* test) {
+    uint8_t buf[64];
+    chunk_journal_t journal;
+    chunk_journal_init(&journal);
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+    edit(&journal, root);
+    chunk_journal_undo(&journal, root);
+
+    // only the applied entries are kept, and they are a valid chunk stream
+    uint64_t length = chunk_journal_length(&journal);
+    is_equal_uint8(test, length < journal.length, 1, "test_chunk_journal_replay(): undone entry left out");
+    uint64_t offset = 0;
+    uint64_t nr_chunks = 0;
+    while (offset < length) {
+        is_equal_uint8(test, chunk_validate(&journal.data[offset], length - offset, NULL), CHUNK_OK, "test_chunk_journal_replay(): entry valid");
+        offset += chunk_decode(&journal.data[offset]).total_length;
+        nr_chunks++;
+    }
+    is_equal_uint64(test, nr_chunks, 4, "test_chunk_journal_replay(): entries in stream");
+
+    chunk_node_t* other = chunk_node_build_lazy(TEST_STRUCTURE);
+    is_equal_uint64(test, chunk_journal_replay(other, journal.data, length), 4, "test_chunk_journal_replay(): applied");
+    uint8_t expected[64];
+    uint64_t expected_length = encode(root, expected);
+    is_equal_uint64(test, encode(other, buf), expected_length, "test_chunk_journal_replay(): size");
+    is_equal_uint8(test, memcmp(buf, expected, expected_length) == 0, 1, "test_chunk_journal_replay(): same tree");
+
+    // a truncated stream stops at the last whole entry
+    chunk_node_t* short_tree = chunk_node_build_lazy(TEST_STRUCTURE);
+    is_equal_uint64(test, chunk_journal_replay(short_tree, journal.data, length - 1), 3, "test_chunk_journal_replay(): truncated");
+
+    // a malformed entry is not decoded
+    uint8_t corrupt[256];
+    memcpy(corrupt, journal.data, length);
+    uint64_t second = chunk_decode(corrupt).total_length;
+    chunk_t entry = chunk_decode(&corrupt[second]);
+    entry.data[0] = 0x1e;
+    chunk_node_t* corrupt_tree = chunk_node_build_lazy(TEST_STRUCTURE);
+    is_equal_uint64(test, chunk_journal_replay(corrupt_tree, corrupt, length), 1, "test_chunk_journal_replay(): malformed entry");
+    chunk_node_destroy(corrupt_tree);
+
+    // so is a type that does not exist
+    memcpy(corrupt, journal.data, length);
+    uint64_t third = second + chunk_decode(&corrupt[second]).total_length;
+    entry = chunk_decode(&corrupt[third]);
+    chunk_t field = chunk_decode(entry.data);
+    field = chunk_decode(field.data + field.data_length);
+    field = chunk_decode(field.data + field.data_length);
+    field.data[1] = 0x0e;
+    corrupt_tree = chunk_node_build_lazy(TEST_STRUCTURE);
+    is_equal_uint64(test, chunk_journal_replay(corrupt_tree, corrupt, length), 2, "test_chunk_journal_replay(): bad type");
+    is_equal_uint8(test, chunk_node_child(corrupt_tree, 0)->type, CHUNK_TYPE_UNDEF, "test_chunk_journal_replay(): bad type not set");
+    chunk_node_destroy(corrupt_tree);
+
+    chunk_node_destroy(short_tree);
+    chunk_node_destroy(other);
+    chunk_node_destroy(root);
+    chunk_journal_destroy(&journal);
+}
+
+void test_chunk_journal_typing(test_harness_t* test) {
+    chunk_journal_t journal;
+    chunk_journal_init(&journal);
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+    uint64_t path[1] = {0};
+    chunk_journal_set_delete(&journal, root, path, 0, 0);
+    chunk_journal_set_insert(&journal, root, path, 0, 0, CHUNK_TYPE_UTF8);
+    chunk_journal_data_replace(&journal, root, path, 1, 0, 0, (uint8_t*)"helo", 4);
+    chunk_journal_data_replace(&journal, root, path, 1, 3, 0, (uint8_t*)"l", 1);
+
+    // backspace and overwrite record what they remove without flattening
+    chunk_node_t* node = chunk_node_child(root, 0);
+    chunk_journal_data_replace(&journal, root, path, 1, 4, 1, NULL, 0);
+    chunk_journal_data_replace(&journal, root, path, 1, 3, 1, (uint8_t*)"p", 1);
+    is_equal_uint64(test, (uintptr_t)node->data, 0, "test_chunk_journal_typing(): gap kept");
+    is_equal_uint8(test, memcmp(chunk_node_data(node), "help", 4) == 0, 1, "test_chunk_journal_typing(): edited");
+
+    chunk_journal_undo(&journal, root);
+    chunk_journal_undo(&journal, root);
+    is_equal_uint8(test, memcmp(chunk_node_data(node), "hello", 5) == 0, 1, "test_chunk_journal_typing(): removed bytes restored");
+
+    chunk_node_destroy(root);
+    chunk_journal_destroy(&journal);
+}
+
+int main(int argc, char** argv) {
+    test_harness_t test;
+    test_harness_init(&test);
+    test.verbose = 1;
+
+    test_chunk_journal_undo_redo(&test);
+    test_chunk_journal_replay(&test);
+    test_chunk_journal_typing(&test);
+
+    test_harness_report(&test);
+    return 0;
+}
@@ -1,6 +1,10 @@
 #include "../chunk_node.h"
+#include "../chunk_snap.h"
+#include "../bitwise.h"
 #include "test_harness.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 uint8_t TEST_STRUCTURE[] = {
     0x8d,
@@ -46,29 +50,29 @@ void test_chunk_node_build(test_harness_t* test) {
     chunk_node_t* node = root;
 
     is_equal_uint64(test, node->nr_children, 4, "test_chunk_node_build(): [] nr_children");
-    is_equal_uint8(test, node->children[0].type, 1, "test_chunk_node_build(): [0] type");
-    is_equal_uint64(test, node->children[0].nr_children, 1, "test_chunk_node_build(): [0] nr_children");
+    is_equal_uint8(test, chunk_node_child(node, 0)->type, 1, "test_chunk_node_build(): [0] type");
+    is_equal_uint64(test, chunk_node_child(node, 0)->nr_children, 1, "test_chunk_node_build(): [0] nr_children");
 
-    is_equal_uint8(test, node->children[1].type, 13, "test_chunk_node_build(): [1] type");
-    is_equal_uint64(test, node->children[1].nr_children, 3, "test_chunk_node_build(): [1] nr_children");
+    is_equal_uint8(test, chunk_node_child(node, 1)->type, 13, "test_chunk_node_build(): [1] type");
+    is_equal_uint64(test, chunk_node_child(node, 1)->nr_children, 3, "test_chunk_node_build(): [1] nr_children");
 
-    node = &node->children[1];
+    node = chunk_node_child(node, 1);
     is_equal_uint64(test, node->nr_children, 3, "test_chunk_node_build(): [1] nr_children");
-    is_equal_uint8(test, node->children[0].type, 1, "test_chunk_node_build(): [1:0] type");
-    is_equal_uint64(test, node->children[0].nr_children, 1, "test_chunk_node_build(): [1:0] nr_children");
+    is_equal_uint8(test, chunk_node_child(node, 0)->type, 1, "test_chunk_node_build(): [1:0] type");
+    is_equal_uint64(test, chunk_node_child(node, 0)->nr_children, 1, "test_chunk_node_build(): [1:0] nr_children");
 
-    is_equal_uint8(test, node->children[1].type, 1, "test_chunk_node_build(): [1:2] type");
-    is_equal_uint64(test, node->children[1].nr_children, 1, "test_chunk_node_build(): [1:2] nr_children");
+    is_equal_uint8(test, chunk_node_child(node, 1)->type, 1, "test_chunk_node_build(): [1:2] type");
+    is_equal_uint64(test, chunk_node_child(node, 1)->nr_children, 1, "test_chunk_node_build(): [1:2] nr_children");
 
-    is_equal_uint8(test, node->children[2].type, 2, "test_chunk_node_build(): [1:2] type");
-    is_equal_uint64(test, node->children[2].nr_children, 1, "test_chunk_node_build(): [1:2] nr_children");
+    is_equal_uint8(test, chunk_node_child(node, 2)->type, 2, "test_chunk_node_build(): [1:2] type");
+    is_equal_uint64(test, chunk_node_child(node, 2)->nr_children, 1, "test_chunk_node_build(): [1:2] nr_children");
 
     node = root;
-    is_equal_uint8(test, node->children[2].type, 1, "test_chunk_node_build(): [2] type");
-    is_equal_uint64(test, node->children[2].nr_children, 1, "test_chunk_node_build(): [2] nr_children");
+    is_equal_uint8(test, chunk_node_child(node, 2)->type, 1, "test_chunk_node_build(): [2] type");
+    is_equal_uint64(test, chunk_node_child(node, 2)->nr_children, 1, "test_chunk_node_build(): [2] nr_children");
 
-    is_equal_uint8(test, node->children[3].type, 1, "test_chunk_node_build(): [3] type");
-    is_equal_uint64(test, node->children[3].nr_children, 1, "test_chunk_node_build(): [3] nr_children");
+    is_equal_uint8(test, chunk_node_child(node, 3)->type, 1, "test_chunk_node_build(): [3] type");
+    is_equal_uint64(test, chunk_node_child(node, 3)->nr_children, 1, "test_chunk_node_build(): [3] nr_children");
 
     chunk_node_destroy(root);
 }
@@ -82,37 +86,439 @@ void test_chunk_node_set_insert(test_harness_t* test) {
     is_equal_uint64(test, node->nr_children, 5, "test_chunk_node_set_insert(): [] nr_children");
     is_equal_uint64(test, new->type, 0, "test_chunk_node_set_insert(): [0] NEW type");
 
-    is_equal_uint8(test, node->children[2].type, 13, "test_chunk_node_set_insert(): [2] type");
-    is_equal_uint64(test, node->children[2].nr_children, 3, "test_chunk_node_set_insert(): [2] nr_children");
+    is_equal_uint8(test, chunk_node_child(node, 2)->type, 13, "test_chunk_node_set_insert(): [2] type");
+    is_equal_uint64(test, chunk_node_child(node, 2)->nr_children, 3, "test_chunk_node_set_insert(): [2] nr_children");
 
-    is_equal_uint8(test, node->children[4].type, 1, "test_chunk_node_set_insert(): [4] type");
-    is_equal_uint64(test, node->children[4].nr_children, 1, "test_chunk_node_set_insert(): [4] nr_children");
+    is_equal_uint8(test, chunk_node_child(node, 4)->type, 1, "test_chunk_node_set_insert(): [4] type");
+    is_equal_uint64(test, chunk_node_child(node, 4)->nr_children, 1, "test_chunk_node_set_insert(): [4] nr_children");
 
     // insert before child set
     new = chunk_node_set_insert(node, 2);
     is_equal_uint64(test, node->nr_children, 6, "test_chunk_node_set_insert(): [] nr_children");
     is_equal_uint64(test, new->type, 0, "test_chunk_node_set_insert(): [0] NEW type");
 
-    is_equal_uint8(test, node->children[3].type, 13, "test_chunk_node_set_insert(): [3] type");
-    is_equal_uint64(test, node->children[3].nr_children, 3, "test_chunk_node_set_insert(): [3] nr_children");
+    is_equal_uint8(test, chunk_node_child(node, 3)->type, 13, "test_chunk_node_set_insert(): [3] type");
+    is_equal_uint64(test, chunk_node_child(node, 3)->nr_children, 3, "test_chunk_node_set_insert(): [3] nr_children");
 
-    is_equal_uint8(test, node->children[5].type, 1, "test_chunk_node_set_insert(): [5] type");
-    is_equal_uint64(test, node->children[5].nr_children, 1, "test_chunk_node_set_insert(): [5] nr_children");
+    is_equal_uint8(test, chunk_node_child(node, 5)->type, 1, "test_chunk_node_set_insert(): [5] type");
+    is_equal_uint64(test, chunk_node_child(node, 5)->nr_children, 1, "test_chunk_node_set_insert(): [5] nr_children");
 
     // append to the end
     new = chunk_node_set_insert(node, 6);
     is_equal_uint64(test, node->nr_children, 7, "test_chunk_node_set_insert(): [] nr_children");
     is_equal_uint64(test, new->type, 0, "test_chunk_node_set_insert(): [0] NEW type");
 
-    is_equal_uint8(test, node->children[3].type, 13, "test_chunk_node_set_insert(): [3] type");
-    is_equal_uint64(test, node->children[3].nr_children, 3, "test_chunk_node_set_insert(): [3] nr_children");
+    is_equal_uint8(test, chunk_node_child(node, 3)->type, 13, "test_chunk_node_set_insert(): [3] type");
+    is_equal_uint64(test, chunk_node_child(node, 3)->nr_children, 3, "test_chunk_node_set_insert(): [3] nr_children");
 
-    is_equal_uint8(test, node->children[5].type, 1, "test_chunk_node_set_insert(): [5] type");
-    is_equal_uint64(test, node->children[5].nr_children, 1, "test_chunk_node_set_insert(): [5] nr_children");
+    is_equal_uint8(test, chunk_node_child(node, 5)->type, 1, "test_chunk_node_set_insert(): [5] type");
+    is_equal_uint64(test, chunk_node_child(node, 5)->nr_children, 1, "test_chunk_node_set_insert(): [5] nr_children");
 
     chunk_node_destroy(root);
 }
 
+void test_chunk_node_build_arena(test_harness_t* test) {
+    chunk_arena_t* arena = chunk_arena_create(0);
+    chunk_node_t* root = chunk_node_build_arena(TEST_STRUCTURE, arena);
+
+    is_equal_uint8(test, root->type, 13, "test_chunk_node_build_arena(): [] type");
+    is_equal_uint64(test, root->nr_children, 4, "test_chunk_node_build_arena(): [] nr_children");
+    is_equal_uint8(test, chunk_node_child(root, 1)->type, 13, "test_chunk_node_build_arena(): [1] type");
+    is_equal_uint64(test, chunk_node_child(root, 1)->nr_children, 3, "test_chunk_node_build_arena(): [1] nr_children");
+    is_equal_uint8(test, chunk_node_child(root, 0)->data[0], 9, "test_chunk_node_build_arena(): [0] data");
+
+    // inserted children live outside the arena
+    chunk_node_t* new = chunk_node_set_insert(root, 0);
+    is_equal_uint64(test, new->type, 0, "test_chunk_node_build_arena(): [0] NEW type");
+    is_equal_uint64(test, root->nr_children, 5, "test_chunk_node_build_arena(): [] nr_children after insert");
+    is_equal_uint8(test, chunk_node_child(root, 1)->data[0], 9, "test_chunk_node_build_arena(): [1] data after insert");
+
+    chunk_node_destroy_arena(root, arena);
+}
+
+// Number of nodes under a and b that differ in shape, data or parent.
+static uint64_t tree_differences(chunk_node_t* a, chunk_node_t* b) {
+    if ((a->type != b->type) || (a->nr_children != b->nr_children) || (chunk_node_size(a) != chunk_node_size(b))) {
+        return 1;
+    }
+    if (a->type != CHUNK_TYPE_SET) {
+        return memcmp(a->data, b->data, a->data_length) != 0;
+    }
+    uint64_t differences = 0;
+    for (uint64_t i = 0; i < a->nr_children; i++) {
+        chunk_node_t* child = chunk_node_child(b, i);
+        differences += (child->parent != b);
+        differences += tree_differences(chunk_node_child(a, i), child);
+    }
+    return differences;
+}
+
+void test_chunk_node_build_parallel(test_harness_t* test) {
+    uint8_t* data = malloc(64 * 1024);
+    uint8_t* walk = data + 9;
+    for (uint64_t i = 0; i < 2000; i++) {
+        // one set big enough to be split rather than handed out whole
+        if (i == 1000) {
+            uint8_t* big = walk;
+            walk += 9;
+            for (uint64_t j = 0; j < 3000; j++) {
+                walk = chunk_write_header(walk, CHUNK_TYPE_UINT16, 2);
+                *walk++ = (uint8_t)j;
+                *walk++ = (uint8_t)(j >> 8);
+            }
+            chunk_write_header(big, CHUNK_TYPE_SET, (walk - big) - 9);
+        }
+        uint8_t nr_leaves = 1 + (i % 3);
+        walk = chunk_write_header(walk, CHUNK_TYPE_SET, nr_leaves * 3);
+        for (uint8_t j = 0; j < nr_leaves; j++) {
+            walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+            *walk++ = (uint8_t)(i + j);
+        }
+    }
+    chunk_write_header(data, CHUNK_TYPE_SET, (walk - data) - 9);
+
+    chunk_node_t* expected = chunk_node_build(data);
+    for (uint32_t nr_threads = 1; nr_threads <= 4; nr_threads++) {
+        chunk_arena_t* arena = chunk_arena_create(0);
+        chunk_node_t* root = chunk_node_build_parallel(data, arena, nr_threads);
+        char message[80];
+        snprintf(message, sizeof(message), "test_chunk_node_build_parallel(): %u threads same tree", nr_threads);
+        is_equal_uint64(test, tree_differences(expected, root), 0, message);
+        chunk_node_destroy_arena(root, arena);
+    }
+    is_equal_uint64(test, chunk_node_child(chunk_node_child(expected, 1000), 2999)->data[1], 0x0b, "test_chunk_node_build_parallel(): big set built");
+
+    chunk_node_destroy(expected);
+    free(data);
+}
+
+void test_chunk_node_build_lazy(test_harness_t* test) {
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+
+    is_equal_uint8(test, root->type, 13, "test_chunk_node_build_lazy(): [] type");
+    is_equal_uint64(test, root->nr_children, 4, "test_chunk_node_build_lazy(): [] nr_children");
+    is_equal_uint8(test, BIT_TEST(root->flags, NODE_FLAG_REALISED), 0, "test_chunk_node_build_lazy(): [] not realised");
+    is_equal_uint64(test, (uintptr_t)root->children.root, 0, "test_chunk_node_build_lazy(): [] no children");
+    is_equal_uint64(test, chunk_node_size(root), 36, "test_chunk_node_build_lazy(): [] size unrealised");
+
+    uint64_t addr[2] = {1, 2};
+    chunk_node_t* node = chunk_node_select(root, addr, 2);
+    is_equal_uint8(test, node->type, 2, "test_chunk_node_build_lazy(): [1:2] type");
+    is_equal_uint8(test, BIT_TEST(root->flags, NODE_FLAG_REALISED), 1, "test_chunk_node_build_lazy(): [] realised");
+    is_equal_uint8(test, BIT_TEST(chunk_node_child(root, 1)->flags, NODE_FLAG_REALISED), 1, "test_chunk_node_build_lazy(): [1] realised");
+
+    node = chunk_node_child(root, 0);
+    is_equal_uint8(test, node->data[0], 9, "test_chunk_node_build_lazy(): [0] data");
+    is_equal_uint64(test, (uintptr_t)chunk_node_child(root, 4), 0, "test_chunk_node_build_lazy(): [4] out of range");
+    is_equal_uint64(test, chunk_node_size(root), 36, "test_chunk_node_build_lazy(): [] size realised");
+
+    chunk_node_destroy(root);
+}
+
+void test_chunk_node_trim(test_harness_t* test) {
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+    uint64_t addr[2] = {1, 2};
+    chunk_node_select(root, addr, 2);
+
+    uint64_t page = sizeof(chunk_btree_page_t);
+    uint64_t top = (4 * sizeof(chunk_node_t)) + page + (4 * sizeof(void*));
+    uint64_t full = top + (3 * sizeof(chunk_node_t)) + page + (3 * sizeof(void*));
+    is_equal_uint64(test, chunk_node_memory(root), full, "test_chunk_node_trim(): memory realised");
+    is_equal_uint64(test, chunk_node_trim(root, full), full, "test_chunk_node_trim(): within budget");
+    is_equal_uint8(test, BIT_TEST(chunk_node_child(root, 1)->flags, NODE_FLAG_REALISED), 1, "test_chunk_node_trim(): [1] kept");
+
+    is_equal_uint64(test, chunk_node_trim(root, 0), top, "test_chunk_node_trim(): trimmed");
+    is_equal_uint8(test, BIT_TEST(chunk_node_child(root, 1)->flags, NODE_FLAG_REALISED), 0, "test_chunk_node_trim(): [1] unrealised");
+    is_equal_uint64(test, chunk_node_size(root), 36, "test_chunk_node_trim(): size unchanged");
+
+    // touching it again brings it back from the buffer
+    chunk_node_t* node = chunk_node_select(root, addr, 2);
+    is_equal_uint8(test, node->type, 2, "test_chunk_node_trim(): [1:2] type after reload");
+
+    // dirty subtrees are pinned
+    chunk_node_set_insert(chunk_node_child(root, 1), 0);
+    chunk_node_trim(root, 0);
+    is_equal_uint8(test, BIT_TEST(chunk_node_child(root, 1)->flags, NODE_FLAG_REALISED), 1, "test_chunk_node_trim(): [1] dirty pinned");
+    is_equal_uint8(test, chunk_node_load_data_unrealise(chunk_node_child(root, 1)), 0, "test_chunk_node_trim(): [1] refuse unrealise");
+    is_equal_uint64(test, chunk_node_child(root, 1)->nr_children, 4, "test_chunk_node_trim(): [1] edit kept");
+
+    chunk_node_destroy(root);
+}
+
+void test_chunk_node_data_own(test_harness_t* test) {
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+    chunk_node_t* node = chunk_node_child(root, 0);
+
+    is_equal_uint64(test, (uintptr_t)node->data, (uintptr_t)&TEST_STRUCTURE[11], "test_chunk_node_data_own(): [0] borrowed");
+    is_equal_uint8(test, BIT_TEST(node->flags, NODE_FLAG_BORROWED), 1, "test_chunk_node_data_own(): [0] borrowed flag");
+    uint64_t top = (4 * sizeof(chunk_node_t)) + sizeof(chunk_btree_page_t) + (4 * sizeof(void*));
+    is_equal_uint64(test, chunk_node_memory(root), top, "test_chunk_node_data_own(): borrowed memory");
+
+    uint8_t* data = chunk_node_data_own(node);
+    is_equal_uint8(test, BIT_TEST(node->flags, NODE_FLAG_BORROWED), 0, "test_chunk_node_data_own(): [0] owned flag");
+    is_equal_uint8(test, (data != &TEST_STRUCTURE[11]), 1, "test_chunk_node_data_own(): [0] copied");
+    is_equal_uint8(test, data[0], 9, "test_chunk_node_data_own(): [0] data");
+    is_equal_uint8(test, (data == node->bytes), 1, "test_chunk_node_data_own(): [0] inline");
+    is_equal_uint64(test, chunk_node_memory(root), top, "test_chunk_node_data_own(): inline memory");
+    is_equal_uint64(test, (uintptr_t)chunk_node_data_own(node), (uintptr_t)data, "test_chunk_node_data_own(): [0] copied once");
+
+    chunk_node_destroy(root);
+}
+
+void test_chunk_node_data_insert(test_harness_t* test) {
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+    chunk_node_t* node = chunk_node_set_insert(root, 4);
+    chunk_node_set_type(node, CHUNK_TYPE_UTF8);
+
+    is_equal_uint8(test, chunk_node_data_insert(node, 0, (uint8_t*)"hllo", 4), 1, "test_chunk_node_data_insert(): insert");
+    is_equal_uint8(test, chunk_node_data_insert(node, 1, (uint8_t*)"\xc3\xa9", 2), 1, "test_chunk_node_data_insert(): insert middle");
+    is_equal_uint64(test, node->data_length, 6, "test_chunk_node_data_insert(): data_length");
+    is_equal_uint64(test, node->nr_children, 5, "test_chunk_node_data_insert(): nr_children");
+    is_equal_uint8(test, memcmp(chunk_node_data(node), "h\xc3\xa9llo", 6) == 0, 1, "test_chunk_node_data_insert(): data");
+    is_equal_uint8(test, chunk_node_data_insert(node, 7, (uint8_t*)"x", 1), 0, "test_chunk_node_data_insert(): out of range");
+
+    is_equal_uint8(test, chunk_node_data_delete(node, 1, 2), 1, "test_chunk_node_data_insert(): delete");
+    is_equal_uint64(test, node->nr_children, 4, "test_chunk_node_data_insert(): nr_children after delete");
+    is_equal_uint8(test, memcmp(chunk_node_data(node), "hllo", 4) == 0, 1, "test_chunk_node_data_insert(): data after delete");
+
+    // a borrowed leaf is copied into the gap buffer, not written through
+    node = chunk_node_child(root, 3);
+    uint8_t value = 7;
+    chunk_node_data_insert(node, 1, &value, 1);
+    is_equal_uint64(test, node->nr_children, 2, "test_chunk_node_data_insert(): [3] nr_children");
+    is_equal_uint8(test, chunk_node_data(node)[1], 7, "test_chunk_node_data_insert(): [3] data");
+    is_equal_uint8(test, TEST_STRUCTURE[35], 0x07, "test_chunk_node_data_insert(): source untouched");
+
+    chunk_node_destroy(root);
+}
+
+void test_chunk_node_inline(test_harness_t* test) {
+    chunk_node_t* root = chunk_node_build(TEST_STRUCTURE);
+    chunk_node_t* node = chunk_node_child(root, 0);
+    is_equal_uint8(test, BIT_TEST(node->flags, NODE_FLAG_INLINE), 1, "test_chunk_node_inline(): [0] inline");
+    is_equal_uint8(test, (node->data == node->bytes), 1, "test_chunk_node_inline(): [0] data in node");
+    is_equal_uint8(test, node->data[0], 9, "test_chunk_node_inline(): [0] data");
+    uint64_t nodes = (4 * sizeof(chunk_node_t)) + sizeof(chunk_btree_page_t) + (4 * sizeof(void*));
+    nodes += (3 * sizeof(chunk_node_t)) + sizeof(chunk_btree_page_t) + (3 * sizeof(void*));
+    is_equal_uint64(test, chunk_node_memory(root), nodes, "test_chunk_node_inline(): no payload memory");
+
+    // growing past the node moves the payload into a gap buffer
+    uint8_t bytes[CHUNK_NODE_INLINE] = {1, 2, 3, 4, 5, 6, 7, 8};
+    chunk_node_data_insert(node, 1, bytes, CHUNK_NODE_INLINE);
+    is_equal_uint8(test, BIT_TEST(node->flags, NODE_FLAG_INLINE), 0, "test_chunk_node_inline(): [0] moved out");
+    uint8_t* data = chunk_node_data(node);
+    is_equal_uint8(test, data[0], 9, "test_chunk_node_inline(): [0] first byte kept");
+    is_equal_uint8(test, data[CHUNK_NODE_INLINE], 8, "test_chunk_node_inline(): [0] last byte");
+    is_equal_uint64(test, chunk_node_size(node), 11, "test_chunk_node_inline(): [0] size");
+
+    is_equal_uint64(test, (uintptr_t)chunk_node_data(chunk_node_child(root, 1)), 0, "test_chunk_node_inline(): [1] set has no data");
+
+    // an emptied inline leaf leaves nothing behind for the set it becomes
+    node = chunk_node_child(root, 2);
+    is_equal_uint8(test, BIT_TEST(node->flags, NODE_FLAG_INLINE), 1, "test_chunk_node_inline(): [2] inline");
+    chunk_node_data_delete(node, 0, 1);
+    is_equal_uint8(test, chunk_node_set_type(node, CHUNK_TYPE_SET), 1, "test_chunk_node_inline(): [2] to set");
+    is_equal_uint64(test, (uintptr_t)node->block, 0, "test_chunk_node_inline(): [2] no block");
+    chunk_node_t* child = chunk_node_set_insert(node, 0);
+    is_equal_uint8(test, (chunk_node_child(node, 0) == child), 1, "test_chunk_node_inline(): [2:0] inserted");
+    is_equal_uint64(test, chunk_node_size(root), 9 + root->data_length, "test_chunk_node_inline(): [] consistent");
+
+    chunk_node_destroy(root);
+}
+
+void test_chunk_node_utf8_count(test_harness_t* test) {
+    // the payload ends the buffer, so nothing may be read past it
+    uint8_t leaf[] = {0x1b, 0x03, 0x68, 0xc3, 0xa9};
+    uint8_t* data = malloc(sizeof(leaf));
+    memcpy(data, leaf, sizeof(leaf));
+    chunk_node_t* node = chunk_node_build_lazy(data);
+    is_equal_uint64(test, node->nr_children, 2, "test_chunk_node_utf8_count(): characters");
+    chunk_node_destroy(node);
+    free(data);
+}
+
+void test_chunk_node_set_delete(test_harness_t* test) {
+    chunk_node_t* root = chunk_node_build(TEST_STRUCTURE);
+    chunk_node_t* last = chunk_node_child(root, 3);
+
+    is_equal_uint8(test, chunk_node_set_delete(root, 1), 1, "test_chunk_node_set_delete(): [1] deleted");
+    is_equal_uint64(test, root->nr_children, 3, "test_chunk_node_set_delete(): [] nr_children");
+    is_equal_uint8(test, chunk_node_child(root, 1)->type, 1, "test_chunk_node_set_delete(): [1] type");
+    is_equal_uint64(test, (uintptr_t)chunk_node_child(root, 2), (uintptr_t)last, "test_chunk_node_set_delete(): [2] same address");
+    is_equal_uint8(test, chunk_node_set_delete(root, 3), 0, "test_chunk_node_set_delete(): [3] out of range");
+
+    // a wide set: inserting keeps earlier children where they are
+    chunk_node_t* first = chunk_node_set_insert(root, 0);
+    for (uint64_t i = 0; i < 20000; i++) {
+        chunk_node_t* child = chunk_node_set_insert(root, (i % 3) ? root->nr_children - 1 : 1);
+        chunk_node_set_type(child, CHUNK_TYPE_UINT8);
+    }
+    is_equal_uint64(test, root->nr_children, 20004, "test_chunk_node_set_delete(): wide nr_children");
+    is_equal_uint64(test, (uintptr_t)chunk_node_child(root, 0), (uintptr_t)first, "test_chunk_node_set_delete(): first kept");
+    is_equal_uint64(test, (uintptr_t)chunk_node_child(root, 20003), (uintptr_t)last, "test_chunk_node_set_delete(): last kept");
+    for (uint64_t i = 0; i < 10000; i++) {
+        chunk_node_set_delete(root, 1);
+    }
+    is_equal_uint64(test, root->nr_children, 10004, "test_chunk_node_set_delete(): wide after delete");
+    is_equal_uint64(test, (uintptr_t)chunk_node_child(root, 10003), (uintptr_t)last, "test_chunk_node_set_delete(): last after delete");
+
+    chunk_node_destroy(root);
+}
+
+void test_chunk_node_size(test_harness_t* test) {
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+    uint64_t addr[2] = {1, 0};
+    chunk_node_t* set = chunk_node_select(root, addr, 1);
+    chunk_node_t* leaf = chunk_node_select(root, addr, 2);
+    is_equal_uint64(test, chunk_node_size(set), 18, "test_chunk_node_size(): [1] clean");
+    is_equal_uint8(test, BIT_TEST(root->flags, NODE_FLAG_DIRTY), 0, "test_chunk_node_size(): [] clean");
+
+    // 1 byte leaf grows by 2 bytes, both sets keep 8 byte headers
+    uint8_t bytes[2] = {1, 2};
+    chunk_node_data_insert(leaf, 1, bytes, 2);
+    is_equal_uint64(test, chunk_node_size(leaf), 5, "test_chunk_node_size(): [1:0] grown");
+    is_equal_uint64(test, chunk_node_size(set), 20, "test_chunk_node_size(): [1] grown");
+    is_equal_uint64(test, chunk_node_size(root), 38, "test_chunk_node_size(): [] grown");
+    is_equal_uint8(test, BIT_TEST(root->flags, NODE_FLAG_DIRTY), 1, "test_chunk_node_size(): [] dirty");
+    is_equal_uint64(test, root->data_length, 29, "test_chunk_node_size(): [] data_length");
+
+    // an empty leaf still has one length byte, an empty set has all 8
+    chunk_node_t* child = chunk_node_set_insert(set, 3);
+    is_equal_uint64(test, chunk_node_size(root), 40, "test_chunk_node_size(): [] with empty leaf");
+    chunk_node_set_type(child, CHUNK_TYPE_SET);
+    is_equal_uint64(test, chunk_node_size(root), 47, "test_chunk_node_size(): [] with empty set");
+
+    chunk_node_set_delete(root, 1);
+    is_equal_uint64(test, chunk_node_size(root), 18, "test_chunk_node_size(): [] after delete");
+    is_equal_uint64(test, chunk_node_size(root), 9 + root->data_length, "test_chunk_node_size(): [] consistent");
+
+    chunk_node_destroy(root);
+}
+
+void test_chunk_node_walk(test_harness_t* test) {
+    uint8_t types[16];
+    uint8_t depths[16];
+    uint64_t nr = 0;
+    chunk_node_t* node = NULL;
+    chunk_node_iter_t iter;
+    chunk_node_t* root = chunk_node_build(TEST_STRUCTURE);
+
+    chunk_node_iter_init(&iter, root, CHUNK_ITER_PRE_ORDER);
+    while (((node = chunk_node_iter_next(&iter)) != NULL) && (nr < 16)) {
+        types[nr] = node->type;
+        depths[nr++] = iter.depth;
+    }
+    chunk_node_iter_destroy(&iter);
+    uint8_t pre_types[8] = {0x0d, 0x01, 0x0d, 0x01, 0x01, 0x02, 0x01, 0x01};
+    uint8_t pre_depths[8] = {0, 1, 1, 2, 2, 2, 1, 1};
+    is_equal_uint64(test, nr, 8, "test_chunk_node_walk(): pre-order count");
+    is_equal_uint8(test, memcmp(types, pre_types, 8) == 0, 1, "test_chunk_node_walk(): pre-order types");
+    is_equal_uint8(test, memcmp(depths, pre_depths, 8) == 0, 1, "test_chunk_node_walk(): pre-order depths");
+
+    nr = 0;
+    chunk_node_iter_init(&iter, root, CHUNK_ITER_POST_ORDER);
+    while (((node = chunk_node_iter_next(&iter)) != NULL) && (nr < 16)) {
+        types[nr] = node->type;
+        depths[nr++] = iter.depth;
+        if (node->type == CHUNK_TYPE_SET) {
+            is_equal_uint8(test, types[nr - 2] != CHUNK_TYPE_SET, 1, "test_chunk_node_walk(): set after its children");
+        }
+    }
+    chunk_node_iter_destroy(&iter);
+    uint8_t post_types[8] = {0x01, 0x01, 0x01, 0x02, 0x0d, 0x01, 0x01, 0x0d};
+    uint8_t post_depths[8] = {1, 2, 2, 2, 1, 1, 1, 0};
+    is_equal_uint64(test, nr, 8, "test_chunk_node_walk(): post-order count");
+    is_equal_uint8(test, memcmp(types, post_types, 8) == 0, 1, "test_chunk_node_walk(): post-order types");
+    is_equal_uint8(test, memcmp(depths, post_depths, 8) == 0, 1, "test_chunk_node_walk(): post-order depths");
+
+    nr = 0;
+    chunk_node_iter_init(&iter, root, CHUNK_ITER_PRE_ORDER);
+    while ((node = chunk_node_iter_next(&iter)) != NULL) {
+        nr++;
+        if (iter.depth == 1) {
+            chunk_node_iter_skip(&iter);
+        }
+    }
+    chunk_node_iter_destroy(&iter);
+    is_equal_uint64(test, nr, 5, "test_chunk_node_walk(): skipped count");
+    chunk_node_destroy(root);
+
+    // sets that were never realised are not entered, unless realised on the way
+    root = chunk_node_build_lazy(TEST_STRUCTURE);
+    nr = 0;
+    chunk_node_iter_init(&iter, root, CHUNK_ITER_PRE_ORDER);
+    while ((node = chunk_node_iter_next(&iter)) != NULL) {
+        nr++;
+    }
+    chunk_node_iter_destroy(&iter);
+    is_equal_uint64(test, nr, 1, "test_chunk_node_walk(): lazy root only");
+    nr = 0;
+    chunk_node_iter_init(&iter, root, CHUNK_ITER_PRE_ORDER);
+    while ((node = chunk_node_iter_next(&iter)) != NULL) {
+        chunk_node_realise(node);
+        nr++;
+    }
+    chunk_node_iter_destroy(&iter);
+    is_equal_uint64(test, nr, 8, "test_chunk_node_walk(): realised on the way");
+    chunk_node_destroy(root);
+}
+
+void test_chunk_node_walk_deep(test_harness_t* test) {
+    // deep enough that walking it on the C stack would overflow
+    uint64_t depth = 100000;
+    uint8_t* data = malloc((depth * 9) + 3);
+    uint8_t* walk = data;
+    for (uint64_t i = 0; i < depth; i++) {
+        walk = chunk_write_header(walk, CHUNK_TYPE_SET, ((depth - i - 1) * 9) + 3);
+    }
+    walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+    *walk = 0x2a;
+
+    chunk_node_t* root = chunk_node_build(data);
+    chunk_node_t* node = root;
+    uint64_t nr = 0;
+    while (node->type == CHUNK_TYPE_SET) {
+        node = &node->block[0];
+        nr++;
+    }
+    is_equal_uint64(test, nr, depth, "test_chunk_node_walk_deep(): built depth");
+    is_equal_uint8(test, chunk_node_data(node)[0], 0x2a, "test_chunk_node_walk_deep(): leaf data");
+    is_equal_uint8(test, chunk_node_memory(root) > 0, 1, "test_chunk_node_walk_deep(): memory");
+
+    // sets above the grain are split on the calling thread
+    chunk_arena_t* arena = chunk_arena_create(0);
+    chunk_node_t* split = chunk_node_build_parallel(data, arena, 2);
+    chunk_node_t* bottom = split;
+    nr = 0;
+    while (bottom->type == CHUNK_TYPE_SET) {
+        bottom = chunk_node_child(bottom, 0);
+        nr++;
+    }
+    is_equal_uint64(test, nr, depth, "test_chunk_node_walk_deep(): split depth");
+    is_equal_uint8(test, chunk_node_data(bottom)[0], 0x2a, "test_chunk_node_walk_deep(): split leaf data");
+    chunk_node_destroy_arena(split, arena);
+
+    // an edit at the bottom dirties the whole path, which then has to be
+    // cleaned again
+    uint8_t value = 0x2b;
+    chunk_node_data_delete(node, 0, 1);
+    chunk_node_data_insert(node, 0, &value, 1);
+    is_equal_uint8(test, BIT_TEST(root->flags, NODE_FLAG_DIRTY), 1, "test_chunk_node_walk_deep(): dirty");
+    chunk_snap_t* snap = chunk_snap_take(root);
+    uint8_t* encoded = malloc(chunk_snap_size(snap));
+    uint8_t* end = chunk_snap_encode(snap, encoded);
+    is_equal_uint64(test, end - encoded, (depth * 9) + 3, "test_chunk_node_walk_deep(): snapshot size");
+    is_equal_uint8(test, encoded[(depth * 9) + 2], 0x2b, "test_chunk_node_walk_deep(): snapshot edit");
+    chunk_snap_release(snap);
+    free(encoded);
+    chunk_node_clean(root);
+    is_equal_uint8(test, BIT_TEST(root->flags, NODE_FLAG_DIRTY), 0, "test_chunk_node_walk_deep(): clean");
+    is_equal_uint8(test, chunk_node_data(node)[0], 0x2a, "test_chunk_node_walk_deep(): back to the buffer");
+
+    chunk_node_destroy(root);
+    free(data);
+}
+
 int main(int argc, char** argv) {
     test_harness_t test;
     test_harness_init(&test);
@@ -120,6 +526,18 @@ int main(int argc, char** argv) {
 
     test_chunk_node_build(&test);
     test_chunk_node_set_insert(&test);
+    test_chunk_node_build_arena(&test);
+    test_chunk_node_build_parallel(&test);
+    test_chunk_node_build_lazy(&test);
+    test_chunk_node_trim(&test);
+    test_chunk_node_data_own(&test);
+    test_chunk_node_data_insert(&test);
+    test_chunk_node_inline(&test);
+    test_chunk_node_utf8_count(&test);
+    test_chunk_node_set_delete(&test);
+    test_chunk_node_size(&test);
+    test_chunk_node_walk(&test);
+    test_chunk_node_walk_deep(&test);
 
     test_harness_report(&test);
     return 0;
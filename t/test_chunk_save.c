@@ -0,0 +1,372 @@
+#include "../chunk_save.h"
+#include "../chunk_node.h"
+#include "../chunk_builder.h"
+#include "test_harness.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../bitwise.h"
+
+uint8_t TEST_STRUCTURE[] = {
+    0x8d, 0x1b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x01, 0x09,
+    0x8d, 0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x01, 0x09,
+    0x11, 0x01, 0x08,
+    0x12, 0x01, 0x07,
+    0x11, 0x01, 0x08,
+    0x11, 0x01, 0x07
+};
+
+// [1:0] grown from 09 to 09 01 02
+uint8_t TEST_EDITED[] = {
+    0x8d, 0x1d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x01, 0x09,
+    0x8d, 0x0b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x03, 0x09, 0x01, 0x02,
+    0x11, 0x01, 0x08,
+    0x12, 0x01, 0x07,
+    0x11, 0x01, 0x08,
+    0x11, 0x01, 0x07
+};
+
+static uint64_t read_back(int fd, uint8_t* buf, uint64_t size) {
+    lseek(fd, 0, SEEK_SET);
+    ssize_t nr_read = read(fd, buf, size);
+    return (nr_read < 0) ? 0 : (uint64_t)nr_read;
+}
+
+void test_chunk_save_fd(test_harness_t* test) {
+    char path[] = "/tmp/test_chunk_save_XXXXXX";
+    int fd = mkstemp(path);
+    unlink(path);
+    uint8_t buf[64];
+    chunk_save_stats_t stats;
+
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+    is_equal_uint8(test, chunk_save_fd(root, fd, &stats), 1, "test_chunk_save_fd(): clean ok");
+    is_equal_uint64(test, read_back(fd, buf, 64), 36, "test_chunk_save_fd(): clean size");
+    is_equal_uint8(test, memcmp(buf, TEST_STRUCTURE, 36) == 0, 1, "test_chunk_save_fd(): clean bytes");
+    is_equal_uint64(test, stats.nr_iovecs, 1, "test_chunk_save_fd(): clean is one span");
+    is_equal_uint64(test, stats.nr_reused, 36, "test_chunk_save_fd(): clean reused");
+
+    uint64_t addr[2] = {1, 0};
+    uint8_t bytes[2] = {1, 2};
+    chunk_node_data_insert(chunk_node_select(root, addr, 2), 1, bytes, 2);
+
+    ftruncate(fd, 0);
+    lseek(fd, 0, SEEK_SET);
+    is_equal_uint8(test, chunk_save_fd(root, fd, &stats), 1, "test_chunk_save_fd(): edited ok");
+    is_equal_uint64(test, read_back(fd, buf, 64), 38, "test_chunk_save_fd(): edited size");
+    is_equal_uint8(test, memcmp(buf, TEST_EDITED, 38) == 0, 1, "test_chunk_save_fd(): edited bytes");
+    is_equal_uint64(test, stats.nr_bytes, chunk_node_size(root), "test_chunk_save_fd(): matches size");
+    is_equal_uint64(test, stats.nr_reused, 15, "test_chunk_save_fd(): edited reused");
+    is_equal_uint8(test, chunk_validate(buf, 38, NULL), CHUNK_OK, "test_chunk_save_fd(): edited valid");
+
+    chunk_node_destroy(root);
+    close(fd);
+}
+
+// Saves node and checks the file and a snapshot both hold expected.
+static void check_saved(test_harness_t* test, chunk_node_t* root, uint8_t* expected, uint64_t size, const char* name) {
+    char path[] = "/tmp/test_chunk_save_XXXXXX";
+    int fd = mkstemp(path);
+    unlink(path);
+    uint8_t buf[64];
+    uint8_t encoded[64];
+    char message[128];
+
+    snprintf(message, sizeof(message), "test_chunk_save_forms(): %s size", name);
+    is_equal_uint64(test, chunk_node_size(root), size, message);
+    chunk_save_fd(root, fd, NULL);
+    snprintf(message, sizeof(message), "test_chunk_save_forms(): %s bytes", name);
+    is_equal_uint8(test, (read_back(fd, buf, 64) == size) && (memcmp(buf, expected, size) == 0), 1, message);
+    snprintf(message, sizeof(message), "test_chunk_save_forms(): %s valid", name);
+    is_equal_uint8(test, chunk_validate(buf, size, NULL), CHUNK_OK, message);
+
+    chunk_snap_t* snap = chunk_snap_take(root);
+    uint64_t encoded_size = chunk_snap_encode(snap, encoded) - encoded;
+    snprintf(message, sizeof(message), "test_chunk_save_forms(): %s snapshot", name);
+    is_equal_uint8(test, (encoded_size == size) && (memcmp(encoded, expected, size) == 0), 1, message);
+    chunk_snap_release(snap);
+    close(fd);
+}
+
+void test_chunk_save_forms(test_harness_t* test) {
+    uint8_t value = 0x2a;
+
+    uint8_t compact[] = {0xfd, 0x06, 0xf1, 0x01, 0x09, 0xf2, 0x01, 0x07};
+    uint8_t compact_edited[] = {0xfd, 0x07, 0xf1, 0x02, 0x09, 0x2a, 0xf2, 0x01, 0x07};
+    chunk_node_t* root = chunk_node_build_lazy(compact);
+    chunk_node_data_insert(chunk_node_child(root, 0), 1, &value, 1);
+    check_saved(test, root, compact_edited, 9, "compact");
+    chunk_node_destroy(root);
+
+    uint8_t counted[] = {0xed, 0x06, 0x02, 0xf1, 0x01, 0x09, 0x12, 0x01, 0x07};
+    uint8_t counted_edited[] = {0xed, 0x03, 0x01, 0xf1, 0x01, 0x09};
+    root = chunk_node_build_lazy(counted);
+    chunk_node_set_delete(root, 1);
+    check_saved(test, root, counted_edited, 6, "counted");
+    chunk_node_destroy(root);
+
+    // the uint32 payload sits at offset 12, aligned by a redundant length byte
+    uint8_t aligned[] = {
+        0x8d, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x25, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00
+    };
+    uint8_t aligned_edited[] = {
+        0x8d, 0x0b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x25, 0x08, 0x00, 0x01, 0x00, 0x00, 0x00, 0x2a, 0x2a, 0x2a, 0x2a
+    };
+    uint8_t values[4] = {0x2a, 0x2a, 0x2a, 0x2a};
+    root = chunk_node_build_lazy(aligned);
+    chunk_node_data_insert(chunk_node_child(root, 0), 4, values, 4);
+    check_saved(test, root, aligned_edited, 20, "aligned");
+    chunk_node_destroy(root);
+
+    // a length that outgrows its field widens it
+    uint8_t grown[140];
+    memset(grown, 0x2a, sizeof(grown));
+    root = chunk_node_build_lazy(compact);
+    chunk_node_data_insert(chunk_node_child(root, 0), 1, grown, 128);
+    is_equal_uint64(test, chunk_node_child(root, 0)->nr_length_bytes, 2, "test_chunk_save_forms(): grown leaf widened");
+    is_equal_uint64(test, chunk_node_size(root), 3 + 3 + 129 + 3, "test_chunk_save_forms(): grown set widened");
+    chunk_node_destroy(root);
+}
+
+void test_chunk_save_file(test_harness_t* test) {
+    char path[] = "/tmp/test_chunk_save_XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+
+    chunk_node_t* root = chunk_node_build(TEST_STRUCTURE);
+    chunk_node_t* child = chunk_node_set_insert(root, 4);
+    chunk_node_set_type(child, CHUNK_TYPE_UINT8);
+    uint8_t value = 0x2a;
+    chunk_node_data_insert(child, 0, &value, 1);
+    is_equal_uint8(test, chunk_save_file(root, path, NULL), 1, "test_chunk_save_file(): ok");
+
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    is_equal_uint8(test, access(tmp, F_OK) != 0, 1, "test_chunk_save_file(): no temp left");
+
+    uint8_t buf[64];
+    FILE* file = fopen(path, "rb");
+    uint64_t nr_read = fread(buf, 1, 64, file);
+    fclose(file);
+    is_equal_uint64(test, nr_read, 39, "test_chunk_save_file(): size");
+    is_equal_uint8(test, memcmp(&buf[9], &TEST_STRUCTURE[9], 27) == 0, 1, "test_chunk_save_file(): children kept");
+    is_equal_uint8(test, buf[38], 0x2a, "test_chunk_save_file(): appended");
+
+    chunk_node_destroy(root);
+    unlink(path);
+}
+
+void test_chunk_save_snap_fd(test_harness_t* test) {
+    char path[] = "/tmp/test_chunk_save_XXXXXX";
+    int fd = mkstemp(path);
+    unlink(path);
+    uint8_t buf[64];
+    chunk_save_stats_t stats;
+
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+    uint64_t addr[2] = {1, 0};
+    uint8_t bytes[2] = {1, 2};
+    chunk_node_t* leaf = chunk_node_select(root, addr, 2);
+    chunk_node_data_insert(leaf, 1, bytes, 2);
+    chunk_snap_t* snap = chunk_snap_take(root);
+
+    // edits after the snapshot do not reach the file
+    chunk_node_data_delete(leaf, 0, 3);
+    is_equal_uint8(test, chunk_save_snap_fd(snap, fd, &stats), 1, "test_chunk_save_snap_fd(): ok");
+    is_equal_uint64(test, read_back(fd, buf, 64), 38, "test_chunk_save_snap_fd(): size");
+    is_equal_uint8(test, memcmp(buf, TEST_EDITED, 38) == 0, 1, "test_chunk_save_snap_fd(): bytes");
+    is_equal_uint64(test, stats.nr_reused, 15, "test_chunk_save_snap_fd(): reused");
+
+    chunk_snap_release(snap);
+    chunk_node_destroy(root);
+    close(fd);
+}
+
+void test_chunk_save_snap_deep(test_harness_t* test) {
+    // deep enough that walking it on the C stack would overflow
+    uint64_t depth = 100000;
+    uint64_t size = (depth * 9) + 3;
+    uint8_t* data = malloc(size);
+    uint8_t* walk = data;
+    for (uint64_t i = 0; i < depth; i++) {
+        walk = chunk_write_header(walk, CHUNK_TYPE_SET, ((depth - i - 1) * 9) + 3);
+    }
+    walk = chunk_write_header(walk, CHUNK_TYPE_UINT8, 1);
+    *walk = 0x2a;
+
+    chunk_node_t* root = chunk_node_build(data);
+    chunk_node_t* node = root;
+    while (node->type == CHUNK_TYPE_SET) {
+        node = chunk_node_child(node, 0);
+    }
+    uint8_t value = 0x2b;
+    chunk_node_data_delete(node, 0, 1);
+    chunk_node_data_insert(node, 0, &value, 1);
+    chunk_snap_t* snap = chunk_snap_take(root);
+
+    char path[] = "/tmp/test_chunk_save_XXXXXX";
+    int fd = mkstemp(path);
+    unlink(path);
+    is_equal_uint8(test, chunk_save_snap_fd(snap, fd, NULL), 1, "test_chunk_save_snap_deep(): ok");
+    uint8_t* buf = malloc(size + 1);
+    is_equal_uint64(test, read_back(fd, buf, size + 1), size, "test_chunk_save_snap_deep(): size");
+    data[size - 1] = 0x2b;
+    is_equal_uint8(test, memcmp(buf, data, size) == 0, 1, "test_chunk_save_snap_deep(): bytes");
+
+    chunk_snap_release(snap);
+    chunk_node_destroy(root);
+    free(buf);
+    free(data);
+    close(fd);
+}
+
+void test_chunk_save_patch(test_harness_t* test) {
+    char path[] = "/tmp/test_chunk_save_XXXXXX";
+    int fd = mkstemp(path);
+    unlink(path);
+    write(fd, TEST_STRUCTURE, 36);
+    uint8_t* map = mmap(0, 36, PROT_READ, MAP_SHARED, fd, 0);
+    uint8_t buf[64];
+    chunk_save_stats_t stats;
+
+    chunk_node_t* root = chunk_node_build_lazy(map);
+    is_equal_uint8(test, chunk_save_patch(root, fd, map, &stats), 1, "test_chunk_save_patch(): clean ok");
+    is_equal_uint64(test, stats.nr_writes, 0, "test_chunk_save_patch(): clean writes nothing");
+
+    uint64_t addr[2] = {1, 0};
+    chunk_node_t* leaf = chunk_node_select(root, addr, 2);
+    uint8_t value = 0x2a;
+    chunk_node_data_delete(leaf, 0, 1);
+    chunk_node_data_insert(leaf, 0, &value, 1);
+    is_equal_uint8(test, chunk_save_patch(root, fd, map, &stats), 1, "test_chunk_save_patch(): same size ok");
+    is_equal_uint64(test, stats.nr_patches, 1, "test_chunk_save_patch(): one patch");
+    is_equal_uint64(test, stats.nr_bytes, 1, "test_chunk_save_patch(): one byte");
+    is_equal_uint64(test, read_back(fd, buf, 64), 36, "test_chunk_save_patch(): size kept");
+    is_equal_uint8(test, buf[23], 0x2a, "test_chunk_save_patch(): byte written");
+    is_equal_uint8(test, memcmp(buf, map, 36) == 0, 1, "test_chunk_save_patch(): mapping matches");
+
+    chunk_node_clean(root);
+    is_equal_uint8(test, BIT_TEST(root->flags, NODE_FLAG_DIRTY), 0, "test_chunk_save_patch(): clean root");
+    is_equal_uint8(test, BIT_TEST(leaf->flags, NODE_FLAG_BORROWED), 1, "test_chunk_save_patch(): leaf borrows again");
+    is_equal_uint8(test, chunk_node_data(leaf)[0], 0x2a, "test_chunk_save_patch(): leaf value");
+
+    chunk_snap_t* held = chunk_snap_take(root);
+    is_equal_uint64(test, chunk_snap_nr_borrowed(root), 1, "test_chunk_save_patch(): snapshot borrows");
+    value = 0x2b;
+    chunk_node_data_delete(leaf, 0, 1);
+    chunk_node_data_insert(leaf, 0, &value, 1);
+    chunk_snap_release(chunk_snap_take(root));
+    is_equal_uint8(test, chunk_save_patch(root, fd, map, &stats), 0, "test_chunk_save_patch(): held snapshot refused");
+    is_equal_uint64(test, stats.nr_writes, 0, "test_chunk_save_patch(): held snapshot writes nothing");
+    is_equal_uint8(test, map[23], 0x2a, "test_chunk_save_patch(): held snapshot unchanged");
+    chunk_snap_release(held);
+    is_equal_uint64(test, chunk_snap_nr_borrowed(root), 0, "test_chunk_save_patch(): nothing borrowed");
+
+    // a snapshot of a tree read from another buffer does not stand in the way
+    chunk_node_t* other = chunk_node_build_lazy(TEST_STRUCTURE);
+    chunk_snap_t* other_held = chunk_snap_take(other);
+    is_equal_uint64(test, chunk_snap_nr_borrowed(other), 1, "test_chunk_save_patch(): other tree borrows");
+    is_equal_uint64(test, chunk_snap_nr_borrowed(root), 0, "test_chunk_save_patch(): counted per buffer");
+    is_equal_uint8(test, chunk_save_patch(root, fd, map, &stats), 1, "test_chunk_save_patch(): released ok");
+    chunk_snap_release(other_held);
+    chunk_node_destroy(other);
+    is_equal_uint8(test, map[23], 0x2b, "test_chunk_save_patch(): released byte written");
+    chunk_node_clean(root);
+
+    chunk_node_data_insert(leaf, 1, &value, 1);
+    is_equal_uint8(test, chunk_save_patch(root, fd, map, &stats), 0, "test_chunk_save_patch(): grown refused");
+    is_equal_uint64(test, stats.nr_writes, 0, "test_chunk_save_patch(): grown writes nothing");
+    chunk_node_data_delete(leaf, 1, 1);
+
+    chunk_node_set_delete(chunk_node_child(root, 1), 2);
+    chunk_node_t* child = chunk_node_set_insert(chunk_node_child(root, 1), 2);
+    chunk_node_set_type(child, CHUNK_TYPE_INT16);
+    chunk_node_data_insert(child, 0, &value, 1);
+    is_equal_uint64(test, chunk_node_size(root), 36, "test_chunk_save_patch(): replaced child same size");
+    is_equal_uint8(test, chunk_save_patch(root, fd, map, &stats), 0, "test_chunk_save_patch(): new child refused");
+
+    chunk_node_destroy(root);
+    munmap(map, 36);
+    close(fd);
+}
+
+void test_chunk_save_patch_forms(test_harness_t* test) {
+    uint8_t flags[4] = {0, CHUNK_BUILDER_COMPACT, CHUNK_BUILDER_COUNTED, CHUNK_BUILDER_ALIGNED};
+    const char* names[4] = {"fixed", "compact", "counted", "aligned"};
+    char message[128];
+
+    for (uint8_t i = 0; i < 4; i++) {
+        chunk_builder_t builder;
+        uint64_t size = 0;
+        uint32_t id = 7;
+        uint8_t flag = 1;
+        chunk_builder_init(&builder, NULL, 0, flags[i]);
+        chunk_builder_begin_set(&builder);
+        chunk_builder_append(&builder, CHUNK_TYPE_UINT32, (uint8_t*)&id, 4);
+        chunk_builder_begin_set(&builder);
+        chunk_builder_append(&builder, CHUNK_TYPE_UINT8, &flag, 1);
+        chunk_builder_append(&builder, CHUNK_TYPE_UTF8, (uint8_t*)"name", 4);
+        chunk_builder_end_set(&builder);
+        chunk_builder_end_set(&builder);
+        uint8_t* document = chunk_builder_finish(&builder, &size);
+
+        char path[] = "/tmp/test_chunk_save_XXXXXX";
+        int fd = mkstemp(path);
+        unlink(path);
+        write(fd, document, size);
+        chunk_builder_destroy(&builder);
+        uint8_t* map = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+        chunk_node_t* root = chunk_node_build_lazy(map);
+
+        id = 8;
+        chunk_node_t* leaf = chunk_node_child(root, 0);
+        chunk_node_data_delete(leaf, 0, 4);
+        chunk_node_data_insert(leaf, 0, (uint8_t*)&id, 4);
+        leaf = chunk_node_child(chunk_node_child(root, 1), 1);
+        chunk_node_data_delete(leaf, 0, 4);
+        chunk_node_data_insert(leaf, 0, (uint8_t*)"same", 4);
+
+        snprintf(message, sizeof(message), "test_chunk_save_patch_forms(): %s size kept", names[i]);
+        is_equal_uint64(test, chunk_node_size(root), size, message);
+        chunk_save_stats_t stats;
+        snprintf(message, sizeof(message), "test_chunk_save_patch_forms(): %s patched", names[i]);
+        is_equal_uint8(test, chunk_save_patch(root, fd, map, &stats), 1, message);
+        snprintf(message, sizeof(message), "test_chunk_save_patch_forms(): %s two patches", names[i]);
+        is_equal_uint64(test, stats.nr_patches, 2, message);
+        snprintf(message, sizeof(message), "test_chunk_save_patch_forms(): %s valid", names[i]);
+        is_equal_uint8(test, chunk_validate(map, size, NULL), CHUNK_OK, message);
+        chunk_node_t* again = chunk_node_build_lazy(map);
+        snprintf(message, sizeof(message), "test_chunk_save_patch_forms(): %s reads back", names[i]);
+        is_equal_uint8(test, memcmp(chunk_node_data(chunk_node_child(again, 0)), &id, 4) == 0, 1, message);
+
+        chunk_node_destroy(again);
+        chunk_node_destroy(root);
+        munmap(map, size);
+        close(fd);
+    }
+}
+
+int main(int argc, char** argv) {
+    test_harness_t test;
+    test_harness_init(&test);
+    test.verbose = 1;
+
+    test_chunk_save_fd(&test);
+    test_chunk_save_forms(&test);
+    test_chunk_save_file(&test);
+    test_chunk_save_snap_fd(&test);
+    test_chunk_save_snap_deep(&test);
+    test_chunk_save_patch(&test);
+    test_chunk_save_patch_forms(&test);
+
+    test_harness_report(&test);
+    return 0;
+}
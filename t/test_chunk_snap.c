@@ -0,0 +1,153 @@
+#include "../chunk_snap.h"
+#include "../chunk_node.h"
+#include "test_harness.h"
+#include <stdio.h>
+#include <string.h>
+
+uint8_t TEST_STRUCTURE[] = {
+    0x8d, 0x1b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x01, 0x09,
+    0x8d, 0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x01, 0x09,
+    0x11, 0x01, 0x08,
+    0x12, 0x01, 0x07,
+    0x11, 0x01, 0x08,
+    0x11, 0x01, 0x07
+};
+
+// [1:0] grown from 09 to 09 01 02
+uint8_t TEST_EDITED[] = {
+    0x8d, 0x1d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x01, 0x09,
+    0x8d, 0x0b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x03, 0x09, 0x01, 0x02,
+    0x11, 0x01, 0x08,
+    0x12, 0x01, 0x07,
+    0x11, 0x01, 0x08,
+    0x11, 0x01, 0x07
+};
+
+void test_chunk_snap_take(test_harness_t* test) {
+    uint8_t buf[64];
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+
+    chunk_snap_t* clean = chunk_snap_take(root);
+    is_equal_uint8(test, clean->kind, CHUNK_SNAP_BYTES, "test_chunk_snap_take(): clean is bytes");
+    is_equal_uint64(test, chunk_snap_size(clean), 36, "test_chunk_snap_take(): clean size");
+    is_equal_uint8(test, clean->data == TEST_STRUCTURE, 1, "test_chunk_snap_take(): clean shares the source");
+
+    uint64_t addr[2] = {1, 0};
+    uint8_t bytes[2] = {1, 2};
+    chunk_node_data_insert(chunk_node_select(root, addr, 2), 1, bytes, 2);
+
+    chunk_snap_t* edited = chunk_snap_take(root);
+    is_equal_uint8(test, edited->kind, CHUNK_SNAP_SET, "test_chunk_snap_take(): edited is set");
+    is_equal_uint64(test, chunk_snap_size(edited), 38, "test_chunk_snap_take(): edited size");
+    is_equal_uint64(test, edited->nr_parts, 3, "test_chunk_snap_take(): edited parts");
+    is_equal_uint64(test, edited->parts[2]->nr_items, 2, "test_chunk_snap_take(): untouched neighbours merged");
+    is_equal_uint64(test, chunk_snap_encode(edited, buf) - buf, 38, "test_chunk_snap_take(): edited encoded size");
+    is_equal_uint8(test, memcmp(buf, TEST_EDITED, 38) == 0, 1, "test_chunk_snap_take(): edited bytes");
+    chunk_snap_encode(clean, buf);
+    is_equal_uint8(test, memcmp(buf, TEST_STRUCTURE, 36) == 0, 1, "test_chunk_snap_take(): clean kept");
+
+    chunk_snap_t* again = chunk_snap_take(root);
+    is_equal_uint8(test, again == edited, 1, "test_chunk_snap_take(): unchanged tree reuses snapshot");
+    chunk_snap_release(again);
+
+    // only the path to the new edit is copied
+    uint64_t last[1] = {3};
+    uint8_t value = 0x2a;
+    chunk_node_data_insert(chunk_node_select(root, last, 1), 1, &value, 1);
+    chunk_snap_t* later = chunk_snap_take(root);
+    is_equal_uint8(test, later != edited, 1, "test_chunk_snap_take(): new root");
+    is_equal_uint8(test, later->parts[1] == edited->parts[1], 1, "test_chunk_snap_take(): [1] shared");
+    is_equal_uint64(test, later->nr_parts, 4, "test_chunk_snap_take(): later parts");
+    is_equal_uint64(test, chunk_snap_size(later), chunk_node_size(root), "test_chunk_snap_take(): later size");
+
+    chunk_snap_release(clean);
+    chunk_snap_release(edited);
+    chunk_snap_release(later);
+    chunk_node_destroy(root);
+}
+
+void test_chunk_snap_navigate(test_harness_t* test) {
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+    chunk_snap_node_t node;
+
+    chunk_snap_t* clean = chunk_snap_take(root);
+    uint64_t path[2] = {1, 2};
+    is_equal_uint8(test, chunk_snap_select(clean, path, 2, &node), 1, "test_chunk_snap_navigate(): clean [1:2]");
+    is_equal_uint8(test, chunk_snap_chunk(node).type, CHUNK_TYPE_INT8, "test_chunk_snap_navigate(): clean [1:2] type");
+    is_equal_uint8(test, chunk_snap_chunk(node).data[0], 7, "test_chunk_snap_navigate(): clean [1:2] data");
+    is_equal_uint64(test, chunk_snap_nr_children(chunk_snap_root(clean)), 4, "test_chunk_snap_navigate(): clean nr_children");
+
+    path[1] = 0;
+    uint8_t bytes[2] = {1, 2};
+    chunk_node_data_insert(chunk_node_select(root, path, 2), 1, bytes, 2);
+    chunk_snap_t* edited = chunk_snap_take(root);
+    chunk_snap_node_t top = chunk_snap_root(edited);
+    is_equal_uint64(test, chunk_snap_nr_children(top), 4, "test_chunk_snap_navigate(): root nr_children");
+    is_equal_uint8(test, chunk_snap_chunk(top).type, CHUNK_TYPE_SET, "test_chunk_snap_navigate(): root type");
+    is_equal_uint64(test, chunk_snap_chunk(top).data_length, 29, "test_chunk_snap_navigate(): root data_length");
+    is_equal_uint8(test, chunk_snap_select(edited, path, 2, &node), 1, "test_chunk_snap_navigate(): [1:0]");
+    is_equal_uint8(test, node.part->kind, CHUNK_SNAP_LEAF, "test_chunk_snap_navigate(): [1:0] copied");
+    is_equal_uint64(test, chunk_snap_chunk(node).data_length, 3, "test_chunk_snap_navigate(): [1:0] data_length");
+    is_equal_uint8(test, chunk_snap_chunk(node).data[2], 2, "test_chunk_snap_navigate(): [1:0] data");
+    is_equal_uint8(test, chunk_snap_child(node, 0, &node), 0, "test_chunk_snap_navigate(): leaf has no children");
+    is_equal_uint8(test, chunk_snap_child(top, 1, &node), 1, "test_chunk_snap_navigate(): [1]");
+    is_equal_uint64(test, chunk_snap_nr_children(node), 3, "test_chunk_snap_navigate(): [1] nr_children");
+    is_equal_uint8(test, chunk_snap_child(node, 3, &node), 0, "test_chunk_snap_navigate(): [1:3] out of range");
+    is_equal_uint8(test, chunk_snap_child(top, 3, &node), 1, "test_chunk_snap_navigate(): [3]");
+    is_equal_uint8(test, node.address == &TEST_STRUCTURE[33], 1, "test_chunk_snap_navigate(): [3] in the merged run");
+
+    // the snapshot reads the same after the tree moves on
+    uint64_t last[1] = {3};
+    uint8_t value = 0x2a;
+    chunk_node_data_insert(chunk_node_select(root, last, 1), 1, &value, 1);
+    chunk_snap_t* later = chunk_snap_take(root);
+    chunk_snap_select(later, last, 1, &node);
+    is_equal_uint64(test, chunk_snap_chunk(node).data_length, 2, "test_chunk_snap_navigate(): later [3] grown");
+    chunk_snap_select(edited, last, 1, &node);
+    is_equal_uint64(test, chunk_snap_chunk(node).data_length, 1, "test_chunk_snap_navigate(): edited [3] kept");
+    uint64_t past[3] = {1, 0, 0};
+    is_equal_uint8(test, chunk_snap_select(edited, past, 3, &node), 0, "test_chunk_snap_navigate(): path past a leaf");
+
+    chunk_snap_release(clean);
+    chunk_snap_release(edited);
+    chunk_snap_release(later);
+    chunk_node_destroy(root);
+}
+
+void test_chunk_snap_outlives_tree(test_harness_t* test) {
+    uint8_t buf[64];
+    chunk_node_t* root = chunk_node_build_lazy(TEST_STRUCTURE);
+    chunk_node_t* child = chunk_node_set_insert(root, 4);
+    chunk_node_set_type(child, CHUNK_TYPE_UINT8);
+    uint8_t value = 0x2a;
+    chunk_node_data_insert(child, 0, &value, 1);
+
+    chunk_snap_t* snap = chunk_snap_take(root);
+    chunk_node_set_delete(root, 4);
+    chunk_node_set_delete(root, 1);
+    is_equal_uint64(test, chunk_node_size(root), 18, "test_chunk_snap_outlives_tree(): tree shrunk");
+    chunk_node_destroy(root);
+
+    is_equal_uint64(test, chunk_snap_encode(snap, buf) - buf, 39, "test_chunk_snap_outlives_tree(): size");
+    is_equal_uint8(test, chunk_validate(buf, 39, NULL), CHUNK_OK, "test_chunk_snap_outlives_tree(): valid");
+    is_equal_uint8(test, memcmp(&buf[9], &TEST_STRUCTURE[9], 27) == 0, 1, "test_chunk_snap_outlives_tree(): children kept");
+    is_equal_uint8(test, buf[38], 0x2a, "test_chunk_snap_outlives_tree(): inserted child");
+    chunk_snap_release(snap);
+}
+
+int main(int argc, char** argv) {
+    test_harness_t test;
+    test_harness_init(&test);
+    test.verbose = 1;
+
+    test_chunk_snap_take(&test);
+    test_chunk_snap_navigate(&test);
+    test_chunk_snap_outlives_tree(&test);
+
+    test_harness_report(&test);
+    return 0;
+}
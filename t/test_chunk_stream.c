@@ -0,0 +1,183 @@
+#include "../chunk_stream.h"
+#include "test_harness.h"
+#include <stdio.h>
+#include <string.h>
+
+uint8_t TEST_STRUCTURE[] = {
+    0x8d, // 8 length bytes, data type 12
+    0x1b, // 27 bytes long
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x15, //   1 length byte, data type 5
+    0x01, //   1 bytes long
+    0x09, //   data (9)
+    0x8d, //   1 length byte, data type 12
+    0x09, //   9 bytes long
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x15, //     1 length byte, data type 5
+    0x01, //     1 bytes long
+    0x09, //     data (9)
+    0x11, //     1 length byte, data type 1
+    0x01, //     1 bytes long
+    0x08, //     data (8)
+    0x12, //     1 length byte, data type 2
+    0x01, //     1 bytes long
+    0x07, //     data (7)
+    0x13, //   1 length byte, data type 3
+    0x01, //   1 bytes long
+    0x08, //   data (8)
+    0x12, //   1 length byte, data type 2
+    0x01, //   1 bytes long
+    0x07  //   data (7)
+};
+
+typedef struct event_log {
+    char text[256];
+    uint64_t leaf_bytes;
+} event_log_t;
+
+void log_event(chunk_event_t* event, void* user) {
+    event_log_t* log = user;
+    char item[32];
+    switch (event->type) {
+        case CHUNK_EVENT_ENTER_SET:
+            sprintf(item, "[%u ", event->depth);
+            break;
+        case CHUNK_EVENT_LEAVE_SET:
+            sprintf(item, "]%u ", event->depth);
+            break;
+        case CHUNK_EVENT_LEAF:
+            log->leaf_bytes += event->length;
+            if ((event->offset + event->length) != event->chunk.data_length) {
+                return;
+            }
+            sprintf(item, "%s:%u ", chunk_type_name(event->chunk.type), event->data[event->length - 1]);
+            break;
+    }
+    strcat(log->text, item);
+}
+
+const char* EXPECTED = "[0 uint32:9 [1 uint32:9 uint8:8 int8:7 ]1 uint16:8 int8:7 ]0 ";
+
+void test_chunk_stream_whole(test_harness_t* test) {
+    chunk_stream_t stream;
+    event_log_t log;
+    memset(&log, 0, sizeof(event_log_t));
+
+    chunk_stream_init(&stream, log_event, &log);
+    is_equal_uint8(test, chunk_stream_done(&stream), 0, "test_chunk_stream_whole(): not done before data");
+    chunk_error_t error = chunk_stream_push(&stream, TEST_STRUCTURE, 36);
+    is_equal_uint8(test, error, CHUNK_OK, "test_chunk_stream_whole(): no error");
+    is_equal_string(test, log.text, EXPECTED, "test_chunk_stream_whole(): events");
+    is_equal_uint64(test, log.leaf_bytes, 6, "test_chunk_stream_whole(): leaf bytes");
+    is_equal_uint8(test, chunk_stream_done(&stream), 1, "test_chunk_stream_whole(): done");
+    chunk_stream_destroy(&stream);
+}
+
+void test_chunk_stream_fragments(test_harness_t* test) {
+    chunk_stream_t stream;
+    event_log_t log;
+    memset(&log, 0, sizeof(event_log_t));
+
+    chunk_stream_init(&stream, log_event, &log);
+    for (uint8_t i = 0; i < 36; i++) {
+        chunk_stream_push(&stream, &TEST_STRUCTURE[i], 1);
+        if (i == 20) {
+            is_equal_uint8(test, chunk_stream_done(&stream), 0, "test_chunk_stream_fragments(): not done part way");
+            is_equal_uint32(test, stream.depth, 2, "test_chunk_stream_fragments(): depth part way");
+        }
+    }
+    is_equal_string(test, log.text, EXPECTED, "test_chunk_stream_fragments(): events");
+    is_equal_uint8(test, chunk_stream_done(&stream), 1, "test_chunk_stream_fragments(): done");
+    chunk_stream_destroy(&stream);
+}
+
+void test_chunk_stream_large_leaf(test_harness_t* test) {
+    chunk_stream_t stream;
+    event_log_t log;
+    memset(&log, 0, sizeof(event_log_t));
+    uint8_t data[1024];
+    memset(data, 0x05, 1024);
+    uint8_t* payload = chunk_write_header_compact(data, CHUNK_TYPE_UINT8, 1000);
+    uint64_t total = (payload - data) + 1000;
+
+    chunk_stream_init(&stream, log_event, &log);
+    chunk_stream_push(&stream, data, 100);
+    chunk_stream_push(&stream, &data[100], 300);
+    chunk_stream_push(&stream, &data[400], total - 400);
+    is_equal_string(test, log.text, "uint8:5 ", "test_chunk_stream_large_leaf(): events");
+    is_equal_uint64(test, log.leaf_bytes, 1000, "test_chunk_stream_large_leaf(): leaf bytes");
+    is_equal_uint8(test, chunk_stream_done(&stream), 1, "test_chunk_stream_large_leaf(): done");
+    chunk_stream_destroy(&stream);
+}
+
+void test_chunk_stream_counted(test_harness_t* test) {
+    chunk_stream_t stream;
+    event_log_t log;
+    memset(&log, 0, sizeof(event_log_t));
+    uint8_t data[] = {0xed, 0x06, 0x02, 0x11, 0x01, 0x09, 0x12, 0x01, 0x07};
+
+    chunk_stream_init(&stream, log_event, &log);
+    for (uint8_t i = 0; i < 9; i++) {
+        chunk_stream_push(&stream, &data[i], 1);
+    }
+    is_equal_string(test, log.text, "[0 uint8:9 int8:7 ]0 ", "test_chunk_stream_counted(): events");
+    is_equal_uint8(test, chunk_stream_done(&stream), 1, "test_chunk_stream_counted(): done");
+    chunk_stream_destroy(&stream);
+}
+
+void test_chunk_stream_errors(test_harness_t* test) {
+    chunk_stream_t stream;
+    event_log_t log;
+    memset(&log, 0, sizeof(event_log_t));
+
+    uint8_t overflow[] = {0x1d, 0x02, 0x11, 0x01, 0x09};
+    chunk_stream_init(&stream, log_event, &log);
+    is_equal_uint8(test, chunk_stream_push(&stream, overflow, 5), CHUNK_ERROR_OVERFLOW, "test_chunk_stream_errors(): child overflows set");
+    is_equal_uint8(test, chunk_stream_push(&stream, overflow, 1), CHUNK_ERROR_OVERFLOW, "test_chunk_stream_errors(): error is sticky");
+    chunk_stream_destroy(&stream);
+
+    // the child's length bytes run past the end of its set
+    uint8_t header[] = {0x1d, 0x02, 0x21, 0x01, 0x00, 0x05};
+    chunk_stream_init(&stream, log_event, &log);
+    is_equal_uint8(test, chunk_stream_push(&stream, header, 6), CHUNK_ERROR_OVERFLOW, "test_chunk_stream_errors(): header overflows set");
+    is_equal_uint8(test, chunk_stream_done(&stream), 0, "test_chunk_stream_errors(): header overflow not done");
+    is_equal_uint8(test, chunk_validate(header, 6, NULL), CHUNK_ERROR_TRUNCATED, "test_chunk_stream_errors(): validate agrees");
+    chunk_stream_destroy(&stream);
+
+    uint8_t wide[] = {0xf1, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x02};
+    chunk_stream_init(&stream, log_event, &log);
+    is_equal_uint8(test, chunk_stream_push(&stream, wide, 11), CHUNK_ERROR_LENGTH_BYTES, "test_chunk_stream_errors(): varint past 64 bits");
+    chunk_stream_destroy(&stream);
+
+    uint8_t type[] = {0x1e, 0x00};
+    chunk_stream_init(&stream, log_event, &log);
+    is_equal_uint8(test, chunk_stream_push(&stream, type, 2), CHUNK_ERROR_TYPE, "test_chunk_stream_errors(): unknown type");
+    chunk_stream_destroy(&stream);
+}
+
+int main(int argc, char** argv) {
+    test_harness_t test;
+    test_harness_init(&test);
+    test.verbose = 1;
+
+    test_chunk_stream_whole(&test);
+    test_chunk_stream_fragments(&test);
+    test_chunk_stream_large_leaf(&test);
+    test_chunk_stream_counted(&test);
+    test_chunk_stream_errors(&test);
+
+    test_harness_report(&test);
+    return 0;
+}
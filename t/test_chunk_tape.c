@@ -0,0 +1,128 @@
+#include "../chunk_tape.h"
+#include "test_harness.h"
+#include <stdio.h>
+
+uint8_t TEST_STRUCTURE[] = {
+    0x8d, // 8 length bytes, data type 12
+    0x1b, // 27 bytes long
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x15, //   1 length byte, data type 5
+    0x01, //   1 bytes long
+    0x09, //   data (9)
+    0x8d, //   1 length byte, data type 12
+    0x09, //   9 bytes long
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x15, //     1 length byte, data type 5
+    0x01, //     1 bytes long
+    0x09, //     data (9)
+    0x11, //     1 length byte, data type 1
+    0x01, //     1 bytes long
+    0x08, //     data (8)
+    0x12, //     1 length byte, data type 2
+    0x01, //     1 bytes long
+    0x07, //     data (7)
+    0x13, //   1 length byte, data type 3
+    0x01, //   1 bytes long
+    0x08, //   data (8)
+    0x12, //   1 length byte, data type 2
+    0x01, //   1 bytes long
+    0x07  //   data (7)
+};
+
+void test_chunk_tape_build(test_harness_t* test) {
+    chunk_tape_t tape;
+
+    uint8_t ok = chunk_tape_build(&tape, TEST_STRUCTURE);
+    is_equal_uint8(test, ok, 1, "test_chunk_tape_build(): built");
+    is_equal_uint32(test, tape.nr_entries, 8, "test_chunk_tape_build(): nr_entries");
+
+    uint8_t types[8] = {13, 5, 13, 5, 1, 2, 3, 2};
+    uint64_t offsets[8] = {0, 9, 12, 21, 24, 27, 30, 33};
+    uint32_t parents[8] = {CHUNK_TAPE_NONE, 0, 0, 2, 2, 2, 0, 0};
+    uint32_t nexts[8] = {CHUNK_TAPE_NONE, 2, 6, 4, 5, CHUNK_TAPE_NONE, 7, CHUNK_TAPE_NONE};
+    for (uint32_t i = 0; i < 8; i++) {
+        is_equal_uint8(test, tape.entries[i].type, types[i], "test_chunk_tape_build(): type");
+        is_equal_uint64(test, tape.entries[i].offset, offsets[i], "test_chunk_tape_build(): offset");
+        is_equal_uint32(test, tape.entries[i].parent, parents[i], "test_chunk_tape_build(): parent");
+        is_equal_uint32(test, tape.entries[i].next, nexts[i], "test_chunk_tape_build(): next");
+    }
+    is_equal_uint32(test, tape.nr_longs, 0, "test_chunk_tape_build(): no long lengths");
+
+    chunk_tape_destroy(&tape);
+}
+
+void test_chunk_tape_navigate(test_harness_t* test) {
+    chunk_tape_t tape;
+    chunk_tape_build(&tape, TEST_STRUCTURE);
+
+    is_equal_uint64(test, chunk_tape_nr_children(&tape, 0), 4, "test_chunk_tape_navigate(): [] nr_children");
+    is_equal_uint64(test, chunk_tape_nr_children(&tape, 2), 3, "test_chunk_tape_navigate(): [1] nr_children");
+    is_equal_uint64(test, chunk_tape_nr_children(&tape, 1), 0, "test_chunk_tape_navigate(): [0] nr_children");
+
+    uint32_t set = chunk_tape_nth_child(&tape, 0, 1);
+    is_equal_uint32(test, set, 2, "test_chunk_tape_navigate(): [1] entry");
+    uint32_t leaf = chunk_tape_nth_child(&tape, set, 2);
+    is_equal_uint32(test, leaf, 5, "test_chunk_tape_navigate(): [1:2] entry");
+    is_equal_uint32(test, chunk_tape_nth_child(&tape, set, 3), CHUNK_TAPE_NONE, "test_chunk_tape_navigate(): [1:3] overflow");
+    is_equal_uint32(test, chunk_tape_first_child(&tape, leaf), CHUNK_TAPE_NONE, "test_chunk_tape_navigate(): leaf has no children");
+
+    chunk_t chunk = chunk_tape_chunk(&tape, leaf);
+    chunk_t expected = chunk_decode(&TEST_STRUCTURE[27]);
+    is_equal_uint8(test, chunk.type, expected.type, "test_chunk_tape_navigate(): chunk type");
+    is_equal_uint64(test, chunk.total_length, expected.total_length, "test_chunk_tape_navigate(): chunk total_length");
+    is_equal_uint8(test, chunk.data[0], 7, "test_chunk_tape_navigate(): chunk data");
+    chunk_tape_destroy(&tape);
+
+    // the entry after an empty set is its sibling, not its child
+    uint8_t empty[] = {0x1d, 0x05, 0x1d, 0x00, 0x11, 0x01, 0x07};
+    chunk_tape_build(&tape, empty);
+    is_equal_uint32(test, chunk_tape_first_child(&tape, 1), CHUNK_TAPE_NONE, "test_chunk_tape_navigate(): empty set");
+    is_equal_uint64(test, chunk_tape_nr_children(&tape, 1), 0, "test_chunk_tape_navigate(): empty set nr_children");
+    is_equal_uint32(test, tape.entries[1].next, 2, "test_chunk_tape_navigate(): empty set next");
+    chunk_tape_destroy(&tape);
+}
+
+void test_chunk_tape_long(test_harness_t* test) {
+    // only the headers are read, so the 4GB payload need not exist
+    uint8_t data[] = {
+        0x8d, 0x0c, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+        0x11, 0x01, 0x07,
+        0x81, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00
+    };
+    chunk_tape_t tape;
+    is_equal_uint8(test, chunk_tape_build(&tape, data), 1, "test_chunk_tape_long(): built");
+    is_equal_uint32(test, tape.nr_entries, 3, "test_chunk_tape_long(): nr_entries");
+    is_equal_uint32(test, tape.nr_longs, 2, "test_chunk_tape_long(): nr_longs");
+    is_equal_uint32(test, tape.entries[2].data_length, CHUNK_TAPE_LONG, "test_chunk_tape_long(): marked long");
+    is_equal_uint64(test, chunk_tape_data_length(&tape, 0), 0x10000000cULL, "test_chunk_tape_long(): set length");
+    is_equal_uint64(test, chunk_tape_data_length(&tape, 1), 1, "test_chunk_tape_long(): short length");
+    is_equal_uint64(test, chunk_tape_chunk(&tape, 2).total_length, 0x100000009ULL, "test_chunk_tape_long(): leaf total_length");
+    is_equal_uint32(test, chunk_tape_nth_child(&tape, 0, 1), 2, "test_chunk_tape_long(): [1] entry");
+    is_equal_uint32(test, tape.entries[2].parent, 0, "test_chunk_tape_long(): parent");
+    chunk_tape_destroy(&tape);
+}
+
+int main(int argc, char** argv) {
+    test_harness_t test;
+    test_harness_init(&test);
+    test.verbose = 1;
+
+    test_chunk_tape_build(&test);
+    test_chunk_tape_navigate(&test);
+    test_chunk_tape_long(&test);
+
+    test_harness_report(&test);
+    return 0;
+}